@@ -1,22 +1,94 @@
-#include <iterator>
-#include <utility>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <vector>
 #include <fmt/format.h>
 
-[[nodiscard]] auto sum_values(const uint8_t *Data, size_t Size)
+#include "usp.h"
+#include "verifier.h"
+#include "basicsolver.h"
+#include "dpllsolver.h"
+#include "cdclsolver.h"
+#include "cnfsolver.h"
+#include "matchingsolver.h"
+
+namespace {
+
+// Largest puzzle decoded from an input, and the largest given to the exhaustive solver
+constexpr unsigned int kMaxRows = 10;
+constexpr unsigned int kMaxCols = 10;
+constexpr unsigned int kMaxBasicRows = 5;
+// Node budget of each solver, so a single input can not stall the fuzzer
+constexpr unsigned long long kMaxDecisions = 5000;
+
+/* Decode an input into a puzzle: the first two bytes pick n and k, and the
+ * remaining bytes hold five cells each as base 3 digits, as UspGenerator draws
+ * them. Cells past the end of the input are 1.
+ */
+usp::Usp DecodePuzzle(const uint8_t *Data, size_t Size)
 {
-  constexpr auto scale = 1000;
+  const unsigned int n = 1 + (Size > 0 ? Data[0] : 0U) % kMaxRows;
+  const unsigned int k = 1 + (Size > 1 ? Data[1] : 0U) % kMaxCols;
+  std::vector<int> cells(n * k, 1);
+  std::size_t cell = 0;
+  for (std::size_t byte = 2; byte < Size && cell < cells.size(); ++byte) {
+    // A byte below 243 = 3^5 is five uniform base 3 digits, larger ones would favour the low digits
+    if (Data[byte] >= 243) {
+      continue;
+    }
+    unsigned int digits = Data[byte];
+    for (unsigned int digit = 0; digit < 5 && cell < cells.size(); ++digit, digits /= 3) {
+      cells[cell++] = static_cast<int>(digits % 3) + 1;
+    }
+  }
+  return usp::Usp(std::move(cells), n, k);
+}
 
-  int value = 0;
-  for (std::size_t offset = 0; offset < Size; ++offset) {
-    value += static_cast<int>(*std::next(Data, static_cast<long>(offset))) * scale;
+[[noreturn]] void Fail(const usp::Usp &puzzle, const char *message)
+{
+  fmt::print(stderr, "{} on a ({}, {}) puzzle:\n", message, puzzle.rows(), puzzle.cols());
+  for (unsigned int row = 0; row < puzzle.rows(); ++row) {
+    for (unsigned int col = 0; col < puzzle.cols(); ++col) {
+      fmt::print(stderr, "{}", puzzle.element(row, col));
+    }
+    fmt::print(stderr, "\n");
   }
-  return value;
+  std::abort();
 }
 
-// Fuzzer that attempts to invoke undefined behavior for signed integer overflow
+}// namespace
+
+// Differential fuzzer: every solver must reach the same verdict, and every witness must verify
 // cppcheck-suppress unusedFunction symbolName=LLVMFuzzerTestOneInput
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
 {
-  fmt::print("Value sum: {}, len{}\n", sum_values(Data,Size), Size);
+  const usp::Usp puzzle = DecodePuzzle(Data, Size);
+  usp::SolverLimits limits;
+  limits.maxDecisions = kMaxDecisions;
+
+  std::optional<bool> weak;
+  auto check = [&puzzle, &weak](const char *name, usp::SolverStatus status, const std::optional<std::pair<usp::Permutation, usp::Permutation>> &witness) {
+    if (status == usp::SolverStatus::UNKNOWN) {
+      return;
+    }
+    // VerifyUspWeakness accepts the identity pair, which proves nothing
+    if (witness.has_value() && (usp::IsIdentityWitness(witness->first.assignments(), witness->second.assignments()) || !usp::VerifyUspWeakness(puzzle, witness->first, witness->second))) {
+      Fail(puzzle, name);
+    }
+    const bool verdict = status == usp::SolverStatus::WEAK;
+    if (weak.has_value() && *weak != verdict) {
+      Fail(puzzle, "Solvers disagree");
+    }
+    weak = verdict;
+  };
+
+  if (puzzle.rows() <= kMaxBasicRows) {
+    auto witness = usp::BasicSolver(puzzle, 1);
+    check("BasicSolver witness fails", witness.has_value() ? usp::SolverStatus::WEAK : usp::SolverStatus::STRONG, witness);
+  }
+  for (const auto &[name, solve] : { std::make_pair("DPLL witness fails", &usp::DpllSolve), std::make_pair("CDCL witness fails", &usp::CdclSolve), std::make_pair("CNF witness fails", &usp::CnfSolve), std::make_pair("Matching witness fails", &usp::MatchingSolve) }) {
+    usp::SolverResult result = solve(puzzle, limits);
+    check(name, result.status, result.witness);
+  }
   return 0;
 }
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+#include "uspgenerator.h"
+
+// Throughput driver for the differential fuzz target, built without libFuzzer
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size);
+
+namespace {
+
+// Read every file of the given paths, descending into directories
+std::vector<std::vector<uint8_t>> LoadCorpus(const std::vector<std::string> &paths)
+{
+  std::vector<std::vector<uint8_t>> inputs;
+  auto load = [&inputs](const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    inputs.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  };
+  for (const std::string &path : paths) {
+    if (std::filesystem::is_directory(path)) {
+      for (const auto &entry : std::filesystem::recursive_directory_iterator(path)) {
+        if (entry.is_regular_file()) {
+          load(entry.path());
+        }
+      }
+    } else {
+      load(path);
+    }
+  }
+  return inputs;
+}
+
+// Random inputs covering every puzzle size the target decodes
+std::vector<std::vector<uint8_t>> RandomCorpus(std::size_t count)
+{
+  usp::Xoshiro256 random(0);
+  std::vector<std::vector<uint8_t>> inputs(count);
+  for (auto &input : inputs) {
+    input.resize(2 + 25);
+    for (uint8_t &byte : input) {
+      byte = static_cast<uint8_t>(random());
+    }
+  }
+  return inputs;
+}
+
+}// namespace
+
+/* Usage: fuzz_throughput <seconds> [<corpus file or directory>...]
+ * Replays the corpus, or random inputs if none is given, through the
+ * fuzz target until the time is up and reports the executions per second.
+ * Aborts like the fuzzer on the first disagreement between solvers.
+ */
+int main(int argc, const char **argv)
+{
+  const double seconds = argc > 1 ? std::stod(argv[1]) : 10.0;
+  std::vector<std::string> paths(argc > 2 ? std::next(argv, 2) : std::next(argv, argc), std::next(argv, argc));
+  std::vector<std::vector<uint8_t>> inputs = paths.empty() ? RandomCorpus(4096) : LoadCorpus(paths);
+  if (inputs.empty()) {
+    fmt::print(stderr, "Empty corpus\n");
+    return 1;
+  }
+
+  unsigned long long executions = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{ 0 };
+  do {
+    for (const auto &input : inputs) {
+      LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    executions += inputs.size();
+    elapsed = std::chrono::steady_clock::now() - startTime;
+  } while (elapsed.count() < seconds);
+
+  fmt::print("{} executions over {} inputs in {:.2f}s, {:.0f} execs/s\n", executions, inputs.size(), elapsed.count(), static_cast<double>(executions) / elapsed.count());
+  return 0;
+}
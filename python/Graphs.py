@@ -1,6 +1,12 @@
 from matplotlib import pyplot as plt
 from USP import UspRecursive, UspWeaknessVerifier, GenerateUsp, Permutation
 from Sat import SatReduction, ExtractAssignment
+# Native solvers, built with -DENABLE_PYTHON=ON; put the build directory on PYTHONPATH.
+# Without them only the Python solvers are timed
+try:
+    import pyusp
+except ImportError:
+    pyusp = None
 
 import numpy as np
 import scipy.stats as st
@@ -20,6 +26,18 @@ def TestDPLL(Usps):
                                   loc=mean, scale=sigma)
 
 
+def TestNative(Usps, solver="cdcl"):
+    # Packed from the int8 arrays up front, so only the solves are timed
+    puzzles = [pyusp.Usp(np.array(Usp, dtype=np.int8)) for Usp in Usps]
+    results = []
+    for puzzle in puzzles:
+        results += [timeit.timeit(functools.partial(pyusp.solve,
+                                                    puzzle, solver), number=1)]
+    mean, sigma = np.mean(results), np.std(results)
+    return mean, st.norm.interval(0.90,
+                                  loc=mean, scale=sigma)
+
+
 def TestSAT(Usps):
     results = []
     for Usp in Usps:
@@ -32,40 +50,33 @@ def TestSAT(Usps):
 def produce_graphs():
     sizes = [x for x in range(4, 20)]
     labels = ["(" + str(x) + ", " + str(math.floor(1.5 * x)) + ")" for x in sizes]
+    tests = [("DPLL Solver", TestDPLL), ("SAT reduction + pysat", TestSAT)]
+    if pyusp is not None:
+        tests += [("Native CDCL Solver", TestNative)]
     results = []
 
     samples = 100
 
     for size in sizes:
         print("Running size: ", size)
-        # Average runtime of 100 runs on both methods for each
+        # Average runtime of 100 runs on every method for each
         # data point
         genUsps = [GenerateUsp(size, math.floor(size * 1.5))
                    for x in range(samples)]
 
-        rec = TestDPLL(genUsps)
-        sat = TestSAT(genUsps)
-
-        results += [(rec, sat)]
+        results += [[test(genUsps) for _, test in tests]]
 
-    fig, (ax1, ax2) = plt.subplots(2, 1, figsize=(15, 15))
+    fig, axes = plt.subplots(len(tests), 1, figsize=(15, 7.5 * len(tests)))
 
     fig.suptitle("90% CI of runtimes solving USP")
     fig.tight_layout(pad=12.0)
 
-    ax1.set_title("DPLL Solver")
-    ax2.set_title("SAT reduction + pysat")
-
-    ax1.set_xlabel("USP size (n, k)")
-    ax2.set_xlabel("USP size (n, k)")
-
-    ax1.set_ylabel("Time (seconds)")
-    ax2.set_ylabel("Time (seconds)")
-
-    ax1.errorbar(labels, [result[0][0] for result in results], yerr=[
-        result[0][1][1] - result[0][0] for result in results])
-    ax2.errorbar(labels, [result[1][0] for result in results], yerr=[
-        result[1][1][1] - result[1][0] for result in results])
+    for i, (ax, (title, _)) in enumerate(zip(axes, tests)):
+        ax.set_title(title)
+        ax.set_xlabel("USP size (n, k)")
+        ax.set_ylabel("Time (seconds)")
+        ax.errorbar(labels, [result[i][0] for result in results], yerr=[
+            result[i][1][1] - result[i][0] for result in results])
 
     plt.show()
     fig.savefig("USP Graphs")
@@ -0,0 +1,74 @@
+# Smoke tests of the pyusp extension module, run by ctest when built with
+# -DENABLE_PYTHON=ON. The module must be on PYTHONPATH.
+import threading
+import time
+import unittest
+
+import numpy as np
+
+import pyusp
+
+
+class TestPyusp(unittest.TestCase):
+    def test_construction(self):
+        cells = np.array([[1, 2], [3, 1], [2, 3]], dtype=np.int8)
+        puzzle = pyusp.Usp(cells)
+        self.assertEqual((puzzle.rows, puzzle.cols), (3, 2))
+        self.assertFalse(puzzle.lazy)
+        np.testing.assert_array_equal(puzzle.cells(), cells)
+        # The puzzle owns a copy of the cells
+        cells[0, 0] = 3
+        self.assertEqual(puzzle.element(0, 0), 1)
+        # Strided int8 arrays are accepted
+        np.testing.assert_array_equal(pyusp.Usp(cells.T.copy().T).cells(), cells)
+        self.assertTrue(pyusp.Usp(cells, lazy=True).lazy)
+
+    def test_rejected_cells(self):
+        with self.assertRaises(TypeError):
+            pyusp.Usp(np.array([[1.5, 2.0]]))
+        with self.assertRaises(TypeError):
+            pyusp.Usp(np.array([[1, 257]], dtype=np.int32))
+        for value in (0, 4, -1):
+            with self.assertRaises(ValueError):
+                pyusp.Usp(np.array([[1, value]], dtype=np.int8))
+        with self.assertRaises(ValueError):
+            pyusp.Usp(np.array([1, 2, 3], dtype=np.int8))
+
+    def test_solvers_agree(self):
+        puzzles = [pyusp.generate(6, 4, seed) for seed in range(20)]
+        expected = [pyusp.solve(puzzle, "dpll").status for puzzle in puzzles]
+        for solver in ("cdcl", "cnf", "matching"):
+            results = pyusp.solve_batch(puzzles, solver, threads=4)
+            self.assertEqual([result.status for result in results], expected)
+            for puzzle, result in zip(puzzles, results):
+                if result.weak:
+                    self.assertTrue(pyusp.verify(puzzle, *result.witness))
+        lazy = pyusp.Usp(puzzles[0].cells(), lazy=True)
+        with self.assertRaises(ValueError):
+            pyusp.solve_batch([lazy, lazy], threads=2)
+
+    def test_batch_releases_gil(self):
+        # Near the threshold, so each solve takes a while
+        puzzles = [pyusp.generate(13, 8, seed) for seed in range(8)]
+        ticks = [0]
+        stop = threading.Event()
+
+        def count():
+            while not stop.is_set():
+                ticks[0] += 1
+                time.sleep(0)
+
+        counter = threading.Thread(target=count)
+        counter.start()
+        try:
+            before = ticks[0]
+            pyusp.solve_batch(puzzles, "cdcl", threads=2)
+            # Only a released GIL lets the counter run during the batch
+            self.assertGreater(ticks[0], before)
+        finally:
+            stop.set()
+            counter.join()
+
+
+if __name__ == "__main__":
+    unittest.main()
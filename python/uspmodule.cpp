@@ -0,0 +1,196 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "usp.h"
+#include "uspgenerator.h"
+#include "solverregistry.h"
+#include "batchserver.h"
+#include "verifier.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace {
+
+usp::SolverLimits MakeLimits(unsigned long long timeout, unsigned long long maxDecisions, unsigned long long maxConflicts, std::size_t maxLearnedBytes)
+{
+  usp::SolverLimits limits;
+  limits.wallTime = std::chrono::milliseconds(timeout);
+  limits.maxDecisions = maxDecisions;
+  limits.maxConflicts = maxConflicts;
+  limits.maxLearnedBytes = maxLearnedBytes;
+  return limits;
+}
+
+/* Build a puzzle from a 2D array of cells. The puzzle packs its own copy of
+ * the cells, so it does not keep the array alive or see later writes to it.
+ * The array must be int8, as casting would silently truncate floats and wrap
+ * out of range integers, and every cell must be 1, 2 or 3 ('std::invalid_argument').
+ * A C contiguous array is packed from its buffer, a strided one is made
+ * contiguous first. The GIL is released while the cells are packed and the
+ * query tensor is computed, the array staying referenced by the call.
+ */
+usp::Usp MakeUsp(const py::array &array, bool lazy, std::size_t cachedSlabs)
+{
+  if (!py::isinstance<py::array_t<std::int8_t>>(array)) {
+    throw py::type_error("Usp cells must be an int8 array, not " + std::string(py::str(array.dtype())));
+  }
+  if (array.ndim() != 2) {
+    throw std::invalid_argument("Usp cells must be a 2D array");
+  }
+  const auto cells = py::array_t<std::int8_t, py::array::c_style>::ensure(array);
+  if (!lazy) {
+    cachedSlabs = 0;
+  } else if (cachedSlabs == 0) {
+    cachedSlabs = usp::Usp::kCacheEverySlab;
+  }
+  const auto n = static_cast<unsigned int>(cells.shape(0));
+  const auto k = static_cast<unsigned int>(cells.shape(1));
+  const std::int8_t *data = cells.data();
+  py::gil_scoped_release release;
+  return usp::Usp(data, n, k, cachedSlabs);
+}
+
+// Copy of the cells of puzzle as a (n, k) int8 array
+py::array_t<std::int8_t> UspCells(const usp::Usp &puzzle)
+{
+  py::array_t<std::int8_t> cells(std::vector<py::ssize_t>{ puzzle.rows(), puzzle.cols() });
+  auto view = cells.mutable_unchecked<2>();
+  for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+    for (unsigned int j = 0; j < puzzle.cols(); ++j) {
+      view(i, j) = static_cast<std::int8_t>(puzzle.element(i, j));
+    }
+  }
+  return cells;
+}
+
+/* True iff rho and sigma, as column arrays, prove puzzle weak.
+ * Throws 'std::invalid_argument' if either is not a permutation of the rows
+ */
+bool Verify(const usp::Usp &puzzle, const std::vector<unsigned int> &rho, const std::vector<unsigned int> &sigma)
+{
+  for (const std::vector<unsigned int> *permutation : { &rho, &sigma }) {
+    std::vector<unsigned int> sorted(*permutation);
+    std::sort(sorted.begin(), sorted.end());
+    bool valid = sorted.size() == puzzle.rows();
+    for (std::size_t i = 0; valid && i < sorted.size(); ++i) {
+      valid = sorted[i] == i;
+    }
+    if (!valid) {
+      throw std::invalid_argument("Witness is not a permutation of the rows");
+    }
+  }
+  bool identity = true;
+  for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+    identity = identity && rho[i] == i && sigma[i] == i;
+  }
+  return !identity && usp::FirstFailingRow(puzzle, rho, sigma) == usp::kNoFailingRow;
+}
+
+// The witness of a weak result as a tuple of column arrays, or None
+py::object Witness(const usp::SolverResult &result)
+{
+  if (!result.witness.has_value()) {
+    return py::none();
+  }
+  return py::make_tuple(result.witness->first.assignments(), result.witness->second.assignments());
+}
+
+}// namespace
+
+PYBIND11_MODULE(pyusp, module)
+{
+  module.doc() = "USP weakness puzzles and the native solvers. Solves of eager puzzles release the GIL, "
+                 "and solve_batch spreads a list of puzzles over native threads.";
+
+  py::enum_<usp::SolverStatus>(module, "SolverStatus")
+    .value("WEAK", usp::SolverStatus::WEAK)
+    .value("STRONG", usp::SolverStatus::STRONG)
+    .value("UNKNOWN", usp::SolverStatus::UNKNOWN);
+
+  py::class_<usp::SolverStats>(module, "SolverStats")
+    .def_readonly("decisions", &usp::SolverStats::decisions)
+    .def_readonly("conflicts", &usp::SolverStats::conflicts)
+    .def_readonly("learned_clauses", &usp::SolverStats::learnedClauses)
+    .def_readonly("learned_bytes", &usp::SolverStats::learnedBytes)
+    .def_readonly("probes", &usp::SolverStats::probes)
+    .def_readonly("failed_literals", &usp::SolverStats::failedLiterals);
+
+  py::class_<usp::SolverResult>(module, "SolverResult")
+    .def_readonly("status", &usp::SolverResult::status)
+    .def_readonly("stats", &usp::SolverResult::stats)
+    .def_property_readonly("weak", [](const usp::SolverResult &result) { return result.status == usp::SolverStatus::WEAK; })
+    .def_property_readonly("witness", &Witness, "(rho, sigma) as column arrays if weak, otherwise None");
+
+  py::class_<usp::Usp>(module, "Usp")
+    .def(py::init(&MakeUsp), py::arg("cells"), py::arg("lazy") = false, py::arg("cached_slabs") = 0,
+      "Puzzle of a (n, k) int8 array of 1, 2 and 3. The cells are copied into the puzzle's own 2-bit packed storage. "
+      "A lazy puzzle computes its query tensor a slab at a time, keeping every slab "
+      "or at most cached_slabs of them")
+    .def_property_readonly("rows", &usp::Usp::rows)
+    .def_property_readonly("cols", &usp::Usp::cols)
+    .def_property_readonly("lazy", &usp::Usp::lazy)
+    .def_property_readonly("slabs_computed", &usp::Usp::slabsComputed)
+    .def("query", [](const usp::Usp &puzzle, unsigned int a, unsigned int b, unsigned int c) {
+      if (a >= puzzle.rows() || b >= puzzle.rows() || c >= puzzle.rows()) {
+        throw py::index_error("Usp row out of range");
+      }
+      return puzzle.query(a, b, c);
+    })
+    .def("element", [](const usp::Usp &puzzle, unsigned int row, unsigned int col) {
+      if (row >= puzzle.rows() || col >= puzzle.cols()) {
+        throw py::index_error("Usp cell out of range");
+      }
+      return puzzle.element(row, col);
+    })
+    .def("cells", &UspCells, "Copy of the cells as a (n, k) int8 array")
+    .def("__repr__", [](const usp::Usp &puzzle) {
+      return "<Usp " + std::to_string(puzzle.rows()) + "x" + std::to_string(puzzle.cols()) + ">";
+    });
+
+  module.def("generate", [](unsigned int n, unsigned int k, std::uint64_t seed) {
+    usp::UspGenerator generator(seed);
+    return generator.generateRandomPuzzle(n, k);
+  }, py::arg("n"), py::arg("k"), py::arg("seed"), "Random (n, k) puzzle drawn as by runsolver from seed");
+
+  module.def("verify", &Verify, py::arg("puzzle"), py::arg("rho"), py::arg("sigma"),
+    "True iff the column arrays rho and sigma prove puzzle weak");
+
+  module.def("solve", [](const usp::Usp &puzzle, const std::string &solver, unsigned long long timeout, unsigned long long maxDecisions, unsigned long long maxConflicts, std::size_t maxLearnedBytes) {
+    // Throws 'std::invalid_argument', a ValueError in Python, for an unknown name
+    const usp::SolveFunction solve = usp::SolverByName(solver);
+    const usp::SolverLimits limits = MakeLimits(timeout, maxDecisions, maxConflicts, maxLearnedBytes);
+    // Another Python thread could query a lazy puzzle, and so update its cache, while the GIL is released
+    if (puzzle.lazy()) {
+      return solve(puzzle, limits);
+    }
+    py::gil_scoped_release release;
+    return solve(puzzle, limits);
+  },
+    py::arg("puzzle"), py::arg("solver") = "cdcl", py::arg("timeout_ms") = 0, py::arg("max_decisions") = 0, py::arg("max_conflicts") = 0, py::arg("max_learned_bytes") = 0,
+    "Solve puzzle with the dpll, cdcl, cnf or matching solver. A limit of 0 is unlimited");
+
+  module.def("solve_batch", [](const std::vector<const usp::Usp *> &puzzles, const std::string &solver, unsigned int threads, unsigned long long timeout, unsigned long long maxDecisions, unsigned long long maxConflicts, std::size_t maxLearnedBytes) {
+    if (std::find(puzzles.begin(), puzzles.end(), nullptr) != puzzles.end()) {
+      throw std::invalid_argument("solve_batch takes a list of Usp");
+    }
+    const usp::SolveFunction solve = usp::SolverByName(solver);
+    const usp::SolverLimits limits = MakeLimits(timeout, maxDecisions, maxConflicts, maxLearnedBytes);
+    // SolveBatch keeps a lazy puzzle on one thread, but not away from other Python threads
+    if (std::any_of(puzzles.begin(), puzzles.end(), [](const usp::Usp *puzzle) { return puzzle->lazy(); })) {
+      return usp::SolveBatch(puzzles, solve, limits, threads);
+    }
+    py::gil_scoped_release release;
+    return usp::SolveBatch(puzzles, solve, limits, threads);
+  },
+    py::arg("puzzles"), py::arg("solver") = "cdcl", py::arg("threads") = 0, py::arg("timeout_ms") = 0, py::arg("max_decisions") = 0, py::arg("max_conflicts") = 0, py::arg("max_learned_bytes") = 0,
+    "Solve a list of puzzles on threads native threads (0 for every core), each under the limits. "
+    "The results are in the order of puzzles");
+}
@@ -0,0 +1,64 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<unsigned long long> allocations{ 0 };
+std::atomic<unsigned long long> allocatedBytes{ 0 };
+
+void *CountedAllocate(std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  // malloc(0) may return nullptr, while new must return a unique pointer
+  return std::malloc(size != 0 ? size : 1);
+}
+
+}// namespace
+
+namespace usp {
+
+unsigned long long AllocationCount()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
+
+unsigned long long AllocatedBytes()
+{
+  return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+}// namespace usp
+
+// Replacements of the global allocation functions. The array, sized and
+// nothrow forms of the standard library forward to these
+void *operator new(std::size_t size)
+{
+  if (void *pointer = CountedAllocate(size)) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+  return CountedAllocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t /*size*/) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+  std::free(pointer);
+}
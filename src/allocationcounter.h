@@ -0,0 +1,15 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+namespace usp {
+
+/* Heap allocations made through operator new since the program started,
+ * over all threads. Defined by allocationcounter.cpp, which replaces the
+ * global operator new and delete, so only binaries that link it can call them.
+ */
+unsigned long long AllocationCount();
+unsigned long long AllocatedBytes();
+
+}// namespace usp
+
+#endif
@@ -9,65 +9,201 @@
 #include <algorithm>
 #include <numeric>
 #include <sstream>
+#include <stdexcept>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace usp {
 
-/* Naive algorithm to solve USP Weakness
- * Attempts all permutations (n!)
- * Returns a pair of permutations if one has been found 
- * which verifies the USP as weak.
+/* Number of ordered arrangements of length elements taken from n,
+ * n! / (n - length)!. This is the size of the rank space of a
+ * permutation prefix.
  */
-std::optional<std::pair<Permutation, Permutation>> BasicSolver(const Usp &puzzle)
+unsigned long long PermutationPrefixCount(unsigned int n, unsigned int length)
 {
-  // Generate the identity {0, ..., n}
-  auto generateRange = [&puzzle]() -> std::vector<unsigned int> {
-    std::vector<unsigned int> range(puzzle.rows());
-    std::iota(range.begin(), range.end(), 0);
-    return range;
-  };
+  unsigned long long count = 1;
+  for (unsigned int i = 0; i < length; ++i) {
+    count *= n - i;
+  }
+  return count;
+}
 
-  // O(n) algorithm to check if a vector is the identity {0, ..., n}
-  auto isIdentity = [](const std::vector<unsigned int> &range) {
-    auto it = range.begin();
-    while (it != range.end()) {
-      if (*it != std::distance(range.begin(), it)) {
-        return false;
-      }
-      ++it;
+/* Maps a rank in [0, PermutationPrefixCount(n, length)) to the first
+ * length entries of a permutation of {0, ..., n - 1}, in lexicographic order.
+ */
+std::vector<unsigned int> UnrankPermutationPrefix(unsigned long long rank, unsigned int n, unsigned int length)
+{
+  std::vector<unsigned int> remaining(n);
+  std::iota(remaining.begin(), remaining.end(), 0);
+
+  std::vector<unsigned int> prefix;
+  prefix.reserve(length);
+  for (unsigned int i = 0; i < length; ++i) {
+    unsigned long long block = PermutationPrefixCount(n - i - 1, length - i - 1);
+    auto index = static_cast<long>(rank / block);
+    rank %= block;
+    prefix.push_back(remaining[static_cast<unsigned int>(index)]);
+    remaining.erase(std::next(remaining.begin(), index));
+  }
+  return prefix;
+}
+
+/* Exhaustive search over plain index arrays.
+ * Rows are assigned in order, picking rho(i) then sigma(i), and a row is
+ * rejected as soon as query(i, rho(i), sigma(i)) holds, so no completion of
+ * a failing prefix is ever enumerated.
+ * A prefix of rho can be fixed to split the search space between threads.
+ */
+class ExhaustiveSearch
+{
+public:
+  ExhaustiveSearch(const Usp &puzzle, const std::atomic<bool> &stop) : m_puzzle(puzzle), m_stop(stop), m_rho(puzzle.rows()), m_sigma(puzzle.rows()), m_rhoUsed(puzzle.rows(), 0), m_sigmaUsed(puzzle.rows(), 0)
+  {}
+
+  // Search every completion of rho beginning with rhoPrefix. Returns true if a witness was found
+  bool search(const std::vector<unsigned int> &rhoPrefix)
+  {
+    std::fill(m_rhoUsed.begin(), m_rhoUsed.end(), 0);
+    std::fill(m_sigmaUsed.begin(), m_sigmaUsed.end(), 0);
+    for (unsigned int value : rhoPrefix) {
+      m_rhoUsed[value] = 1;
     }
-    return true;
-  };
+    m_prefix = &rhoPrefix;
+    return searchRow(0, true);
+  }
 
+  const std::vector<unsigned int> &rho() const
+  {
+    return m_rho;
+  }
 
-  std::vector<unsigned int> range1 = generateRange();
-  do {
-    Permutation rho(puzzle.rows());
+  const std::vector<unsigned int> &sigma() const
+  {
+    return m_sigma;
+  }
 
-    std::vector<unsigned int> range2 = generateRange();
-    for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+private:
+  bool searchRow(unsigned int row, bool identity)
+  {
+    if (row == m_puzzle.rows()) {
+      // Both permutations must not be the identity
+      return !identity;
+    }
+    if (m_stop.load(std::memory_order_relaxed)) {
+      return false;
+    }
 
-      rho.assign(i, range1[i], true);
+    if (row < m_prefix->size()) {
+      return searchSigma(row, (*m_prefix)[row], identity);
+    }
+    for (unsigned int b = 0; b < m_puzzle.rows(); ++b) {
+      if (!m_rhoUsed[b]) {
+        m_rhoUsed[b] = 1;
+        bool found = searchSigma(row, b, identity);
+        m_rhoUsed[b] = 0;
+        if (found) {
+          return true;
+        }
+      }
     }
-    do {
-      Permutation sigma(puzzle.rows());
+    return false;
+  }
 
-      // Check at least one string is not the identity
-      if (!isIdentity(range1) || !isIdentity(range2)) {
-        for (unsigned int i = 0; i < puzzle.rows(); ++i) {
-          sigma.assign(i, range2[i], true);
+  bool searchSigma(unsigned int row, unsigned int b, bool identity)
+  {
+    m_rho[row] = b;
+    for (unsigned int c = 0; c < m_puzzle.rows(); ++c) {
+      if (!m_sigmaUsed[c] && !m_puzzle.query(row, b, c)) {
+        m_sigmaUsed[c] = 1;
+        m_sigma[row] = c;
+        bool found = searchRow(row + 1, identity && b == row && c == row);
+        m_sigmaUsed[c] = 0;
+        if (found) {
+          return true;
         }
-        if (VerifyUspWeakness(puzzle, rho, sigma)) {
-          return std::make_optional<std::pair<Permutation, Permutation>>(rho, sigma);
+      }
+    }
+    return false;
+  }
+
+  const Usp &m_puzzle;
+  const std::atomic<bool> &m_stop;
+  const std::vector<unsigned int> *m_prefix{ nullptr };
+  std::vector<unsigned int> m_rho;
+  std::vector<unsigned int> m_sigma;
+  std::vector<char> m_rhoUsed;
+  std::vector<char> m_sigmaUsed;
+};
+
+/* Naive algorithm to solve USP Weakness
+ * Attempts all permutations (n!^2), rejecting a row as soon as it fails.
+ * The rho space is split by prefix rank between threads
+ * (0 uses the hardware concurrency).
+ * Returns a pair of permutations if one has been found
+ * which verifies the USP as weak.
+ * Throws 'std::invalid_argument' if puzzle is lazy and threads is not 1,
+ * as the threads would share its slab cache.
+ */
+std::optional<std::pair<Permutation, Permutation>> BasicSolver(const Usp &puzzle, unsigned int threads = 0)
+{
+  if (puzzle.lazy() && threads != 1) {
+    throw std::invalid_argument("BasicSolver of a lazy puzzle must use one thread");
+  }
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+
+  // Fix enough of rho that every thread gets several prefixes to work through
+  unsigned int prefixLength = 0;
+  while (prefixLength < puzzle.rows() && PermutationPrefixCount(puzzle.rows(), prefixLength) < 8ULL * threads) {
+    ++prefixLength;
+  }
+  const unsigned long long tasks = PermutationPrefixCount(puzzle.rows(), prefixLength);
+
+  std::atomic<bool> stop{ false };
+  std::atomic<unsigned long long> nextTask{ 0 };
+  std::mutex resultMutex;
+  std::optional<std::pair<std::vector<unsigned int>, std::vector<unsigned int>>> witness;
+
+  auto worker = [&]() {
+    ExhaustiveSearch search(puzzle, stop);
+    for (unsigned long long task = nextTask++; task < tasks && !stop.load(std::memory_order_relaxed); task = nextTask++) {
+      if (search.search(UnrankPermutationPrefix(task, puzzle.rows(), prefixLength))) {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        if (!witness.has_value()) {
+          witness = std::make_pair(search.rho(), search.sigma());
         }
+        stop = true;
       }
-    } while (std::next_permutation(range2.begin(), range2.end()));
-  } while (std::next_permutation(range1.begin(), range1.end()));
+    }
+  };
+
+  threads = static_cast<unsigned int>(std::min<unsigned long long>(threads, tasks));
+  std::vector<std::thread> pool;
+  for (unsigned int i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
 
   // Strong USP, return nullopt
-  return std::nullopt;
+  if (!witness.has_value()) {
+    return std::nullopt;
+  }
+
+  Permutation rho(puzzle.rows());
+  Permutation sigma(puzzle.rows());
+  for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+    rho.assign(i, witness->first[i], true);
+    sigma.assign(i, witness->second[i], true);
+  }
+  return std::make_optional<std::pair<Permutation, Permutation>>(rho, sigma);
 }
 
 }// namespace usp
 
 
-#endif
\ No newline at end of file
+#endif
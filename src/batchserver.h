@@ -0,0 +1,403 @@
+#ifndef BATCH_SERVER_H
+#define BATCH_SERVER_H
+
+#include "usp.h"
+#include "solverlimits.h"
+#include "littleendian.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace usp {
+
+using BatchSolveFunction = std::function<SolverResult(const Usp &, const SolverLimits &)>;
+
+struct BatchServerOptions
+{
+  // Worker threads solving puzzles, 0 for every core
+  unsigned int threads{ 0 };
+  // Puzzles read but not yet written. Reading stops once this many are in flight
+  unsigned int maxInFlight{ 64 };
+  // Write results in input order, instead of as they finish
+  bool ordered{ true };
+  // Read puzzles in the packed binary form instead of as text
+  bool binary{ false };
+  SolverLimits limits{};
+  /* Largest puzzle accepted. The query tensor of each puzzle in flight takes
+   * rows^2 * (rows / 64 + 1) words, so larger puzzles are answered with an error
+   */
+  unsigned int maxRows{ 256 };
+  unsigned int maxCols{ 256 };
+};
+
+/* Counters of a batch server run
+ */
+struct BatchServerStats
+{
+  unsigned long long puzzles{ 0 };
+  unsigned long long weak{ 0 };
+  unsigned long long strong{ 0 };
+  unsigned long long unknown{ 0 };
+  unsigned long long errors{ 0 };
+  // Most puzzles in flight at once
+  unsigned long long peakInFlight{ 0 };
+};
+
+/* Solves a stream of puzzles on a pool of workers, writing a line per puzzle.
+ *
+ * Text input has a puzzle per line, its rows as digits separated by spaces,
+ * e.g. "123 312". Blank lines and lines starting with '#' are skipped.
+ * Binary input is a sequence of records: uint32 rows, uint32 cols (little
+ * endian), then the cells packed as in PackedCellsView.
+ *
+ * Every result line is "<index> <verdict> <microseconds> <decisions> <conflicts>",
+ * where verdict is weak, strong or unknown, followed for a weak puzzle by
+ * rho and sigma as comma separated values. A text line or binary record that
+ * is not a puzzle, or is larger than maxRows by maxCols, and a solve or result
+ * line that throws, give "<index> error <message>". Lines are flushed as they are written.
+ *
+ * The calling thread reads and blocks while maxInFlight puzzles are read but
+ * not yet written, which bounds the memory of both the queue and, for ordered
+ * output, the results held back until their predecessors finish.
+ */
+class BatchServer
+{
+public:
+  BatchServer(BatchSolveFunction solve, const BatchServerOptions &options) : m_solve(std::move(solve)), m_options(options)
+  {
+    m_options.maxInFlight = std::max(1U, m_options.maxInFlight);
+  }
+
+  /* Solve every puzzle of in, writing the results to out. Returns once all are written.
+   * Throws 'std::runtime_error' if binary input ends inside a puzzle. Any
+   * exception is rethrown once the workers have written the puzzles before it
+   */
+  BatchServerStats run(std::istream &in, std::ostream &out)
+  {
+    m_out = &out;
+    m_stats = {};
+    m_done = false;
+    m_failure = nullptr;
+    m_nextWrite = 0;
+
+    const unsigned int threads = m_options.threads != 0 ? m_options.threads : std::max(1U, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    unsigned long long index = 0;
+    // Malformed input ends the run once the puzzles before it are written
+    std::exception_ptr error;
+    try {
+      for (unsigned int t = 0; t < threads; ++t) {
+        workers.emplace_back([this]() { work(); });
+      }
+      for (std::optional<Job> job = readJob(in, index); job.has_value(); job = readJob(in, index)) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_space.wait(lock, [this]() { return m_inFlight < m_options.maxInFlight || m_failure; });
+        if (m_failure) {
+          break;
+        }
+        ++m_inFlight;
+        m_stats.peakInFlight = std::max<unsigned long long>(m_stats.peakInFlight, m_inFlight);
+        m_queue.push_back(std::move(*job));
+        m_work.notify_one();
+        ++index;
+      }
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_done = true;
+    }
+    m_work.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+    m_stats.puzzles = index;
+    if (!error) {
+      error = m_failure;
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return m_stats;
+  }
+
+private:
+  struct Job
+  {
+    unsigned long long index;
+    std::optional<Usp> puzzle;
+    // Reason the input was not a puzzle, if it was not
+    std::string error;
+  };
+
+  // Read the next puzzle, or nothing at the end of the input
+  std::optional<Job> readJob(std::istream &in, unsigned long long index) const
+  {
+    if (m_options.binary) {
+      std::array<char, 8> header{};
+      if (!in.read(header.data(), header.size())) {
+        if (in.gcount() != 0) {
+          throw std::runtime_error("Truncated binary puzzle " + std::to_string(index));
+        }
+        return std::nullopt;
+      }
+      const auto rows = ReadLittleEndian<std::uint32_t>(reinterpret_cast<const std::uint8_t *>(header.data()));
+      const auto cols = ReadLittleEndian<std::uint32_t>(reinterpret_cast<const std::uint8_t *>(header.data() + 4));
+      if (rows > m_options.maxRows || cols > m_options.maxCols) {
+        // Skip the cells without holding them, so the next record can still be read
+        const std::size_t bytes = PackedCellsView::PackedBytes(rows, cols);
+        if (in.ignore(static_cast<std::streamsize>(bytes)).gcount() != static_cast<std::streamsize>(bytes)) {
+          throw std::runtime_error("Truncated binary puzzle " + std::to_string(index));
+        }
+        return Job{ index, std::nullopt, tooLarge(rows, cols) };
+      }
+      std::vector<std::uint8_t> cells(PackedCellsView::PackedBytes(rows, cols));
+      if (!in.read(reinterpret_cast<char *>(cells.data()), static_cast<std::streamsize>(cells.size()))) {
+        throw std::runtime_error("Truncated binary puzzle " + std::to_string(index));
+      }
+      try {
+        return Job{ index, Usp(PackedCellsView(cells.data(), rows, cols)), {} };
+      } catch (const std::invalid_argument &error) {
+        return Job{ index, std::nullopt, error.what() };
+      }
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty() || line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') {
+        continue;
+      }
+      std::istringstream words(line);
+      std::vector<int> data;
+      unsigned int rows = 0;
+      std::size_t cols = 0;
+      std::string row;
+      while (words >> row) {
+        if (rows != 0 && row.size() != cols) {
+          return Job{ index, std::nullopt, "rows of different widths" };
+        }
+        cols = row.size();
+        for (char element : row) {
+          data.push_back(element - '0');
+        }
+        ++rows;
+      }
+      if (rows > m_options.maxRows || cols > m_options.maxCols) {
+        return Job{ index, std::nullopt, tooLarge(rows, cols) };
+      }
+      try {
+        return Job{ index, Usp(std::move(data), rows, static_cast<unsigned int>(cols)), {} };
+      } catch (const std::invalid_argument &error) {
+        return Job{ index, std::nullopt, error.what() };
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::string tooLarge(std::size_t rows, std::size_t cols) const
+  {
+    return "puzzle of " + std::to_string(rows) + "x" + std::to_string(cols) + " is larger than "
+           + std::to_string(m_options.maxRows) + "x" + std::to_string(m_options.maxCols);
+  }
+
+  void work()
+  {
+    std::ostringstream line;
+    while (true) {
+      Job job{};
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_work.wait(lock, [this]() { return m_done || !m_queue.empty(); });
+        if (m_queue.empty()) {
+          return;
+        }
+        job = std::move(m_queue.front());
+        m_queue.pop_front();
+      }
+
+      // Whatever the job throws, from the solve or from formatting and recording its line, gives an error line
+      try {
+        std::optional<SolverStatus> status;
+        std::string text = resultLine(job, line, status);
+        finish(job.index, status, std::move(text));
+      } catch (const std::exception &error) {
+        fail(job.index, error.what());
+      } catch (...) {
+        fail(job.index, "solver failed");
+      }
+    }
+  }
+
+  // Solve job and format its result line, setting status unless the job is an input error
+  std::string resultLine(const Job &job, std::ostringstream &line, std::optional<SolverStatus> &status) const
+  {
+    line.str({});
+    line << job.index << " ";
+    if (!job.puzzle.has_value()) {
+      line << "error " << job.error << "\n";
+      return line.str();
+    }
+    auto startTime = std::chrono::steady_clock::now();
+    SolverResult result = m_solve(*job.puzzle, m_options.limits);
+    std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - startTime;
+    line << (result.status == SolverStatus::WEAK ? "weak" : result.status == SolverStatus::STRONG ? "strong" : "unknown")
+         << " " << static_cast<unsigned long long>(duration.count())
+         << " " << result.stats.decisions
+         << " " << result.stats.conflicts;
+    if (result.witness.has_value()) {
+      for (const Permutation *permutation : { &result.witness->first, &result.witness->second }) {
+        const char *separator = " ";
+        for (unsigned int value : permutation->assignments()) {
+          line << separator << value;
+          separator = ",";
+        }
+      }
+    }
+    line << "\n";
+    status = result.status;
+    return line.str();
+  }
+
+  /* Record an error line for the puzzle at index. If even that throws, the
+   * puzzle can never be written, so reading stops and run rethrows
+   */
+  void fail(unsigned long long index, const char *message) noexcept
+  {
+    try {
+      finish(index, std::nullopt, std::to_string(index) + " error " + message + "\n");
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_failure) {
+        m_failure = std::current_exception();
+      }
+      m_space.notify_all();
+    }
+  }
+
+  // Record a result and write every result that is due
+  void finish(unsigned long long index, std::optional<SolverStatus> status, std::string text)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_options.ordered) {
+      *m_out << text << std::flush;
+      --m_inFlight;
+    } else {
+      m_held.emplace(index, std::move(text));
+      for (auto next = m_held.find(m_nextWrite); next != m_held.end(); next = m_held.find(m_nextWrite)) {
+        *m_out << next->second;
+        m_held.erase(next);
+        ++m_nextWrite;
+        --m_inFlight;
+      }
+      *m_out << std::flush;
+    }
+    // Counted once recorded, so a result that throws above can be recorded again as an error
+    if (!status.has_value()) {
+      ++m_stats.errors;
+    } else if (*status == SolverStatus::WEAK) {
+      ++m_stats.weak;
+    } else if (*status == SolverStatus::STRONG) {
+      ++m_stats.strong;
+    } else {
+      ++m_stats.unknown;
+    }
+    m_space.notify_one();
+  }
+
+  BatchSolveFunction m_solve;
+  BatchServerOptions m_options;
+  std::ostream *m_out{ nullptr };
+
+  std::mutex m_mutex;
+  // Signalled when a job is queued or the input ends
+  std::condition_variable m_work;
+  // Signalled when a result is written
+  std::condition_variable m_space;
+  std::deque<Job> m_queue;
+  // Results of ordered output waiting for an earlier puzzle
+  std::map<unsigned long long, std::string> m_held;
+  unsigned long long m_nextWrite{ 0 };
+  unsigned int m_inFlight{ 0 };
+  bool m_done{ false };
+  // Set when a result could not even be recorded as an error
+  std::exception_ptr m_failure;
+  BatchServerStats m_stats;
+};
+
+/* Solve every puzzle under limits on up to threads threads (0 uses the
+ * hardware concurrency), returning the results in the order of puzzles.
+ * Threads take the next unsolved puzzle as they finish, so uneven solve
+ * times balance out. The puzzles are not copied, so a lazy puzzle is only
+ * ever solved by one thread at a time: throws 'std::invalid_argument' if one
+ * is passed twice on more than one thread. An exception thrown by a solve is
+ * rethrown once every thread has stopped, the remaining puzzles being left
+ * unsolved.
+ */
+inline std::vector<SolverResult> SolveBatch(const std::vector<const Usp *> &puzzles, const BatchSolveFunction &solve, const SolverLimits &limits, unsigned int threads = 0)
+{
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  if (threads > 1) {
+    std::vector<const Usp *> lazy;
+    std::copy_if(puzzles.begin(), puzzles.end(), std::back_inserter(lazy), [](const Usp *puzzle) { return puzzle->lazy(); });
+    std::sort(lazy.begin(), lazy.end());
+    if (std::adjacent_find(lazy.begin(), lazy.end()) != lazy.end()) {
+      throw std::invalid_argument("A lazy puzzle appears twice in the batch");
+    }
+  }
+  std::vector<SolverResult> results(puzzles.size());
+  std::atomic<std::size_t> next{ 0 };
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    for (std::size_t i = next++; i < puzzles.size(); i = next++) {
+      try {
+        results[i] = solve(*puzzles[i], limits);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = puzzles.size();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (std::size_t i = 1; i < std::min<std::size_t>(threads, puzzles.size()); ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
+}// namespace usp
+
+#endif
@@ -35,9 +35,9 @@ void CdclUnitPropagation(const Usp &puzzle, const std::unique_ptr<Permutation> &
   // Apply unit propagation from setting (assignment) = true in the corresponding permutation
   for (unsigned int i = 0; i < puzzle.rows(); ++i) {
     if (assignmentToRho && puzzle.query(assignment.first, assignment.second, i)) {
-      sigma->assign(assignment.first, i, false, depth, { SatVariable(assignment, true, assignmentToRho) });// antecedent should be rho(assignment)
+      sigma->assign(assignment.first, i, false, depth, { SatVariable(assignment, false, assignmentToRho) });// antecedent should be rho(assignment)
     } else if (!assignmentToRho && puzzle.query(assignment.first, i, assignment.second)) {
-      rho->assign(assignment.first, i, false, depth, { SatVariable(assignment, true, assignmentToRho) });// antecedent should be sigma(assignment)
+      rho->assign(assignment.first, i, false, depth, { SatVariable(assignment, false, assignmentToRho) });// antecedent should be sigma(assignment)
     }
   }
   // Apply unit propagation through learned clauses
@@ -49,8 +49,8 @@ SatClause CdclConflictAnalysis(const std::unique_ptr<Permutation> &rho, const st
   // implication graph backwards
   SatClause learnedClause;
   std::queue<SatVariable> implicationGraphQueue;
-  std::vector<SatVariable> rhoAntecedents = rho->contradictionAntecedents(depth);
-  std::vector<SatVariable> sigmaAntecedents = sigma->contradictionAntecedents(depth);
+  std::vector<SatVariable> rhoAntecedents = rho->contradictionAntecedents();
+  std::vector<SatVariable> sigmaAntecedents = sigma->contradictionAntecedents();
   std::vector<SatVariable> antecedents;
 
   for (unsigned int i = 0; i < rhoAntecedents.size(); ++i) {
@@ -87,7 +87,18 @@ SatClause CdclConflictAnalysis(const std::unique_ptr<Permutation> &rho, const st
   return learnedClause;
 }
 
-std::optional<std::pair<Permutation, Permutation>> CdclSolverImpl(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, std::set<SatClause> &learnedClauses, int depth)
+/* Approximate memory held by a learned clause, counting the set nodes
+ */
+std::size_t LearnedClauseBytes(const SatClause &clause)
+{
+  return sizeof(SatClause) + clause.size() * (sizeof(SatVariable) + 4 * sizeof(void *));
+}
+
+/* Enumerate every witness below the current assignment, passing each to onWitness.
+ * Learned clauses are implied by the puzzle, so they never exclude a witness.
+ * Returns true if the callback or the budget stopped the enumeration.
+ */
+bool CdclSolverImpl(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, std::set<SatClause> &learnedClauses, int depth, const WitnessCallback &onWitness, SolverBudget &budget)
 {
   // Update clauses
   for (auto &satClause : learnedClauses) {
@@ -97,90 +108,153 @@ std::optional<std::pair<Permutation, Permutation>> CdclSolverImpl(const Usp &puz
 
   // Check contradiction
   if (rho->checkContradiction() || sigma->checkContradiction()) {
-    return std::nullopt;
+    return false;
   }
 
   // Check assignments are not both the identity
   if (rho->checkIdentity() && sigma->checkIdentity()) {
     spdlog::debug("Identity found");
-    return std::nullopt;
+    return false;
   }
 
   // Check if rho and sigma have complete assignments
   auto rhoAssignment = rho->nextAssignment();
   auto sigmaAssignment = sigma->nextAssignment();
-  if (!rho->nextAssignment().has_value() && !sigma->nextAssignment().has_value()) {
+  if (!rhoAssignment.has_value() && !sigmaAssignment.has_value()) {
     spdlog::debug("Solution found, Weak USP");
-    // Copy rho and sigma instead of just dereferencing.
-    return std::make_optional<std::pair<Permutation, Permutation>>(*rho, *sigma);
+    USP_TRACE(budget, TraceEvent::WITNESS, depth);
+    return !onWitness(*rho, *sigma);
   }
 
   // Branch on an assignment, applying unit propagation
-  if (rhoAssignment.has_value()) {
-    std::vector<unsigned int> possibleAssignments = rho->possibleAssignments(rhoAssignment.value());
-    for (unsigned int assignment : possibleAssignments) {
-      rho->assignPropagate(rhoAssignment.value(), assignment, true, depth);
-      CdclUnitPropagation(puzzle, rho, sigma, { rhoAssignment.value(), assignment }, true, depth);
-
-      bool success = ClauseUnitPropagation(rho, sigma, learnedClauses, depth);
-
-      // Check if any value cannot be assigned
-      if (rho->checkContradiction() || sigma->checkContradiction()) {
-        SatClause learnedClause = CdclConflictAnalysis(rho, sigma, depth);
-        if (learnedClause.size() != 0) {
-          learnedClauses.insert(learnedClause);
-        }
-      }
+  bool branchRho = rhoAssignment.has_value();
+  unsigned int row = branchRho ? rhoAssignment.value() : sigmaAssignment.value();
+  std::vector<unsigned int> possibleAssignments;
+  if (budget.probeAllowed()) {
+    /* Removing a failed literal here would give it no antecedents for the
+     * conflict analysis, so instead branch on its row and try it first,
+     * learning the clause that removes it. Otherwise follow the lookahead.
+     */
+    Lookahead lookahead = UspLookahead(puzzle, rho, sigma, depth, budget, false);
+    if (!lookahead.failed.empty()) {
+      const auto [failedRho, failedRow, failedColumn] = lookahead.failed.front();
+      branchRho = failedRho;
+      row = failedRow;
+      possibleAssignments = (branchRho ? rho : sigma)->possibleAssignments(row);
+      std::stable_partition(possibleAssignments.begin(), possibleAssignments.end(), [&, failedRho = failedRho, failedRow = failedRow](unsigned int column) {
+        return std::find(lookahead.failed.begin(), lookahead.failed.end(), std::make_tuple(failedRho, failedRow, column)) != lookahead.failed.end();
+      });
+    } else if (lookahead.probed) {
+      branchRho = lookahead.branchRho;
+      row = lookahead.branchRow;
+      possibleAssignments = lookahead.branchCandidates;
+    }
+  }
+  const std::unique_ptr<Permutation> &branch = branchRho ? rho : sigma;
+  if (possibleAssignments.empty()) {
+    possibleAssignments = branch->possibleAssignments(row);
+  }
+  for (unsigned int assignment : possibleAssignments) {
+    if (budget.decide()) {
+      return true;
+    }
+    USP_TRACE(budget, TraceEvent::DECISION, depth, row, assignment, branchRho ? 1 : 0);
+    USP_TRACE(budget, TraceEvent::PROPAGATION_BEGIN, depth);
+    branch->assignPropagate(row, assignment, branchRho, depth);
+    CdclUnitPropagation(puzzle, rho, sigma, { row, assignment }, branchRho, depth);
 
-      // Continue through the tree only if the clause propagation didn't find a contradiction
-      if (success) {
-        auto result = CdclSolverImpl(puzzle, rho, sigma, learnedClauses, depth + 1);
+    bool success = ClauseUnitPropagation(rho, sigma, learnedClauses, depth);
+    USP_TRACE(budget, TraceEvent::PROPAGATION_END, depth);
 
-        // Success!
-        if (result.has_value()) {
-          return result;
-        }
+    // Check if any value cannot be assigned
+    bool exhausted = false;
+    if (rho->checkContradiction() || sigma->checkContradiction()) {
+      USP_TRACE(budget, TraceEvent::CONFLICT, depth);
+      exhausted = budget.conflict();
+      SatClause learnedClause = CdclConflictAnalysis(rho, sigma, depth);
+      if (learnedClause.size() != 0 && learnedClauses.insert(learnedClause).second) {
+        USP_TRACE(budget, TraceEvent::LEARN, depth, static_cast<std::uint32_t>(learnedClause.size()));
+        exhausted = budget.learn(LearnedClauseBytes(learnedClause)) || exhausted;
       }
-      // Try again
-      rho->undoPropagation(depth);
-      sigma->undoPropagation(depth);
+    } else if (!success) {
+      USP_TRACE(budget, TraceEvent::CONFLICT, depth);
+      exhausted = budget.conflict();
     }
-  } else {
-    std::vector<unsigned int> possibleAssignments = sigma->possibleAssignments(sigmaAssignment.value());
-    for (unsigned int assignment : possibleAssignments) {
-      sigma->assignPropagate(sigmaAssignment.value(), assignment, false, depth);
-      CdclUnitPropagation(puzzle, rho, sigma, { sigmaAssignment.value(), assignment }, false, depth);
-
-      bool success = ClauseUnitPropagation(rho, sigma, learnedClauses, depth);
-
-      // Check if any value cannot be assigned
-      if (rho->checkContradiction() || sigma->checkContradiction()) {
-        SatClause learnedClause = CdclConflictAnalysis(rho, sigma, depth);
-        if (learnedClause.size() != 0) {
-          learnedClauses.insert(learnedClause);
-        }
-      }
 
-      if (success) {
-        auto result = CdclSolverImpl(puzzle, rho, sigma, learnedClauses, depth + 1);
-        if (result.has_value()) {
-          return result;
-        }
-      }
-      rho->undoPropagation(depth);
-      sigma->undoPropagation(depth);
+    // Continue through the tree only if the clause propagation didn't find a contradiction
+    bool stopped = exhausted || (success && CdclSolverImpl(puzzle, rho, sigma, learnedClauses, depth + 1, onWitness, budget));
+    // Try again
+    rho->undoPropagation(depth);
+    sigma->undoPropagation(depth);
+    if (stopped) {
+      return true;
     }
   }
-  return std::nullopt;
+  // Every branch failed, chronologically back to the level above
+  USP_TRACE(budget, TraceEvent::BACKTRACK, depth, static_cast<std::uint32_t>(std::max(depth - 1, 0)), 1);
+  return false;
+}
+
+/* Solve within limits, returning UNKNOWN if a limit is reached first.
+ */
+SolverResult CdclSolve(const Usp &puzzle, const SolverLimits &limits)
+{
+  std::set<SatClause> learnedClauses;
+  SolverResult result;
+  SolverBudget budget(limits);
+  // Copy rho and sigma instead of just dereferencing.
+  CdclSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), learnedClauses, 0, [&result](const Permutation &rho, const Permutation &sigma) {
+    result.witness = std::make_pair(rho, sigma);
+    return false;
+  }, budget);
+  result.status = result.witness.has_value() ? SolverStatus::WEAK : budget.exhausted() ? SolverStatus::UNKNOWN : SolverStatus::STRONG;
+  result.stats = budget.stats();
+  return result;
 }
 
 std::optional<std::pair<Permutation, Permutation>> CdclSolver(const Usp &puzzle)
+{
+  return CdclSolve(puzzle, {}).witness;
+}
+
+/* Stream every witness of the puzzle to onWitness without copying them.
+ * Returns true if the callback stopped the enumeration.
+ */
+bool CdclEnumerate(const Usp &puzzle, const WitnessCallback &onWitness)
 {
   std::set<SatClause> learnedClauses;
-  return CdclSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), learnedClauses, 0);
+  SolverBudget budget;
+  return CdclSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), learnedClauses, 0, onWitness, budget);
+}
+
+/* Count every witness of the puzzle without materializing them.
+ * The subtrees below each rho(0) are counted in parallel, each
+ * learning its own clauses.
+ * Throws 'std::invalid_argument' if puzzle is lazy and threads is not 1.
+ */
+unsigned long long CdclCountWitnesses(const Usp &puzzle, unsigned int threads = 0)
+{
+  if (puzzle.lazy() && threads != 1) {
+    throw std::invalid_argument("CdclCountWitnesses of a lazy puzzle must use one thread");
+  }
+  return CountSubtreesInParallel(puzzle.rows(), threads, [&puzzle](unsigned int column) {
+    auto rho = std::make_unique<Permutation>(puzzle.rows());
+    auto sigma = std::make_unique<Permutation>(puzzle.rows());
+    std::set<SatClause> learnedClauses;
+    rho->assignPropagate(0, column, true, 0);
+    CdclUnitPropagation(puzzle, rho, sigma, { 0, column }, true, 0);
+
+    unsigned long long count = 0;
+    SolverBudget budget;
+    CdclSolverImpl(puzzle, rho, sigma, learnedClauses, 1, [&count](const Permutation &, const Permutation &) {
+      ++count;
+      return true;
+    }, budget);
+    return count;
+  });
 }
 
 }// namespace usp
 
 
-#endif
\ No newline at end of file
+#endif
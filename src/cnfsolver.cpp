@@ -0,0 +1,313 @@
+#include "cnfsolver.h"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+namespace usp {
+
+UspCnfEncoder::UspCnfEncoder(IncrementalSatSolver &solver) : m_solver(solver)
+{}
+
+int UspCnfEncoder::x(unsigned int i, unsigned int j) const
+{
+  return m_tables[0][i][j];
+}
+
+int UspCnfEncoder::y(unsigned int i, unsigned int j) const
+{
+  return m_tables[1][i][j];
+}
+
+int UspCnfEncoder::activation() const
+{
+  return m_activation;
+}
+
+void UspCnfEncoder::addToAtMostOne(AtMostOne &group, int literal)
+{
+  if (group.prefix == 0 && group.literals.size() < kPairwiseLimit) {
+    for (int other : group.literals) {
+      m_solver.addClause({ -other, -literal });
+    }
+    group.literals.push_back(literal);
+    group.prefixes.push_back(0);
+    return;
+  }
+
+  if (group.prefix == 0) {
+    group.prefix = m_solver.newVariable();
+    for (int other : group.literals) {
+      m_solver.addClause({ -other, group.prefix });
+    }
+    group.prefixes.back() = group.prefix;
+  }
+  // Sequential counter: the next prefix holds iff one of the literals so far is true
+  int next = m_solver.newVariable();
+  m_solver.addClause({ -literal, -group.prefix });
+  m_solver.addClause({ -group.prefix, next });
+  m_solver.addClause({ -literal, next });
+  group.prefix = next;
+  group.literals.push_back(literal);
+  group.prefixes.push_back(next);
+}
+
+void UspCnfEncoder::removeFromAtMostOne(AtMostOne &group)
+{
+  m_solver.addClause({ -group.literals.back() });
+  // Nothing follows the prefix of the removed literal, so setting it true only keeps it from being decided
+  if (group.prefixes.back() != 0) {
+    m_solver.addClause({ group.prefixes.back() });
+  }
+  group.literals.pop_back();
+  group.prefixes.pop_back();
+  group.prefix = group.prefixes.empty() ? 0 : group.prefixes.back();
+}
+
+void UspCnfEncoder::forbid(const Usp &puzzle, unsigned int i, unsigned int b, unsigned int c)
+{
+  if ((puzzle.slab(i, b)[c / 64] >> (c % 64)) & 1) {
+    m_solver.addClause({ -x(b, i), -y(c, i) });
+  }
+}
+
+void UspCnfEncoder::activate()
+{
+  if (m_activation != 0) {
+    m_solver.addClause({ -m_activation });
+  }
+  m_activation = m_solver.newVariable();
+
+  // Every position takes a value
+  for (const auto &table : m_tables) {
+    for (unsigned int j = 0; j < m_rows; ++j) {
+      std::vector<int> position{ -m_activation };
+      for (unsigned int i = 0; i < m_rows; ++i) {
+        position.push_back(table[i][j]);
+      }
+      m_solver.addClause(position);
+    }
+  }
+
+  // Both permutations are not the identity
+  std::vector<int> identity{ -m_activation };
+  for (unsigned int i = 0; i < m_rows; ++i) {
+    identity.push_back(-x(i, i));
+    identity.push_back(-y(i, i));
+  }
+  m_solver.addClause(identity);
+}
+
+void UspCnfEncoder::encode(const Usp &puzzle)
+{
+  const unsigned int n = puzzle.rows();
+  m_rows = n;
+  for (auto &table : m_tables) {
+    table.assign(n, std::vector<int>(n));
+    for (unsigned int i = 0; i < n; ++i) {
+      for (unsigned int j = 0; j < n; ++j) {
+        table[i][j] = m_solver.newVariable();
+      }
+    }
+  }
+
+  // Both are permutations: a position takes at most one value and a value is taken at most once
+  for (unsigned int t = 0; t < m_tables.size(); ++t) {
+    m_positions[t].assign(n, {});
+    m_values[t].assign(n, {});
+    for (unsigned int a = 0; a < n; ++a) {
+      for (unsigned int b = 0; b < n; ++b) {
+        addToAtMostOne(m_positions[t][a], m_tables[t][b][a]);
+        addToAtMostOne(m_values[t][a], m_tables[t][a][b]);
+      }
+    }
+  }
+
+  for (unsigned int i = 0; i < n; ++i) {
+    for (unsigned int b = 0; b < n; ++b) {
+      for (unsigned int c = 0; c < n; ++c) {
+        forbid(puzzle, i, b, c);
+      }
+    }
+  }
+
+  activate();
+}
+
+void UspCnfEncoder::extend(const Usp &puzzle)
+{
+  const unsigned int n = m_rows;
+  if (puzzle.rows() != n + 1) {
+    throw std::invalid_argument("UspCnfEncoder::extend");
+  }
+  m_rows = n + 1;
+
+  for (unsigned int t = 0; t < m_tables.size(); ++t) {
+    auto &table = m_tables[t];
+    for (unsigned int i = 0; i < n; ++i) {
+      table[i].push_back(m_solver.newVariable());
+    }
+    table.emplace_back();
+    for (unsigned int j = 0; j < n + 1; ++j) {
+      table[n].push_back(m_solver.newVariable());
+    }
+
+    // Old positions and values gain the new row, and the new row gets groups of its own
+    for (unsigned int a = 0; a < n; ++a) {
+      addToAtMostOne(m_positions[t][a], table[n][a]);
+      addToAtMostOne(m_values[t][a], table[a][n]);
+    }
+    m_positions[t].emplace_back();
+    m_values[t].emplace_back();
+    for (unsigned int b = 0; b < n + 1; ++b) {
+      addToAtMostOne(m_positions[t][n], table[b][n]);
+      addToAtMostOne(m_values[t][n], table[n][b]);
+    }
+  }
+
+  // Only triples with the new row are new
+  for (unsigned int i = 0; i < n + 1; ++i) {
+    for (unsigned int b = 0; b < n + 1; ++b) {
+      if (i == n || b == n) {
+        for (unsigned int c = 0; c < n + 1; ++c) {
+          forbid(puzzle, i, b, c);
+        }
+      } else {
+        forbid(puzzle, i, b, n);
+      }
+    }
+  }
+
+  activate();
+}
+
+void UspCnfEncoder::shrink(const Usp &puzzle)
+{
+  if (m_rows == 0 || puzzle.rows() != m_rows - 1) {
+    throw std::invalid_argument("UspCnfEncoder::shrink");
+  }
+  const unsigned int n = m_rows - 1;
+  m_rows = n;
+
+  for (unsigned int t = 0; t < m_tables.size(); ++t) {
+    auto &table = m_tables[t];
+    // The groups of the last row hold only its own variables
+    for (unsigned int b = 0; b < n + 1; ++b) {
+      m_solver.addClause({ -table[b][n] });
+      m_solver.addClause({ -table[n][b] });
+    }
+    m_positions[t].pop_back();
+    m_values[t].pop_back();
+    for (unsigned int a = 0; a < n; ++a) {
+      removeFromAtMostOne(m_positions[t][a]);
+      removeFromAtMostOne(m_values[t][a]);
+      table[a].pop_back();
+    }
+    table.pop_back();
+  }
+
+  activate();
+}
+
+std::pair<Permutation, Permutation> UspCnfEncoder::witness() const
+{
+  Permutation rho(m_rows);
+  Permutation sigma(m_rows);
+  for (unsigned int i = 0; i < m_rows; ++i) {
+    for (unsigned int j = 0; j < m_rows; ++j) {
+      if (m_solver.modelValue(x(i, j))) {
+        rho.assign(j, i, true);
+      }
+      if (m_solver.modelValue(y(i, j))) {
+        sigma.assign(j, i, true);
+      }
+    }
+  }
+  return { rho, sigma };
+}
+
+namespace {
+
+  // Solve the puzzle encoded by encoder and translate the result
+  SolverResult SolveEncoded(IncrementalSatSolver &solver, const UspCnfEncoder &encoder, const SolverLimits &limits)
+  {
+    SolverResult result;
+    switch (solver.solve({ encoder.activation() }, limits)) {
+    case IncrementalSatSolver::Result::SATISFIABLE:
+      result.status = SolverStatus::WEAK;
+      result.witness = encoder.witness();
+      break;
+    case IncrementalSatSolver::Result::UNSATISFIABLE:
+      result.status = SolverStatus::STRONG;
+      break;
+    case IncrementalSatSolver::Result::UNKNOWN:
+      result.status = SolverStatus::UNKNOWN;
+      break;
+    }
+    result.stats = solver.stats();
+    return result;
+  }
+
+}// namespace
+
+IncrementalUspSolver::IncrementalUspSolver(Usp puzzle) : m_puzzle(std::move(puzzle)), m_encoder(m_solver)
+{
+  m_encoder.encode(m_puzzle);
+}
+
+void IncrementalUspSolver::appendRow(const std::vector<int> &row)
+{
+  m_puzzle.appendRow(row);
+  m_encoder.extend(m_puzzle);
+  if (m_strong) {
+    // The activation literal guards the clause, since it only holds while the new row is the last
+    const unsigned int n = m_puzzle.rows() - 1;
+    m_solver.addClause({ -m_encoder.activation(), -m_encoder.x(n, n), -m_encoder.y(n, n) });
+  }
+  m_strongBefore.push_back(m_strong);
+  m_strong = false;
+}
+
+void IncrementalUspSolver::popRow()
+{
+  m_puzzle.popRow();
+  m_encoder.shrink(m_puzzle);
+  // The puzzle is back to the one before the row was appended
+  m_strong = !m_strongBefore.empty() && m_strongBefore.back();
+  if (!m_strongBefore.empty()) {
+    m_strongBefore.pop_back();
+  }
+}
+
+void IncrementalUspSolver::markStrong()
+{
+  m_strong = true;
+}
+
+SolverResult IncrementalUspSolver::solve(const SolverLimits &limits)
+{
+  SolverResult result = SolveEncoded(m_solver, m_encoder, limits);
+  m_strong = result.status == SolverStatus::STRONG;
+  return result;
+}
+
+const Usp &IncrementalUspSolver::puzzle() const
+{
+  return m_puzzle;
+}
+
+SolverResult CnfSolve(const Usp &puzzle, const SolverLimits &limits)
+{
+  IncrementalSatSolver solver;
+  UspCnfEncoder encoder(solver);
+  encoder.encode(puzzle);
+  spdlog::debug("Encoded USP with {} variables", solver.variables());
+  return SolveEncoded(solver, encoder, limits);
+}
+
+std::optional<std::pair<Permutation, Permutation>> CnfSolver(const Usp &puzzle)
+{
+  return CnfSolve(puzzle).witness;
+}
+
+}// namespace usp
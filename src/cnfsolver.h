@@ -0,0 +1,127 @@
+#ifndef CNF_SOLVER_H
+#define CNF_SOLVER_H
+
+#include "usp.h"
+#include "satsolver.h"
+#include "solverlimits.h"
+
+#include <array>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace usp {
+
+/* Encodes a Usp as CNF for an IncrementalSatSolver.
+ * x(i, j) is true iff rho(j) = i and y(i, j) iff sigma(j) = i. Encoding a
+ * puzzle into an empty solver numbers them as python/Sat.py does,
+ * x(i, j) = i * n + j + 1 and y(i, j) = n^2 + i * n + j + 1, followed by
+ * auxiliary variables.
+ * The encoding can be extended by a row of the puzzle at a time. Clauses
+ * that a new row would weaken, that every position takes a value and
+ * that the permutations are not the identity, are guarded by an
+ * activation literal which solves must assume. Extending retires the
+ * old activation literal, so every clause learned from them is satisfied.
+ * Shrinking sets the variables of the last row false for good, which
+ * satisfies every clause that mentions them.
+ */
+class UspCnfEncoder
+{
+public:
+  // Groups of at most this many literals are encoded pairwise, larger ones with a sequential counter
+  static constexpr std::size_t kPairwiseLimit = 6;
+
+  explicit UspCnfEncoder(IncrementalSatSolver &solver);
+
+  // Add the clauses of puzzle to the solver
+  void encode(const Usp &puzzle);
+  // Add the clauses of the last row of puzzle, which has one more row than the encoded one
+  void extend(const Usp &puzzle);
+  // Retire the variables of the last encoded row, after it was removed from puzzle
+  void shrink(const Usp &puzzle);
+  // Literal to assume when solving the encoded puzzle
+  int activation() const;
+
+  // Variable of rho(j) = i
+  int x(unsigned int i, unsigned int j) const;
+  // Variable of sigma(j) = i
+  int y(unsigned int i, unsigned int j) const;
+
+  // Read rho and sigma from the model of the last satisfiable solve
+  std::pair<Permutation, Permutation> witness() const;
+
+private:
+  /* At most one of literals may hold. Once it outgrows kPairwiseLimit,
+   * prefix holds if any of literals does, and each further literal
+   * extends a sequential counter from it.
+   */
+  struct AtMostOne
+  {
+    std::vector<int> literals;
+    int prefix{ 0 };
+    // Prefix after each literal was added, to remove literals again
+    std::vector<int> prefixes;
+  };
+
+  void addToAtMostOne(AtMostOne &group, int literal);
+  // Remove the last literal of group and set it false
+  void removeFromAtMostOne(AtMostOne &group);
+  // Forbid rho(i) = b and sigma(i) = c if query(i, b, c)
+  void forbid(const Usp &puzzle, unsigned int i, unsigned int b, unsigned int c);
+  // Replace the activation literal and add the guarded clauses for the current rows
+  void activate();
+
+  IncrementalSatSolver &m_solver;
+  unsigned int m_rows{ 0 };
+  int m_activation{ 0 };
+  // Variables of x then y
+  std::array<std::vector<std::vector<int>>, 2> m_tables;
+  // Groups of each position and of each value of x then y
+  std::array<std::vector<AtMostOne>, 2> m_positions;
+  std::array<std::vector<AtMostOne>, 2> m_values;
+};
+
+/* Solves a Usp which grows a row at a time, keeping the SAT solver with
+ * its learned clauses and heuristics between solves.
+ * After the puzzle is found strong, no witness of the grown puzzle may fix
+ * the new row in both permutations, since restricting it would be a
+ * witness of the strong puzzle, and this is added as a clause.
+ */
+class IncrementalUspSolver
+{
+public:
+  explicit IncrementalUspSolver(Usp puzzle);
+
+  // Add a row of k elements to the puzzle
+  void appendRow(const std::vector<int> &row);
+  // Remove the last row of the puzzle, such as a candidate row found to make it weak
+  void popRow();
+  // Record that the current puzzle is strong, such as when another solver proved it
+  void markStrong();
+  // Solve the current puzzle within limits
+  SolverResult solve(const SolverLimits &limits = {});
+
+  const Usp &puzzle() const;
+
+private:
+  Usp m_puzzle;
+  IncrementalSatSolver m_solver;
+  UspCnfEncoder m_encoder;
+  bool m_strong{ false };
+  // Whether the puzzle was known strong before each appended row
+  std::vector<bool> m_strongBefore;
+};
+
+/* Solve within limits by encoding the puzzle as CNF for the embedded SAT solver.
+ */
+SolverResult CnfSolve(const Usp &puzzle, const SolverLimits &limits = {});
+
+/* Solver for USP Weakness through the CNF encoding.
+ * Returns a pair of permutations if one has been found
+ * which verifies the USP as weak.
+ */
+std::optional<std::pair<Permutation, Permutation>> CnfSolver(const Usp &puzzle);
+
+}// namespace usp
+
+#endif
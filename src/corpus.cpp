@@ -0,0 +1,170 @@
+#include "corpus.h"
+#include "littleendian.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USP_CORPUS_MMAP
+#endif
+
+namespace usp {
+
+namespace {
+
+  constexpr std::array<char, 4> kCorpusMagic{ 'U', 'S', 'P', 'C' };
+  constexpr std::size_t kHeaderBytes = 24;
+  constexpr std::size_t kIndexEntryBytes = 16;
+
+}// namespace
+
+CorpusWriter::CorpusWriter(const std::string &path) : m_file(path, std::ios::binary | std::ios::trunc)
+{
+  if (!m_file) {
+    throw std::runtime_error("Failed to open corpus " + path);
+  }
+  // The header is written again by finish() once the count and index are known
+  m_file.write(kCorpusMagic.data(), kCorpusMagic.size());
+  WriteLittleEndian<std::uint32_t>(m_file, kCorpusVersion);
+  WriteLittleEndian<std::uint64_t>(m_file, 0);
+  WriteLittleEndian<std::uint64_t>(m_file, 0);
+  m_offset = kHeaderBytes;
+}
+
+CorpusWriter::~CorpusWriter()
+{
+  if (!m_finished) {
+    try {
+      finish();
+    } catch (const std::runtime_error &) {
+      // Destructors must not throw, call finish() to see the error
+    }
+  }
+}
+
+void CorpusWriter::add(const PackedCellsView &cells)
+{
+  m_index.push_back({ m_offset, cells.rows(), cells.cols() });
+  m_file.write(reinterpret_cast<const char *>(cells.data()), static_cast<std::streamsize>(cells.bytes()));
+  m_offset += cells.bytes();
+}
+
+void CorpusWriter::add(const Usp &puzzle)
+{
+  add(puzzle.cells());
+}
+
+void CorpusWriter::finish()
+{
+  m_finished = true;
+  for (const IndexEntry &entry : m_index) {
+    WriteLittleEndian<std::uint64_t>(m_file, entry.offset);
+    WriteLittleEndian<std::uint32_t>(m_file, entry.rows);
+    WriteLittleEndian<std::uint32_t>(m_file, entry.cols);
+  }
+  m_file.seekp(static_cast<std::streamoff>(kCorpusMagic.size() + sizeof(std::uint32_t)));
+  WriteLittleEndian<std::uint64_t>(m_file, m_index.size());
+  WriteLittleEndian<std::uint64_t>(m_file, m_offset);
+  m_file.close();
+  if (!m_file) {
+    throw std::runtime_error("Failed to write corpus");
+  }
+}
+
+CorpusReader::CorpusReader(const std::string &path)
+{
+#if defined(USP_CORPUS_MMAP)
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open corpus " + path);
+  }
+  struct stat status = {};
+  if (::fstat(fd, &status) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat corpus " + path);
+  }
+  m_size = static_cast<std::size_t>(status.st_size);
+  if (m_size != 0) {
+    void *mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map corpus " + path);
+    }
+    m_data = static_cast<const std::uint8_t *>(mapping);
+    m_mapped = true;
+  }
+  // The mapping stays valid once the descriptor is closed
+  ::close(fd);
+#else
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open corpus " + path);
+  }
+  m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+#endif
+
+  if (m_size < kHeaderBytes || !std::equal(kCorpusMagic.begin(), kCorpusMagic.end(), m_data)) {
+    unmap();
+    throw std::runtime_error(path + " is not a corpus");
+  }
+  if (ReadLittleEndian<std::uint32_t>(m_data + 4) != kCorpusVersion) {
+    unmap();
+    throw std::runtime_error(path + " is a corpus of another version");
+  }
+  m_count = ReadLittleEndian<std::uint64_t>(m_data + 8);
+  m_indexOffset = ReadLittleEndian<std::uint64_t>(m_data + 16);
+  if (m_indexOffset > m_size || m_count > (m_size - m_indexOffset) / kIndexEntryBytes) {
+    unmap();
+    throw std::runtime_error(path + " has a truncated index");
+  }
+}
+
+CorpusReader::~CorpusReader()
+{
+  unmap();
+}
+
+void CorpusReader::unmap()
+{
+#if defined(USP_CORPUS_MMAP)
+  if (m_mapped) {
+    ::munmap(const_cast<std::uint8_t *>(m_data), m_size);
+    m_mapped = false;
+  }
+#endif
+}
+
+std::size_t CorpusReader::size() const
+{
+  return m_count;
+}
+
+PackedCellsView CorpusReader::view(std::size_t i) const
+{
+  if (i >= m_count) {
+    throw std::out_of_range("CorpusReader::view");
+  }
+  const std::uint8_t *entry = m_data + m_indexOffset + i * kIndexEntryBytes;
+  const auto offset = ReadLittleEndian<std::uint64_t>(entry);
+  const auto rows = ReadLittleEndian<std::uint32_t>(entry + 8);
+  const auto cols = ReadLittleEndian<std::uint32_t>(entry + 12);
+  if (offset > m_indexOffset || PackedCellsView::PackedBytes(rows, cols) > m_indexOffset - offset) {
+    throw std::out_of_range("Corpus index entry out of bounds");
+  }
+  return PackedCellsView(m_data + offset, rows, cols);
+}
+
+Usp CorpusReader::puzzle(std::size_t i) const
+{
+  return Usp(view(i));
+}
+
+}// namespace usp
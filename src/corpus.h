@@ -0,0 +1,90 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include "usp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace usp {
+
+/* Binary corpus of puzzles. All integers are little endian.
+ *   header  magic "USPC", uint32 version, uint64 count, uint64 offset of the index
+ *   cells   the packed cells of every puzzle, as in PackedCellsView
+ *   index   for every puzzle a uint64 offset of its cells, uint32 rows and uint32 cols
+ * The index follows the cells so that a corpus is written in one pass.
+ */
+static constexpr std::uint32_t kCorpusVersion = 1;
+
+/* Writes puzzles to a corpus file. finish() writes the index,
+ * and is called by the destructor if it was not called before.
+ */
+class CorpusWriter
+{
+public:
+  // Throws 'std::runtime_error' if path can not be opened
+  explicit CorpusWriter(const std::string &path);
+  ~CorpusWriter();
+
+  CorpusWriter(const CorpusWriter &) = delete;
+  CorpusWriter &operator=(const CorpusWriter &) = delete;
+
+  void add(const PackedCellsView &cells);
+  void add(const Usp &puzzle);
+  // Write the index and the header. Throws 'std::runtime_error' if writing failed
+  void finish();
+
+private:
+  struct IndexEntry
+  {
+    std::uint64_t offset;
+    std::uint32_t rows;
+    std::uint32_t cols;
+  };
+
+  std::ofstream m_file;
+  std::vector<IndexEntry> m_index;
+  std::uint64_t m_offset{ 0 };
+  bool m_finished{ false };
+};
+
+/* Reads a corpus file through a read-only memory map, so opening it costs
+ * the same for any number of puzzles. view() points straight into the
+ * mapping, and puzzle() builds a Usp straight from the packed cells.
+ * Falls back to reading the file into memory where mmap is not available.
+ */
+class CorpusReader
+{
+public:
+  // Throws 'std::runtime_error' if path is not a corpus of this version
+  explicit CorpusReader(const std::string &path);
+  ~CorpusReader();
+
+  CorpusReader(const CorpusReader &) = delete;
+  CorpusReader &operator=(const CorpusReader &) = delete;
+
+  // Return the number of puzzles
+  std::size_t size() const;
+  // Return the cells of puzzle i. Throws 'std::out_of_range' if i or its index entry is out of bounds
+  PackedCellsView view(std::size_t i) const;
+  // Return puzzle i
+  Usp puzzle(std::size_t i) const;
+
+private:
+  void unmap();
+
+  const std::uint8_t *m_data{ nullptr };
+  std::size_t m_size{ 0 };
+  std::size_t m_count{ 0 };
+  std::uint64_t m_indexOffset{ 0 };
+  // Contents of the file when it is not mapped
+  std::vector<std::uint8_t> m_buffer;
+  bool m_mapped{ false };
+};
+
+}// namespace usp
+
+#endif
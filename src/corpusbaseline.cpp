@@ -0,0 +1,137 @@
+#include "corpusbaseline.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <tuple>
+#include <stdexcept>
+
+namespace usp {
+
+namespace {
+
+  constexpr auto kBaselineHeader = "# uspcorpus baseline";
+  constexpr auto kBaselineColumns = "index,rows,cols,verdict,ms,decisions,conflicts";
+
+  // True if lhs ranks as harder than rhs
+  bool Harder(const InstanceBaseline &lhs, const InstanceBaseline &rhs)
+  {
+    return std::tie(lhs.conflicts, lhs.decisions, lhs.milliseconds) > std::tie(rhs.conflicts, rhs.decisions, rhs.milliseconds);
+  }
+
+  // Order of the heap of HardestPuzzles, the easiest puzzle on top
+  template<typename Entry>
+  bool HarderEntry(const Entry &lhs, const Entry &rhs)
+  {
+    return Harder(lhs.baseline, rhs.baseline);
+  }
+
+}// namespace
+
+void WriteBaselines(std::ostream &out, const CorpusBaselines &baselines)
+{
+  if (std::any_of(baselines.instances.begin(), baselines.instances.end(), [](const InstanceBaseline &instance) { return instance.status == SolverStatus::UNKNOWN; })) {
+    throw std::invalid_argument("Corpus baselines must be weak or strong");
+  }
+  std::ostringstream text;
+  text << kBaselineHeader << " " << kBaselineVersion << " solver=" << baselines.solver << "\n";
+  text << kBaselineColumns << "\n";
+  text << std::setprecision(3) << std::fixed;
+  for (std::size_t i = 0; i < baselines.instances.size(); ++i) {
+    const InstanceBaseline &instance = baselines.instances[i];
+    text << i << "," << instance.rows << "," << instance.cols << ","
+         << (instance.status == SolverStatus::WEAK ? "weak" : "strong") << ","
+         << instance.milliseconds << "," << instance.decisions << "," << instance.conflicts << "\n";
+  }
+  out << text.str();
+}
+
+CorpusBaselines ReadBaselines(std::istream &in)
+{
+  CorpusBaselines baselines;
+  std::string line;
+  std::string version;
+  if (!std::getline(in, line) || line.rfind(kBaselineHeader, 0) != 0) {
+    throw std::runtime_error("Not a corpus baseline file");
+  }
+  std::istringstream header(line.substr(std::string(kBaselineHeader).size()));
+  std::string solver;
+  if (!(header >> version >> solver) || version != std::to_string(kBaselineVersion) || solver.rfind("solver=", 0) != 0) {
+    throw std::runtime_error("Unsupported corpus baseline version " + version);
+  }
+  baselines.solver = solver.substr(std::string("solver=").size());
+  if (!std::getline(in, line) || line != kBaselineColumns) {
+    throw std::runtime_error("Corpus baseline columns are not " + std::string(kBaselineColumns));
+  }
+
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream fields(line);
+    std::size_t index = 0;
+    std::string verdict;
+    InstanceBaseline instance;
+    if (!(fields >> index >> instance.rows >> instance.cols >> verdict >> instance.milliseconds >> instance.decisions >> instance.conflicts)
+        || index != baselines.instances.size()
+        || (verdict != "weak" && verdict != "strong")) {
+      throw std::runtime_error("Malformed corpus baseline of puzzle " + std::to_string(baselines.instances.size()));
+    }
+    instance.status = verdict == "weak" ? SolverStatus::WEAK : SolverStatus::STRONG;
+    baselines.instances.push_back(instance);
+  }
+  return baselines;
+}
+
+ReplayOutcome CompareToBaseline(const InstanceBaseline &baseline, SolverStatus status, double milliseconds, double tolerance, double slackMilliseconds)
+{
+  if (status != baseline.status) {
+    return ReplayOutcome::VERDICT_CHANGED;
+  }
+  if (milliseconds > baseline.milliseconds * (1 + tolerance) && milliseconds - baseline.milliseconds > slackMilliseconds) {
+    return ReplayOutcome::SLOWER;
+  }
+  return ReplayOutcome::UNCHANGED;
+}
+
+HardestPuzzles::HardestPuzzles(std::size_t count) : m_count(count)
+{
+  m_heap.reserve(count);
+}
+
+bool HardestPuzzles::offer(const Usp &puzzle, const InstanceBaseline &baseline)
+{
+  if (m_count == 0) {
+    return false;
+  }
+  if (m_heap.size() == m_count) {
+    if (!Harder(baseline, m_heap.front().baseline)) {
+      return false;
+    }
+    std::pop_heap(m_heap.begin(), m_heap.end(), HarderEntry<Entry>);
+    m_heap.pop_back();
+  }
+  m_heap.push_back({ puzzle, baseline });
+  std::push_heap(m_heap.begin(), m_heap.end(), HarderEntry<Entry>);
+  return true;
+}
+
+std::size_t HardestPuzzles::size() const
+{
+  return m_heap.size();
+}
+
+std::vector<std::pair<Usp, InstanceBaseline>> HardestPuzzles::take()
+{
+  std::sort_heap(m_heap.begin(), m_heap.end(), HarderEntry<Entry>);
+  std::vector<std::pair<Usp, InstanceBaseline>> puzzles;
+  puzzles.reserve(m_heap.size());
+  for (Entry &entry : m_heap) {
+    puzzles.emplace_back(std::move(entry.puzzle), entry.baseline);
+  }
+  m_heap.clear();
+  return puzzles;
+}
+
+}// namespace usp
@@ -0,0 +1,96 @@
+#ifndef CORPUS_BASELINE_H
+#define CORPUS_BASELINE_H
+
+#include "usp.h"
+#include "solverlimits.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace usp {
+
+/* Text file of the timing baselines of a regression corpus, one line per
+ * puzzle of the corpus in the same order:
+ *   # uspcorpus baseline <version> solver=<name>
+ *   index,rows,cols,verdict,ms,decisions,conflicts
+ *   0,18,12,strong,41.25,5130,2204
+ * verdict is weak or strong, as a corpus only keeps decided puzzles.
+ */
+static constexpr std::uint32_t kBaselineVersion = 1;
+
+// Baseline of one puzzle of a corpus
+struct InstanceBaseline
+{
+  unsigned int rows{ 0 };
+  unsigned int cols{ 0 };
+  SolverStatus status{ SolverStatus::UNKNOWN };
+  double milliseconds{ 0 };
+  unsigned long long decisions{ 0 };
+  unsigned long long conflicts{ 0 };
+};
+
+struct CorpusBaselines
+{
+  // Solver the baselines were measured with
+  std::string solver;
+  std::vector<InstanceBaseline> instances;
+};
+
+// Throws 'std::invalid_argument' if a baseline is neither weak nor strong
+void WriteBaselines(std::ostream &out, const CorpusBaselines &baselines);
+/* Read baselines written by WriteBaselines.
+ * Throws 'std::runtime_error' if in is not a baseline file of this version
+ */
+CorpusBaselines ReadBaselines(std::istream &in);
+
+enum class ReplayOutcome {
+  UNCHANGED,
+  SLOWER,
+  VERDICT_CHANGED
+};
+
+/* Compare a replayed solve to its baseline. The solve is SLOWER if it took
+ * more than (1 + tolerance) times the baseline, and also more than
+ * slackMilliseconds beyond it, so that the noise of the fastest puzzles is
+ * not flagged. A verdict other than the baseline's, including UNKNOWN, is
+ * VERDICT_CHANGED.
+ */
+ReplayOutcome CompareToBaseline(const InstanceBaseline &baseline, SolverStatus status, double milliseconds, double tolerance, double slackMilliseconds);
+
+/* Keeps the count hardest puzzles offered to it, with their baselines.
+ * Puzzles are ranked by conflicts, then decisions, and only then by time:
+ * the counters of a solve do not depend on the machine or its warm-up, so
+ * one noisy timing does not pull an easy puzzle in. A puzzle is only
+ * copied if it is among the hardest so far.
+ */
+class HardestPuzzles
+{
+public:
+  explicit HardestPuzzles(std::size_t count);
+
+  // Offer a solved puzzle. Returns true if it is kept, for now
+  bool offer(const Usp &puzzle, const InstanceBaseline &baseline);
+  // Number of puzzles kept
+  std::size_t size() const;
+  // Take the puzzles kept, hardest first, leaving none
+  std::vector<std::pair<Usp, InstanceBaseline>> take();
+
+private:
+  struct Entry
+  {
+    Usp puzzle;
+    InstanceBaseline baseline;
+  };
+
+  std::size_t m_count;
+  // Min heap on the hardness, so the easiest kept puzzle is at the front
+  std::vector<Entry> m_heap;
+};
+
+}// namespace usp
+
+#endif
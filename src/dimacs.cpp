@@ -0,0 +1,343 @@
+#include "dimacs.h"
+#include "verifier.h"
+
+#include <array>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace usp {
+
+namespace {
+
+  /* Formats DIMACS clauses into a fixed buffer, writing it out once full
+   */
+  class DimacsStream
+  {
+  public:
+    explicit DimacsStream(std::ostream &out) : m_out(out)
+    {}
+
+    ~DimacsStream()
+    {
+      flush();
+    }
+
+    DimacsStream(const DimacsStream &) = delete;
+    DimacsStream &operator=(const DimacsStream &) = delete;
+
+    void text(const std::string &line)
+    {
+      flush();
+      m_out << line;
+    }
+
+    void literal(long long value)
+    {
+      // Room for the sign, twenty digits and a separator
+      if (m_used + 22 > m_buffer.size()) {
+        flush();
+      }
+      if (value < 0) {
+        m_buffer[m_used++] = '-';
+        value = -value;
+      }
+      std::array<char, 20> digits{};
+      std::size_t count = 0;
+      do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+      } while (value != 0);
+      while (count != 0) {
+        m_buffer[m_used++] = digits[--count];
+      }
+      m_buffer[m_used++] = ' ';
+    }
+
+    void endClause()
+    {
+      if (m_used + 2 > m_buffer.size()) {
+        flush();
+      }
+      m_buffer[m_used++] = '0';
+      m_buffer[m_used++] = '\n';
+    }
+
+    void flush()
+    {
+      m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_used));
+      m_used = 0;
+    }
+
+  private:
+    std::ostream &m_out;
+    std::array<char, 1 << 16> m_buffer{};
+    std::size_t m_used{ 0 };
+  };
+
+  std::size_t TensorPopulation(const Usp &puzzle)
+  {
+    std::size_t population = 0;
+    for (unsigned int a = 0; a < puzzle.rows(); ++a) {
+      for (unsigned int b = 0; b < puzzle.rows(); ++b) {
+        const std::uint64_t *slab = puzzle.slab(a, b);
+        for (unsigned int w = 0; w < puzzle.slabWords(); ++w) {
+          for (std::uint64_t bits = slab[w]; bits != 0; bits &= bits - 1) {
+            ++population;
+          }
+        }
+      }
+    }
+    return population;
+  }
+
+}// namespace
+
+std::size_t DimacsClauseCount(const Usp &puzzle)
+{
+  const std::size_t n = puzzle.rows();
+  // Per permutation: a pair clause for every two values of a position and every two positions of a value
+  const std::size_t atMostOne = 2 * n * (n * (n - 1) / 2);
+  return 2 * atMostOne + 2 * n + 1 + TensorPopulation(puzzle);
+}
+
+void WriteDimacs(const Usp &puzzle, std::ostream &out)
+{
+  const long long n = puzzle.rows();
+  auto x = [n](long long i, long long j) { return i * n + j + 1; };
+  auto y = [n](long long i, long long j) { return n * n + i * n + j + 1; };
+
+  DimacsStream stream(out);
+  std::ostringstream header;
+  header << "c usp " << puzzle.rows() << " " << puzzle.cols() << "\n";
+  for (unsigned int row = 0; row < puzzle.rows(); ++row) {
+    header << "c row ";
+    for (unsigned int col = 0; col < puzzle.cols(); ++col) {
+      header << puzzle.element(row, col);
+    }
+    header << "\n";
+  }
+  header << "p cnf " << 2 * n * n << " " << DimacsClauseCount(puzzle) << "\n";
+  stream.text(header.str());
+
+  // Both are permutations: a position takes at most one value, a value is taken at most once
+  for (long long first : { x(0, 0), y(0, 0) }) {
+    for (long long a = 0; a < n; ++a) {
+      for (long long b = 0; b < n; ++b) {
+        for (long long c = b + 1; c < n; ++c) {
+          stream.literal(-(first + b * n + a));
+          stream.literal(-(first + c * n + a));
+          stream.endClause();
+          stream.literal(-(first + a * n + b));
+          stream.literal(-(first + a * n + c));
+          stream.endClause();
+        }
+      }
+    }
+  }
+
+  // Every position takes a value
+  for (long long j = 0; j < n; ++j) {
+    for (long long i = 0; i < n; ++i) {
+      stream.literal(x(i, j));
+    }
+    stream.endClause();
+    for (long long i = 0; i < n; ++i) {
+      stream.literal(y(i, j));
+    }
+    stream.endClause();
+  }
+
+  // Both permutations are not the identity
+  for (long long i = 0; i < n; ++i) {
+    stream.literal(-x(i, i));
+    stream.literal(-y(i, i));
+  }
+  stream.endClause();
+
+  // rho(i) = b and sigma(i) = c can not both hold when query(i, b, c)
+  for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+    for (unsigned int b = 0; b < puzzle.rows(); ++b) {
+      const std::uint64_t *slab = puzzle.slab(i, b);
+      for (unsigned int c = 0; c < puzzle.rows(); ++c) {
+        if ((slab[c / 64] >> (c % 64)) & 1) {
+          stream.literal(-x(b, i));
+          stream.literal(-y(c, i));
+          stream.endClause();
+        }
+      }
+    }
+  }
+}
+
+Usp ReadDimacsPuzzle(std::istream &in)
+{
+  std::string line;
+  unsigned int n = 0;
+  unsigned int k = 0;
+  bool found = false;
+  std::vector<int> data;
+  while (std::getline(in, line) && line.rfind("p ", 0) != 0) {
+    std::istringstream words(line);
+    std::string comment;
+    std::string kind;
+    words >> comment >> kind;
+    if (kind == "usp") {
+      found = static_cast<bool>(words >> n >> k);
+    } else if (kind == "row") {
+      std::string row;
+      words >> row;
+      for (char element : row) {
+        if (element < '1' || element > '3') {
+          throw std::runtime_error("Invalid puzzle element in DIMACS comment");
+        }
+        data.push_back(element - '0');
+      }
+    }
+  }
+  if (!found || data.size() != static_cast<std::size_t>(n) * k) {
+    throw std::runtime_error("DIMACS formula does not contain a puzzle");
+  }
+  return Usp(data, n, k);
+}
+
+namespace {
+
+  /* Parse a DIMACS CNF formula, calling onHeader with the number of
+   * variables of the header and onClause with each clause
+   */
+  template<typename OnHeader, typename OnClause>
+  void ParseDimacs(std::istream &in, OnHeader onHeader, OnClause onClause)
+  {
+    std::string token;
+    std::vector<int> clause;
+    bool header = false;
+    while (in >> token) {
+      if (token == "c") {
+        std::getline(in, token);
+      } else if (token == "p") {
+        int variables = 0;
+        std::size_t clauses = 0;
+        if (!(in >> token >> variables >> clauses) || token != "cnf") {
+          throw std::runtime_error("Malformed DIMACS header");
+        }
+        onHeader(variables);
+        header = true;
+      } else {
+        int literal = 0;
+        try {
+          literal = std::stoi(token);
+        } catch (const std::logic_error &) {
+          throw std::runtime_error("Malformed DIMACS literal " + token);
+        }
+        if (!header) {
+          throw std::runtime_error("DIMACS clause before the header");
+        }
+        if (literal == 0) {
+          onClause(clause);
+          clause.clear();
+          continue;
+        }
+        clause.push_back(literal);
+      }
+    }
+    if (!clause.empty()) {
+      throw std::runtime_error("Unterminated DIMACS clause");
+    }
+  }
+
+}// namespace
+
+void LoadDimacs(std::istream &in, IncrementalSatSolver &solver)
+{
+  ParseDimacs(
+    in,
+    [&solver](int variables) {
+      while (solver.variables() < variables) {
+        solver.newVariable();
+      }
+    },
+    [&solver](const std::vector<int> &clause) { solver.addClause(clause); });
+}
+
+void LoadDimacs(std::istream &in, DratChecker &checker)
+{
+  ParseDimacs(
+    in, [](int /*variables*/) {}, [&checker](const std::vector<int> &clause) { checker.addClause(clause); });
+}
+
+std::optional<std::pair<Permutation, Permutation>> ReadDimacsModel(std::istream &in, unsigned int n)
+{
+  const long long size = static_cast<long long>(n) * n;
+  // Value of each position, or n while unassigned
+  std::vector<unsigned int> rho(n, n);
+  std::vector<unsigned int> sigma(n, n);
+  bool satisfiable = false;
+
+  std::string token;
+  while (in >> token) {
+    if (token == "c") {
+      std::getline(in, token);
+    } else if (token == "s" || token == "v") {
+      continue;
+    } else if (token == "UNSATISFIABLE" || token == "UNSAT") {
+      return std::nullopt;
+    } else if (token == "SATISFIABLE" || token == "SAT") {
+      satisfiable = true;
+    } else {
+      long long literal = 0;
+      try {
+        literal = std::stoll(token);
+      } catch (const std::logic_error &) {
+        throw std::runtime_error("Unexpected token in DIMACS model " + token);
+      }
+      if (literal <= 0 || literal > 2 * size) {
+        continue;
+      }
+      // Undo x(i, j) and y(i, j) to value i at position j
+      std::vector<unsigned int> &permutation = literal <= size ? rho : sigma;
+      const long long offset = (literal - 1) % size;
+      const auto value = static_cast<unsigned int>(offset / n);
+      const auto position = static_cast<unsigned int>(offset % n);
+      if (permutation[position] != n) {
+        throw std::runtime_error("DIMACS model assigns a position twice");
+      }
+      permutation[position] = value;
+    }
+  }
+  if (!satisfiable) {
+    throw std::runtime_error("DIMACS model has no verdict");
+  }
+
+  Permutation rhoPermutation(n);
+  Permutation sigmaPermutation(n);
+  for (auto [permutation, result] : { std::make_pair(&rho, &rhoPermutation), std::make_pair(&sigma, &sigmaPermutation) }) {
+    std::vector<bool> taken(n, false);
+    for (unsigned int position = 0; position < n; ++position) {
+      const unsigned int value = (*permutation)[position];
+      if (value == n || taken[value]) {
+        throw std::runtime_error("DIMACS model does not assign a permutation");
+      }
+      taken[value] = true;
+      result->assign(position, value, true);
+    }
+  }
+  return std::make_pair(rhoPermutation, sigmaPermutation);
+}
+
+std::optional<std::pair<Permutation, Permutation>> ReadDimacsWitness(const Usp &puzzle, std::istream &in)
+{
+  auto witness = ReadDimacsModel(in, puzzle.rows());
+  if (!witness.has_value()) {
+    return witness;
+  }
+  // VerifyUspWeakness accepts the identity pair, which the formula excludes and which proves nothing
+  if (IsIdentityWitness(witness->first.assignments(), witness->second.assignments()) || !VerifyUspWeakness(puzzle, witness->first, witness->second)) {
+    throw std::runtime_error("DIMACS model does not prove the puzzle weak");
+  }
+  return witness;
+}
+
+}// namespace usp
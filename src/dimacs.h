@@ -0,0 +1,64 @@
+#ifndef DIMACS_H
+#define DIMACS_H
+
+#include "usp.h"
+#include "satsolver.h"
+#include "drat.h"
+
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <utility>
+
+namespace usp {
+
+/* Number of clauses WriteDimacs emits for puzzle: the pairwise
+ * at-most-one clauses of both permutations, one at-least-one clause
+ * per position, the non-identity clause and one clause per set bit
+ * of the query tensor.
+ */
+std::size_t DimacsClauseCount(const Usp &puzzle);
+
+/* Write puzzle as a DIMACS CNF formula, satisfiable iff the puzzle is weak.
+ * Variables are numbered as in python/Sat.py, x(i, j) = i * n + j + 1 is
+ * rho(j) = i and y(i, j) = n^2 + i * n + j + 1 is sigma(j) = i.
+ * The rows of the puzzle are stored in comment lines so that
+ * ReadDimacsPuzzle can recover it. Clauses are formatted straight into
+ * a fixed buffer and written out as it fills.
+ */
+void WriteDimacs(const Usp &puzzle, std::ostream &out);
+
+/* Read back the puzzle stored in the comments of a formula from WriteDimacs.
+ * Throws 'std::runtime_error' if the formula carries no puzzle.
+ */
+Usp ReadDimacsPuzzle(std::istream &in);
+
+/* Add every clause of a DIMACS CNF formula to solver.
+ * Throws 'std::runtime_error' on a malformed formula.
+ */
+void LoadDimacs(std::istream &in, IncrementalSatSolver &solver);
+
+/* Add every clause of a DIMACS CNF formula to the formula checker checks proofs against.
+ * Throws 'std::runtime_error' on a malformed formula.
+ */
+void LoadDimacs(std::istream &in, DratChecker &checker);
+
+/* Read the model of an external solver for a formula of an n row puzzle.
+ * Accepts both the competition format ("s SATISFIABLE" and "v" lines) and the
+ * minisat result format ("SAT" followed by the literals).
+ * Returns rho and sigma if the formula was satisfiable, or std::nullopt if it was not.
+ * Throws 'std::runtime_error' if the solver gave no verdict or the model
+ * does not assign a pair of permutations.
+ */
+std::optional<std::pair<Permutation, Permutation>> ReadDimacsModel(std::istream &in, unsigned int n);
+
+/* Read a model with ReadDimacsModel and check it with VerifyUspWeakness.
+ * Throws 'std::runtime_error' if the model does not prove puzzle weak,
+ * including a model where rho and sigma are both the identity.
+ */
+std::optional<std::pair<Permutation, Permutation>> ReadDimacsWitness(const Usp &puzzle, std::istream &in);
+
+}// namespace usp
+
+#endif
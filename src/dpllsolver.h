@@ -3,12 +3,19 @@
 
 #include "usp.h"
 #include "verifier.h"
+#include "solverlimits.h"
 
 #include <utility>
 #include <optional>
 #include <algorithm>
 #include <numeric>
 #include <sstream>
+#include <stdexcept>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include <spdlog/spdlog.h>
 
@@ -40,67 +47,262 @@ void UspUnitPropagation(const Usp &puzzle, const std::unique_ptr<Permutation> &r
   }
 }
 
-std::optional<std::pair<Permutation, Permutation>> DpllSolverImpl(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, int depth)
+/* Propagate a tentative assignment as far as it goes: unit propagation
+ * between rho and sigma, then assigning every row left with a single
+ * candidate, until nothing changes. Returns false on a contradiction.
+ */
+bool UspProbePropagation(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, int depth)
+{
+  for (bool forced = true; forced;) {
+    UspUnitPropagation(puzzle, rho, sigma, depth);
+    if (rho->checkContradiction() || sigma->checkContradiction()) {
+      return false;
+    }
+    forced = false;
+    for (const std::unique_ptr<Permutation> *permutation : { &rho, &sigma }) {
+      for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+        if (!(*permutation)->assignment(i).has_value() && (*permutation)->candidateCount(i) == 1) {
+          (*permutation)->assignPropagate(i, (*permutation)->possibleAssignments(i).front(), permutation == &rho, depth);
+          forced = true;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/* Outcome of the lookahead at a node
+ */
+struct Lookahead
+{
+  // Every candidate of a probed row failed
+  bool conflict{ false };
+  // Candidates whose probe failed, as (rho, row, column)
+  std::vector<std::tuple<bool, unsigned int, unsigned int>> failed;
+  // Whether a row was fully probed, and then the row to branch on with its candidates in the order to try
+  bool probed{ false };
+  bool branchRho{ true };
+  unsigned int branchRow{ 0 };
+  std::vector<unsigned int> branchCandidates;
+};
+
+/* Failed-literal probing. Each candidate of the unassigned rows with the
+ * fewest candidates, rows of rho first, is assigned at depth + 1,
+ * propagated and undone. A candidate whose propagation reaches a
+ * contradiction is in no witness; with removeFailed it is removed at
+ * depth, so later probes and the subtree see it gone. The branch is the
+ * probed row left with the fewest candidates, which are kept in order.
+ * Probing stops once the budget allows no more probes.
+ */
+Lookahead UspLookahead(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, int depth, SolverBudget &budget, bool removeFailed)
+{
+  Lookahead lookahead;
+  // (sigma, candidates, row) of every unassigned row, to probe the smallest first
+  std::vector<std::tuple<bool, unsigned int, unsigned int>> rows;
+  for (const std::unique_ptr<Permutation> *permutation : { &rho, &sigma }) {
+    for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+      if (!(*permutation)->assignment(i).has_value()) {
+        rows.emplace_back(permutation == &sigma, (*permutation)->candidateCount(i), i);
+      }
+    }
+  }
+  const auto probedRows = std::min<std::size_t>(rows.size(), budget.lookaheadRows());
+  std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(probedRows), rows.end());
+
+  for (std::size_t r = 0; r < probedRows; ++r) {
+    const bool isRho = !std::get<0>(rows[r]);
+    const unsigned int row = std::get<2>(rows[r]);
+    const std::unique_ptr<Permutation> &permutation = isRho ? rho : sigma;
+    std::vector<unsigned int> survivors;
+    for (unsigned int column : permutation->possibleAssignments(row)) {
+      if (!budget.probeAllowed()) {
+        // A partly probed row is no basis for the branch
+        return lookahead;
+      }
+      permutation->assignPropagate(row, column, isRho, depth + 1);
+      const bool consistent = UspProbePropagation(puzzle, rho, sigma, depth + 1);
+      rho->undoPropagation(depth + 1);
+      sigma->undoPropagation(depth + 1);
+      budget.probe(!consistent);
+      if (consistent) {
+        survivors.push_back(column);
+        continue;
+      }
+      lookahead.failed.emplace_back(isRho, row, column);
+      if (removeFailed) {
+        permutation->assign(row, column, false, depth);
+      }
+    }
+    if (survivors.empty()) {
+      lookahead.conflict = true;
+      return lookahead;
+    }
+    if (!lookahead.probed || survivors.size() < lookahead.branchCandidates.size()) {
+      lookahead.probed = true;
+      lookahead.branchRho = isRho;
+      lookahead.branchRow = row;
+      lookahead.branchCandidates = std::move(survivors);
+    }
+  }
+  return lookahead;
+}
+
+/* Callback receiving each witness found while enumerating.
+ * rho and sigma are the solver's own state and are only valid during the call.
+ * Return false to stop the enumeration.
+ */
+using WitnessCallback = std::function<bool(const Permutation &rho, const Permutation &sigma)>;
+
+/* Enumerate every witness below the current assignment, passing each to onWitness.
+ * Returns true if the callback or the budget stopped the enumeration.
+ */
+bool DpllSolverImpl(const Usp &puzzle, const std::unique_ptr<Permutation> &rho, const std::unique_ptr<Permutation> &sigma, int depth, const WitnessCallback &onWitness, SolverBudget &budget)
 {
   // Check if any value cannot be assigned
   if (rho->checkContradiction() || sigma->checkContradiction()) {
     spdlog::debug("Contradiction found");
-    return std::nullopt;
+    USP_TRACE(budget, TraceEvent::CONFLICT, depth);
+    return budget.conflict();
   }
 
   // Check assignments are not both the identity
   if (rho->checkIdentity() && sigma->checkIdentity()) {
     spdlog::debug("Identity found");
-    return std::nullopt;
+    return false;
   }
 
   // Check if rho and sigma have complete assignments
   auto rhoAssignment = rho->nextAssignment();
   auto sigmaAssignment = sigma->nextAssignment();
-  if (!rho->nextAssignment().has_value() && !sigma->nextAssignment().has_value()) {
+  if (!rhoAssignment.has_value() && !sigmaAssignment.has_value()) {
     spdlog::debug("Solution found, Weak USP");
-    return std::make_optional<std::pair<Permutation, Permutation>>(*rho, *sigma);
+    USP_TRACE(budget, TraceEvent::WITNESS, depth);
+    return !onWitness(*rho, *sigma);
+  }
+
+  // Remove failed literals and pick the branch by lookahead, while the budget allows
+  Lookahead lookahead;
+  if (budget.probeAllowed()) {
+    lookahead = UspLookahead(puzzle, rho, sigma, depth, budget, true);
+    if (lookahead.conflict) {
+      USP_TRACE(budget, TraceEvent::CONFLICT, depth);
+      return budget.conflict();
+    }
   }
 
   // Branch on an assignment, applying unit propagation
-  if (rhoAssignment.has_value()) {
-    std::vector<unsigned int> possibleAssignments = rho->possibleAssignments(rhoAssignment.value());
-    for (unsigned int assignment : possibleAssignments) {
-      rho->assignPropagate(rhoAssignment.value(), assignment, true, depth);
-      UspUnitPropagation(puzzle, rho, sigma, depth);
-
-      auto result = DpllSolverImpl(puzzle, rho, sigma, depth + 1);
-      // Success!
-      if (result.has_value()) {
-        return result;
-      }
-      // Try again
-      rho->undoPropagation(depth);
-      sigma->undoPropagation(depth);
+  bool branchRho = lookahead.probed ? lookahead.branchRho : rhoAssignment.has_value();
+  unsigned int row = lookahead.probed ? lookahead.branchRow : branchRho ? rhoAssignment.value() : sigmaAssignment.value();
+  const std::unique_ptr<Permutation> &branch = branchRho ? rho : sigma;
+  std::vector<unsigned int> possibleAssignments = lookahead.probed ? lookahead.branchCandidates : branch->possibleAssignments(row);
+  for (unsigned int assignment : possibleAssignments) {
+    if (budget.decide()) {
+      return true;
     }
-  } else {
-    std::vector<unsigned int> possibleAssignments = sigma->possibleAssignments(sigmaAssignment.value());
-    for (unsigned int assignment : possibleAssignments) {
-      sigma->assignPropagate(sigmaAssignment.value(), assignment, false, depth);
-      UspUnitPropagation(puzzle, rho, sigma, depth);
-
-      auto result = DpllSolverImpl(puzzle, rho, sigma, depth + 1);
-      if (result.has_value()) {
-        return result;
-      }
-      rho->undoPropagation(depth);
-      sigma->undoPropagation(depth);
+    USP_TRACE(budget, TraceEvent::DECISION, depth, row, assignment, branchRho ? 1 : 0);
+    USP_TRACE(budget, TraceEvent::PROPAGATION_BEGIN, depth);
+    branch->assignPropagate(row, assignment, branchRho, depth);
+    UspUnitPropagation(puzzle, rho, sigma, depth);
+    USP_TRACE(budget, TraceEvent::PROPAGATION_END, depth);
+
+    bool stopped = DpllSolverImpl(puzzle, rho, sigma, depth + 1, onWitness, budget);
+    // Try again. The failed literals were removed at this depth too, so remove them again
+    rho->undoPropagation(depth);
+    sigma->undoPropagation(depth);
+    for (const auto &[failedRho, failedRow, failedColumn] : lookahead.failed) {
+      (failedRho ? rho : sigma)->assign(failedRow, failedColumn, false, depth);
+    }
+    if (stopped) {
+      return true;
     }
   }
-  return std::nullopt;
+  // Every branch failed, chronologically back to the level above
+  USP_TRACE(budget, TraceEvent::BACKTRACK, depth, static_cast<std::uint32_t>(std::max(depth - 1, 0)), 1);
+  return false;
 }
 
 
+/* Solve within limits, returning UNKNOWN if a limit is reached first.
+ */
+SolverResult DpllSolve(const Usp &puzzle, const SolverLimits &limits)
+{
+  SolverResult result;
+  SolverBudget budget(limits);
+  DpllSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), 0, [&result](const Permutation &rho, const Permutation &sigma) {
+    result.witness = std::make_pair(rho, sigma);
+    return false;
+  }, budget);
+  result.status = result.witness.has_value() ? SolverStatus::WEAK : budget.exhausted() ? SolverStatus::UNKNOWN : SolverStatus::STRONG;
+  result.stats = budget.stats();
+  return result;
+}
+
 std::optional<std::pair<Permutation, Permutation>> DpllSolver(const Usp &puzzle)
 {
-  return DpllSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), 0);
+  return DpllSolve(puzzle, {}).witness;
+}
+
+/* Stream every witness of the puzzle to onWitness without copying them.
+ * Returns true if the callback stopped the enumeration.
+ */
+bool DpllEnumerate(const Usp &puzzle, const WitnessCallback &onWitness)
+{
+  SolverBudget budget;
+  return DpllSolverImpl(puzzle, std::make_unique<Permutation>(puzzle.rows()), std::make_unique<Permutation>(puzzle.rows()), 0, onWitness, budget);
+}
+
+/* Run countSubtree on every choice of rho(0) using up to threads threads
+ * (0 uses the hardware concurrency), and sum the results.
+ */
+unsigned long long CountSubtreesInParallel(unsigned int n, unsigned int threads, const std::function<unsigned long long(unsigned int)> &countSubtree)
+{
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  std::atomic<unsigned int> nextColumn{ 0 };
+  std::atomic<unsigned long long> total{ 0 };
+  auto worker = [&]() {
+    for (unsigned int column = nextColumn++; column < n; column = nextColumn++) {
+      total += countSubtree(column);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned int i = 1; i < std::min(threads, n); ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+  return total;
+}
+
+/* Count every witness of the puzzle without materializing them.
+ * The subtrees below each rho(0) are counted in parallel.
+ * Throws 'std::invalid_argument' if puzzle is lazy and threads is not 1.
+ */
+unsigned long long DpllCountWitnesses(const Usp &puzzle, unsigned int threads = 0)
+{
+  if (puzzle.lazy() && threads != 1) {
+    throw std::invalid_argument("DpllCountWitnesses of a lazy puzzle must use one thread");
+  }
+  return CountSubtreesInParallel(puzzle.rows(), threads, [&puzzle](unsigned int column) {
+    auto rho = std::make_unique<Permutation>(puzzle.rows());
+    auto sigma = std::make_unique<Permutation>(puzzle.rows());
+    rho->assignPropagate(0, column, true, 0);
+    UspUnitPropagation(puzzle, rho, sigma, 0);
+
+    unsigned long long count = 0;
+    SolverBudget budget;
+    DpllSolverImpl(puzzle, rho, sigma, 1, [&count](const Permutation &, const Permutation &) {
+      ++count;
+      return true;
+    }, budget);
+    return count;
+  });
 }
 
 }// namespace usp
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,552 @@
+#include "drat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+
+namespace usp {
+
+namespace {
+
+  // Flags stored in the second header word of a clause
+  constexpr std::uint32_t kLemmaFlag = 1;
+  constexpr std::uint32_t kActiveFlag = 2;
+  constexpr std::uint32_t kCoreFlag = 4;
+
+}// namespace
+
+DratWriter::DratWriter(std::ostream &out) : m_out(out)
+{}
+
+DratWriter::~DratWriter()
+{
+  flush();
+}
+
+void DratWriter::add(const std::uint32_t *literals, std::size_t count)
+{
+  step('a', literals, count);
+}
+
+void DratWriter::remove(const std::uint32_t *literals, std::size_t count)
+{
+  step('d', literals, count);
+}
+
+void DratWriter::step(char kind, const std::uint32_t *literals, std::size_t count)
+{
+  // Room for the kind, five bytes of each literal and the terminator
+  if (m_used + 5 * count + 2 > m_buffer.size()) {
+    flush();
+  }
+  if (5 * count + 2 > m_buffer.size()) {
+    throw std::length_error("DratWriter::step");
+  }
+  const std::size_t start = m_used;
+  m_buffer[m_used++] = kind;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::uint32_t literal = literals[i];
+    while (literal > 0x7f) {
+      m_buffer[m_used++] = static_cast<char>((literal & 0x7f) | 0x80);
+      literal >>= 7;
+    }
+    m_buffer[m_used++] = static_cast<char>(literal);
+  }
+  m_buffer[m_used++] = 0;
+  m_bytes += m_used - start;
+}
+
+void DratWriter::flush()
+{
+  m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_used));
+  m_used = 0;
+}
+
+std::size_t DratWriter::bytes() const
+{
+  return m_bytes;
+}
+
+DratChecker::Lit DratChecker::toLit(int literal)
+{
+  auto variable = static_cast<std::uint32_t>(std::abs(literal) - 1);
+  return 2 * variable + (literal < 0 ? 1U : 0U);
+}
+
+int DratChecker::value(Lit lit) const
+{
+  int assigned = m_assigns[lit >> 1];
+  return (lit & 1) ? -assigned : assigned;
+}
+
+void DratChecker::addVariables(std::uint32_t count)
+{
+  if (count > m_assigns.size()) {
+    m_assigns.resize(count, 0);
+    m_reasons.resize(count, kNoReason);
+    m_trailIndex.resize(count, 0);
+    m_seen.resize(count, 0);
+    m_marks.resize(2 * static_cast<std::size_t>(count), 0);
+    m_watches.resize(2 * static_cast<std::size_t>(count));
+  }
+}
+
+std::uint32_t DratChecker::clauseSize(ClauseRef clause) const
+{
+  return m_arena[clause];
+}
+
+DratChecker::Lit *DratChecker::clauseLits(ClauseRef clause)
+{
+  return &m_arena[clause + kHeaderWords];
+}
+
+void DratChecker::removeDuplicates(std::vector<Lit> &lits)
+{
+  for (Lit lit : lits) {
+    addVariables((lit >> 1) + 1);
+  }
+  std::size_t kept = 0;
+  for (Lit lit : lits) {
+    if (!m_marks[lit]) {
+      m_marks[lit] = 1;
+      lits[kept++] = lit;
+    }
+  }
+  lits.resize(kept);
+  for (Lit lit : lits) {
+    m_marks[lit] = 0;
+  }
+}
+
+DratChecker::ClauseRef DratChecker::allocateClause(std::vector<Lit> &lits, bool lemma)
+{
+  removeDuplicates(lits);
+  auto clause = static_cast<ClauseRef>(m_arena.size());
+  m_arena.push_back(static_cast<std::uint32_t>(lits.size()));
+  m_arena.push_back(lemma ? kLemmaFlag : 0);
+  m_arena.push_back(kNoReason);
+  m_arena.insert(m_arena.end(), lits.begin(), lits.end());
+  insertClause(clause);
+  return clause;
+}
+
+std::uint64_t DratChecker::hash(const Lit *lits, std::size_t count)
+{
+  // Sum of mixed literals, which does not depend on their order
+  std::uint64_t value = count;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::uint64_t mixed = (lits[i] + 1) * 0x9e3779b97f4a7c15ULL;
+    value += mixed ^ (mixed >> 29);
+  }
+  return value ^ (value >> 32);
+}
+
+void DratChecker::insertClause(ClauseRef clause)
+{
+  if (m_bucketed >= m_buckets.size()) {
+    // Rehash every bucketed clause into twice the buckets
+    std::vector<ClauseRef> bucketed;
+    bucketed.reserve(m_bucketed);
+    for (ClauseRef head : m_buckets) {
+      for (ClauseRef next = head; next != kNoReason; next = m_arena[next + 2]) {
+        bucketed.push_back(next);
+      }
+    }
+    m_buckets.assign(std::max<std::size_t>(1024, 2 * m_buckets.size()), kNoReason);
+    m_bucketed = 0;
+    // Reinsert oldest first, so each bucket still lists its latest clause first
+    std::sort(bucketed.begin(), bucketed.end());
+    for (ClauseRef moved : bucketed) {
+      insertClause(moved);
+    }
+  }
+  ClauseRef &head = m_buckets[hash(clauseLits(clause), clauseSize(clause)) & (m_buckets.size() - 1)];
+  m_arena[clause + 2] = head;
+  head = clause;
+  ++m_bucketed;
+}
+
+DratChecker::ClauseRef DratChecker::findClause(const std::vector<Lit> &lits)
+{
+  if (m_buckets.empty()) {
+    return kNoReason;
+  }
+  for (Lit lit : lits) {
+    m_marks[lit] = 1;
+  }
+  // The latest copy of the clause is deleted first
+  ClauseRef found = kNoReason;
+  ClauseRef *link = &m_buckets[hash(lits.data(), lits.size()) & (m_buckets.size() - 1)];
+  for (; *link != kNoReason; link = &m_arena[*link + 2]) {
+    const ClauseRef clause = *link;
+    const Lit *clauseLiterals = clauseLits(clause);
+    if (clauseSize(clause) == lits.size() && std::all_of(clauseLiterals, clauseLiterals + lits.size(), [this](Lit lit) { return m_marks[lit] != 0; })) {
+      *link = m_arena[clause + 2];
+      --m_bucketed;
+      found = clause;
+      break;
+    }
+  }
+  for (Lit lit : lits) {
+    m_marks[lit] = 0;
+  }
+  return found;
+}
+
+void DratChecker::addClause(const std::vector<int> &literals)
+{
+  std::vector<Lit> lits;
+  lits.reserve(literals.size());
+  for (int literal : literals) {
+    lits.push_back(toLit(literal));
+  }
+  m_originals.push_back(allocateClause(lits, false));
+}
+
+void DratChecker::readProof(std::istream &in)
+{
+  std::vector<char> proof;
+  std::array<char, 1 << 16> chunk{};
+  while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0) {
+    proof.insert(proof.end(), chunk.begin(), chunk.begin() + in.gcount());
+  }
+  std::vector<Lit> lits;
+  std::size_t position = 0;
+  while (position < proof.size()) {
+    const char kind = proof[position++];
+    if (kind != 'a' && kind != 'd') {
+      throw std::runtime_error("Malformed DRAT proof step");
+    }
+    lits.clear();
+    while (true) {
+      std::uint64_t literal = 0;
+      unsigned int shift = 0;
+      std::uint8_t byte = 0;
+      do {
+        if (position == proof.size() || shift > 28) {
+          throw std::runtime_error("Malformed DRAT proof literal");
+        }
+        byte = static_cast<std::uint8_t>(proof[position++]);
+        literal |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        shift += 7;
+      } while (byte & 0x80);
+      if (literal == 0) {
+        break;
+      }
+      if (literal < 2 || literal > UINT32_MAX) {
+        throw std::runtime_error("Malformed DRAT proof literal");
+      }
+      lits.push_back(static_cast<Lit>(literal - 2));
+    }
+
+    if (kind == 'a') {
+      m_steps.push_back({ allocateClause(lits, true), false, false });
+      continue;
+    }
+    removeDuplicates(lits);
+    const ClauseRef clause = findClause(lits);
+    if (clause == kNoReason) {
+      ++m_unmatchedDeletions;
+    } else {
+      m_steps.push_back({ clause, true, false });
+    }
+  }
+}
+
+void DratChecker::enqueue(Lit lit, ClauseRef reason)
+{
+  m_assigns[lit >> 1] = (lit & 1) ? -1 : 1;
+  m_reasons[lit >> 1] = reason;
+  m_trailIndex[lit >> 1] = static_cast<std::uint32_t>(m_trail.size());
+  m_trail.push_back(lit);
+}
+
+DratChecker::ClauseRef DratChecker::propagate()
+{
+  while (m_propagated < m_trail.size()) {
+    const Lit falseLit = m_trail[m_propagated++] ^ 1;
+    std::vector<ClauseRef> &watchers = m_watches[falseLit ^ 1];
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < watchers.size()) {
+      const ClauseRef clause = watchers[i++];
+      Lit *lits = clauseLits(clause);
+      if (lits[0] == falseLit) {
+        std::swap(lits[0], lits[1]);
+      }
+      if (value(lits[0]) > 0) {
+        watchers[j++] = clause;
+        continue;
+      }
+
+      // Look for a new literal to watch
+      bool moved = false;
+      for (std::uint32_t k = 2; k < clauseSize(clause); ++k) {
+        if (value(lits[k]) >= 0) {
+          std::swap(lits[1], lits[k]);
+          m_watches[lits[1] ^ 1].push_back(clause);
+          moved = true;
+          break;
+        }
+      }
+      if (moved) {
+        continue;
+      }
+
+      watchers[j++] = clause;
+      if (value(lits[0]) < 0) {
+        while (i < watchers.size()) {
+          watchers[j++] = watchers[i++];
+        }
+        watchers.resize(j);
+        m_propagated = m_trail.size();
+        return clause;
+      }
+      enqueue(lits[0], clause);
+    }
+    watchers.resize(j);
+  }
+  return kNoReason;
+}
+
+bool DratChecker::attach(ClauseRef clause)
+{
+  m_arena[clause + 1] |= kActiveFlag;
+  const std::uint32_t size = clauseSize(clause);
+  if (size == 0) {
+    return false;
+  }
+  Lit *lits = clauseLits(clause);
+  if (size == 1) {
+    m_units.push_back(clause);
+  } else {
+    // Watch the two literals of highest value, true before unassigned before false
+    for (std::uint32_t watch = 0; watch < 2; ++watch) {
+      for (std::uint32_t k = watch + 1; k < size; ++k) {
+        if (value(lits[k]) > value(lits[watch])) {
+          std::swap(lits[watch], lits[k]);
+        }
+      }
+    }
+    m_watches[lits[0] ^ 1].push_back(clause);
+    m_watches[lits[1] ^ 1].push_back(clause);
+    if (value(lits[1]) >= 0) {
+      return true;
+    }
+  }
+  if (value(lits[0]) < 0) {
+    return false;
+  }
+  if (value(lits[0]) == 0) {
+    enqueue(lits[0], clause);
+  }
+  return true;
+}
+
+void DratChecker::detach(ClauseRef clause)
+{
+  m_arena[clause + 1] &= ~kActiveFlag;
+  const std::uint32_t size = clauseSize(clause);
+  if (size == 0) {
+    return;
+  }
+  const Lit *lits = clauseLits(clause);
+  if (size == 1) {
+    m_units.erase(std::find(m_units.begin(), m_units.end(), clause));
+  } else {
+    for (std::uint32_t watch = 0; watch < 2; ++watch) {
+      std::vector<ClauseRef> &watchers = m_watches[lits[watch] ^ 1];
+      watchers.erase(std::find(watchers.begin(), watchers.end(), clause));
+    }
+  }
+  // Literals implied by the clause no longer hold
+  if (value(lits[0]) > 0 && m_reasons[lits[0] >> 1] == clause) {
+    unassignFrom(m_trailIndex[lits[0] >> 1]);
+  }
+}
+
+void DratChecker::unassignFrom(std::size_t position)
+{
+  for (std::size_t i = position; i < m_trail.size(); ++i) {
+    m_assigns[m_trail[i] >> 1] = 0;
+    m_reasons[m_trail[i] >> 1] = kNoReason;
+  }
+  m_trail.resize(position);
+  for (ClauseRef unit : m_units) {
+    if (value(clauseLits(unit)[0]) == 0) {
+      enqueue(clauseLits(unit)[0], unit);
+    }
+  }
+  // Clauses made unit by literals before position may have implied the undone literals, so every literal is visited again
+  m_propagated = 0;
+  propagate();
+}
+
+void DratChecker::markConflict(ClauseRef conflict)
+{
+  if (conflict != kNoReason) {
+    m_arena[conflict + 1] |= kCoreFlag;
+    const Lit *lits = clauseLits(conflict);
+    for (std::uint32_t k = 0; k < clauseSize(conflict); ++k) {
+      m_seen[lits[k] >> 1] = 1;
+    }
+  }
+  // Walk the trail backwards marking the reason of every literal seen
+  for (std::size_t i = m_trail.size(); i > 0; --i) {
+    const std::uint32_t variable = m_trail[i - 1] >> 1;
+    if (!m_seen[variable]) {
+      continue;
+    }
+    m_seen[variable] = 0;
+    const ClauseRef reason = m_reasons[variable];
+    if (reason == kNoReason) {
+      continue;
+    }
+    m_arena[reason + 1] |= kCoreFlag;
+    const Lit *lits = clauseLits(reason);
+    for (std::uint32_t k = 1; k < clauseSize(reason); ++k) {
+      m_seen[lits[k] >> 1] = 1;
+    }
+  }
+}
+
+bool DratChecker::checkRup(ClauseRef lemma)
+{
+  const std::size_t trail = m_trail.size();
+  ClauseRef conflict = kNoReason;
+  bool refuted = false;
+  const Lit *lits = clauseLits(lemma);
+  for (std::uint32_t k = 0; k < clauseSize(lemma); ++k) {
+    // A literal true at the root refutes the negation at once
+    if (value(lits[k]) > 0) {
+      m_seen[lits[k] >> 1] = 1;
+      refuted = true;
+      break;
+    }
+    if (value(lits[k]) == 0) {
+      enqueue(lits[k] ^ 1, kNoReason);
+    }
+  }
+  if (!refuted) {
+    conflict = propagate();
+    refuted = conflict != kNoReason;
+  }
+  if (refuted) {
+    markConflict(conflict);
+  }
+
+  for (std::size_t i = trail; i < m_trail.size(); ++i) {
+    m_assigns[m_trail[i] >> 1] = 0;
+    m_reasons[m_trail[i] >> 1] = kNoReason;
+  }
+  m_trail.resize(trail);
+  m_propagated = trail;
+  return refuted;
+}
+
+DratResult DratChecker::check()
+{
+  DratResult result;
+  result.ignoredDeletions = m_unmatchedDeletions;
+  std::fill(m_assigns.begin(), m_assigns.end(), 0);
+  std::fill(m_reasons.begin(), m_reasons.end(), kNoReason);
+  for (auto &watchers : m_watches) {
+    watchers.clear();
+  }
+  m_units.clear();
+  m_trail.clear();
+  m_propagated = 0;
+  for (ClauseRef clause : m_originals) {
+    m_arena[clause + 1] &= ~(kActiveFlag | kCoreFlag);
+  }
+  for (Step &step : m_steps) {
+    m_arena[step.clause + 1] &= ~(kActiveFlag | kCoreFlag);
+    step.ignored = false;
+    result.lemmas += step.deletion ? 0 : 1;
+  }
+
+  // Forward until the root conflicts, without checking lemmas
+  ClauseRef conflict = kNoReason;
+  for (ClauseRef clause : m_originals) {
+    if (!attach(clause)) {
+      conflict = clause;
+      break;
+    }
+  }
+  if (conflict == kNoReason) {
+    conflict = propagate();
+  }
+  std::size_t end = 0;
+  for (; conflict == kNoReason && end < m_steps.size(); ++end) {
+    Step &step = m_steps[end];
+    if (!step.deletion) {
+      conflict = attach(step.clause) ? propagate() : step.clause;
+      continue;
+    }
+    const Lit *lits = clauseLits(step.clause);
+    if (clauseSize(step.clause) != 0 && value(lits[0]) > 0 && m_reasons[lits[0] >> 1] == step.clause) {
+      step.ignored = true;
+      ++result.ignoredDeletions;
+    } else {
+      detach(step.clause);
+    }
+  }
+  if (conflict == kNoReason) {
+    return result;
+  }
+  result.conflict = true;
+  markConflict(conflict);
+
+  // Backward through the steps up to the conflict, checking the lemmas it depends on
+  for (std::size_t i = end; i > 0; --i) {
+    const Step &step = m_steps[i - 1];
+    if (step.deletion) {
+      if (!step.ignored) {
+        attach(step.clause);
+        propagate();
+      }
+      continue;
+    }
+    detach(step.clause);
+    if (i == end) {
+      // Propagation stopped at the conflict, so finish it without the lemma
+      unassignFrom(m_trail.size());
+    }
+    if ((m_arena[step.clause + 1] & kCoreFlag) == 0) {
+      continue;
+    }
+    ++result.checkedLemmas;
+    if (!checkRup(step.clause)) {
+      result.failedStep = i - 1;
+      return result;
+    }
+  }
+
+  result.verified = true;
+  result.coreClauses = static_cast<std::size_t>(std::count_if(m_originals.begin(), m_originals.end(), [this](ClauseRef clause) {
+    return (m_arena[clause + 1] & kCoreFlag) != 0;
+  }));
+  return result;
+}
+
+std::vector<std::vector<int>> DratChecker::core() const
+{
+  std::vector<std::vector<int>> clauses;
+  for (ClauseRef clause : m_originals) {
+    if ((m_arena[clause + 1] & kCoreFlag) == 0) {
+      continue;
+    }
+    std::vector<int> literals;
+    for (std::uint32_t k = 0; k < m_arena[clause]; ++k) {
+      const Lit lit = m_arena[clause + kHeaderWords + k];
+      const auto variable = static_cast<int>(lit >> 1) + 1;
+      literals.push_back((lit & 1) ? -variable : variable);
+    }
+    clauses.push_back(std::move(literals));
+  }
+  return clauses;
+}
+
+}// namespace usp
@@ -0,0 +1,155 @@
+#ifndef DRAT_H
+#define DRAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace usp {
+
+/* Writes a proof in the binary DRAT format. Each step is the byte 'a' for
+ * a lemma or 'd' for a deleted clause, its literals and a zero byte. A
+ * literal l is the unsigned 2 * |l| + (l < 0), in little endian groups of
+ * seven bits whose high bit is set while more groups follow. Steps are
+ * encoded into a fixed buffer, written out as it fills.
+ */
+class DratWriter
+{
+public:
+  explicit DratWriter(std::ostream &out);
+  ~DratWriter();
+
+  DratWriter(const DratWriter &) = delete;
+  DratWriter &operator=(const DratWriter &) = delete;
+
+  // Log a lemma, or the deletion of a clause, of count encoded literals
+  void add(const std::uint32_t *literals, std::size_t count);
+  void remove(const std::uint32_t *literals, std::size_t count);
+  // Write out the buffered steps
+  void flush();
+
+  // Bytes of proof logged so far
+  std::size_t bytes() const;
+
+private:
+  void step(char kind, const std::uint32_t *literals, std::size_t count);
+
+  std::ostream &m_out;
+  std::array<char, 1 << 16> m_buffer{};
+  std::size_t m_used{ 0 };
+  std::size_t m_bytes{ 0 };
+};
+
+// Outcome of DratChecker::check
+struct DratResult
+{
+  bool verified{ false };
+  // True if propagation conflicts once every lemma is added
+  bool conflict{ false };
+  // Lemmas of the proof, and those the refutation depends on, which were checked
+  std::size_t lemmas{ 0 };
+  std::size_t checkedLemmas{ 0 };
+  // Original clauses the refutation depends on
+  std::size_t coreClauses{ 0 };
+  // Deletions of clauses that are not in the formula, and of reasons of root literals, which are skipped
+  std::size_t ignoredDeletions{ 0 };
+  // Step of the first lemma that failed its check, if there was a conflict but not verified
+  std::size_t failedStep{ 0 };
+};
+
+/* Checks a DRAT proof of unsatisfiability backwards, as drat-trim does.
+ * A forward pass adds every lemma unchecked, applying the deletions, until
+ * propagation at the root conflicts. The clauses that conflict is derived
+ * from are marked, and going back through the proof each marked lemma is
+ * checked to be a reverse unit propagation (RUP) consequence of the
+ * clauses before it, marking the clauses its check uses in turn. Lemmas
+ * the refutation never uses are skipped, and the marked original clauses
+ * form the trimmed unsatisfiable core.
+ * Lemmas are only checked by RUP, which covers the proofs of a CDCL solver
+ * without preprocessing; a lemma that needs the RAT check fails.
+ */
+class DratChecker
+{
+public:
+  // Add a clause of the formula of DIMACS literals
+  void addClause(const std::vector<int> &literals);
+  /* Read a binary proof, see DratWriter.
+   * Throws 'std::runtime_error' on a malformed proof
+   */
+  void readProof(std::istream &in);
+  // Check the proof read against the clauses added
+  DratResult check();
+  // Original clauses marked by the last check that verified, as DIMACS literals
+  std::vector<std::vector<int>> core() const;
+
+private:
+  using Lit = std::uint32_t;
+  using ClauseRef = std::uint32_t;
+
+  static constexpr ClauseRef kNoReason = UINT32_MAX;
+  static constexpr ClauseRef kHeaderWords = 3;
+
+  struct Step
+  {
+    ClauseRef clause;
+    bool deletion;
+    // Deletion of the reason of a root literal, which the check keeps
+    bool ignored;
+  };
+
+  static Lit toLit(int literal);
+  int value(Lit lit) const;
+  void addVariables(std::uint32_t count);
+
+  /* Clauses live in one arena as in IncrementalSatSolver: a size word, a word
+   * of flags, the next clause of its hash bucket, then the literals
+   */
+  std::uint32_t clauseSize(ClauseRef clause) const;
+  Lit *clauseLits(ClauseRef clause);
+  ClauseRef allocateClause(std::vector<Lit> &lits, bool lemma);
+  void removeDuplicates(std::vector<Lit> &lits);
+  static std::uint64_t hash(const Lit *lits, std::size_t count);
+  // Put clause in its hash bucket, doubling the buckets once they are outnumbered
+  void insertClause(ClauseRef clause);
+  // Take the latest clause with the literals of lits, in any order, out of its bucket
+  ClauseRef findClause(const std::vector<Lit> &lits);
+
+  void enqueue(Lit lit, ClauseRef reason);
+  ClauseRef propagate();
+  // Watch clause, propagating it if it is unit. Returns false if it conflicts
+  bool attach(ClauseRef clause);
+  void detach(ClauseRef clause);
+  // Undo the root literals from position on and propagate again
+  void unassignFrom(std::size_t position);
+  // Mark conflict, if any, and the reasons of the literals it and those already seen depend on
+  void markConflict(ClauseRef conflict);
+  // Check that the negation of lemma propagates to a conflict, marking what it uses
+  bool checkRup(ClauseRef lemma);
+
+  std::vector<std::uint32_t> m_arena;
+  std::vector<ClauseRef> m_originals;
+  std::vector<Step> m_steps;
+  // Heads of the hash buckets of the clauses that deletions may refer to
+  std::vector<ClauseRef> m_buckets;
+  std::size_t m_bucketed{ 0 };
+  std::size_t m_unmatchedDeletions{ 0 };
+
+  std::vector<std::vector<ClauseRef>> m_watches;
+  // Unit clauses, which are not watched
+  std::vector<ClauseRef> m_units;
+  std::vector<std::int8_t> m_assigns;
+  std::vector<ClauseRef> m_reasons;
+  std::vector<std::uint32_t> m_trailIndex;
+  std::vector<char> m_seen;
+  // Literals of the clause being deduplicated or looked up
+  std::vector<std::uint8_t> m_marks;
+  std::vector<Lit> m_trail;
+  std::size_t m_propagated{ 0 };
+};
+
+}// namespace usp
+
+#endif
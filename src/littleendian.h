@@ -0,0 +1,39 @@
+#ifndef LITTLE_ENDIAN_H
+#define LITTLE_ENDIAN_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace usp {
+
+/* Fixed width little endian integers of the binary formats: corpus files,
+ * binary traces and the packed puzzles of the batch server.
+ */
+
+// Write the sizeof(T) bytes of value, least significant first
+template<typename T>
+void WriteLittleEndian(std::ostream &out, T value)
+{
+  std::array<char, sizeof(T)> bytes{};
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+  out.write(bytes.data(), bytes.size());
+}
+
+// Read a T from its sizeof(T) bytes, least significant first
+template<typename T>
+T ReadLittleEndian(const std::uint8_t *bytes)
+{
+  T value = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    value = static_cast<T>(value | (static_cast<T>(bytes[i]) << (8 * i)));
+  }
+  return value;
+}
+
+}// namespace usp
+
+#endif
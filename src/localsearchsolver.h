@@ -0,0 +1,252 @@
+#ifndef LOCAL_SEARCH_SOLVER_H
+#define LOCAL_SEARCH_SOLVER_H
+
+#include "usp.h"
+#include "verifier.h"
+#include "cdclsolver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace usp {
+
+/* Budget and tuning of the local search.
+ * The search stops after maxFlips swaps or timeLimit, whichever comes first.
+ */
+struct LocalSearchOptions
+{
+  unsigned long long maxFlips{ 1000000 };
+  std::chrono::milliseconds timeLimit{ 1000 };
+  // Probability of a random swap instead of the best one
+  double noise{ 0.1 };
+  // Number of flips a swapped pair of rows stays tabu in its permutation
+  unsigned int tabuTenure{ 8 };
+  std::uint64_t seed{ 0 };
+};
+
+/* Stochastic local search over complete permutations rho and sigma.
+ * A row i is violated if query(i, rho(i), sigma(i)) holds. Each flip picks
+ * a violated row and swaps it with another row in rho or sigma, choosing the
+ * swap which removes the most violations (WalkSAT style noise, tabu on
+ * recently swapped pairs). Only the two swapped rows change, so the number
+ * of violated rows is tracked incrementally.
+ */
+class LocalSearch
+{
+public:
+  LocalSearch(const Usp &puzzle, const LocalSearchOptions &options) : m_puzzle(puzzle), m_options(options), m_random(options.seed), m_rho(puzzle.rows()), m_sigma(puzzle.rows()), m_violatedIndex(puzzle.rows(), kNotViolated), m_rhoTabu(puzzle.rows(), 0), m_sigmaTabu(puzzle.rows(), 0)
+  {
+    std::iota(m_rho.begin(), m_rho.end(), 0);
+    std::iota(m_sigma.begin(), m_sigma.end(), 0);
+    std::shuffle(m_rho.begin(), m_rho.end(), m_random);
+    std::shuffle(m_sigma.begin(), m_sigma.end(), m_random);
+    for (unsigned int i = 0; i < m_puzzle.rows(); ++i) {
+      updateRow(i);
+    }
+  }
+
+  // Search until no row is violated or the budget runs out. Returns true if a witness was found
+  bool run()
+  {
+    // Every pair of permutations of a single row is the identity
+    if (m_puzzle.rows() < 2) {
+      return false;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + m_options.timeLimit;
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<unsigned int> rowDistribution(0, m_puzzle.rows() - 1);
+
+    for (m_flips = 0; m_flips < m_options.maxFlips; ++m_flips) {
+      if (m_violated.empty()) {
+        if (!isIdentity()) {
+          return true;
+        }
+        // The identity is not a witness, step away from it
+        swap(true, 0, 1);
+        continue;
+      }
+      if (m_flips % 1024 == 0 && std::chrono::steady_clock::now() > deadline) {
+        break;
+      }
+
+      unsigned int row = m_violated[std::uniform_int_distribution<std::size_t>(0, m_violated.size() - 1)(m_random)];
+
+      // Random walk
+      if (coin(m_random) < m_options.noise) {
+        unsigned int other = rowDistribution(m_random);
+        if (other != row) {
+          swap(coin(m_random) < 0.5, row, other);
+        }
+        continue;
+      }
+
+      // Best non-tabu swap of row, ties broken at random
+      int bestDelta = std::numeric_limits<int>::max();
+      unsigned int bestOther = row;
+      bool bestRho = true;
+      unsigned int ties = 0;
+      for (unsigned int other = 0; other < m_puzzle.rows(); ++other) {
+        if (other == row) {
+          continue;
+        }
+        for (bool inRho : { true, false }) {
+          int delta = swapDelta(inRho, row, other);
+          const std::vector<unsigned long long> &tabu = inRho ? m_rhoTabu : m_sigmaTabu;
+          bool aspiration = static_cast<int>(m_violated.size()) + delta == 0;
+          if ((tabu[row] > m_flips || tabu[other] > m_flips) && !aspiration) {
+            continue;
+          }
+          if (delta < bestDelta) {
+            bestDelta = delta;
+            bestOther = other;
+            bestRho = inRho;
+            ties = 1;
+          } else if (delta == bestDelta && std::uniform_int_distribution<unsigned int>(0, ties++)(m_random) == 0) {
+            bestOther = other;
+            bestRho = inRho;
+          }
+        }
+      }
+      if (bestOther != row) {
+        swap(bestRho, row, bestOther);
+      }
+    }
+    return m_violated.empty() && !isIdentity();
+  }
+
+  const std::vector<unsigned int> &rho() const
+  {
+    return m_rho;
+  }
+
+  const std::vector<unsigned int> &sigma() const
+  {
+    return m_sigma;
+  }
+
+  // Number of violated rows in the current assignment
+  std::size_t violations() const
+  {
+    return m_violated.size();
+  }
+
+  unsigned long long flips() const
+  {
+    return m_flips;
+  }
+
+private:
+  static constexpr std::size_t kNotViolated = std::numeric_limits<std::size_t>::max();
+
+  bool violatedWith(unsigned int row, unsigned int b, unsigned int c) const
+  {
+    return (m_puzzle.slab(row, b)[c / 64] >> (c % 64)) & 1;
+  }
+
+  // Change in violated rows if rows a and b swapped their values in rho or sigma
+  int swapDelta(bool inRho, unsigned int a, unsigned int b) const
+  {
+    int before = (m_violatedIndex[a] != kNotViolated) + (m_violatedIndex[b] != kNotViolated);
+    int after = inRho ? violatedWith(a, m_rho[b], m_sigma[a]) + violatedWith(b, m_rho[a], m_sigma[b])
+                      : violatedWith(a, m_rho[a], m_sigma[b]) + violatedWith(b, m_rho[b], m_sigma[a]);
+    return after - before;
+  }
+
+  void swap(bool inRho, unsigned int a, unsigned int b)
+  {
+    std::vector<unsigned int> &permutation = inRho ? m_rho : m_sigma;
+    std::swap(permutation[a], permutation[b]);
+    std::vector<unsigned long long> &tabu = inRho ? m_rhoTabu : m_sigmaTabu;
+    tabu[a] = m_flips + m_options.tabuTenure;
+    tabu[b] = m_flips + m_options.tabuTenure;
+    updateRow(a);
+    updateRow(b);
+  }
+
+  // Add or remove row from the violated set after it changed
+  void updateRow(unsigned int row)
+  {
+    bool violated = violatedWith(row, m_rho[row], m_sigma[row]);
+    std::size_t &index = m_violatedIndex[row];
+    if (violated && index == kNotViolated) {
+      index = m_violated.size();
+      m_violated.push_back(row);
+    } else if (!violated && index != kNotViolated) {
+      unsigned int last = m_violated.back();
+      m_violated[index] = last;
+      m_violatedIndex[last] = index;
+      m_violated.pop_back();
+      index = kNotViolated;
+    }
+  }
+
+  bool isIdentity() const
+  {
+    for (unsigned int i = 0; i < m_puzzle.rows(); ++i) {
+      if (m_rho[i] != i || m_sigma[i] != i) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const Usp &m_puzzle;
+  LocalSearchOptions m_options;
+  std::mt19937_64 m_random;
+  std::vector<unsigned int> m_rho;
+  std::vector<unsigned int> m_sigma;
+  // Violated rows, and the position of each row in m_violated
+  std::vector<unsigned int> m_violated;
+  std::vector<std::size_t> m_violatedIndex;
+  // Flip until which a row may not be swapped again
+  std::vector<unsigned long long> m_rhoTabu;
+  std::vector<unsigned long long> m_sigmaTabu;
+  unsigned long long m_flips{ 0 };
+};
+
+/* Incomplete solver for USP Weakness using local search.
+ * Returns a pair of permutations which verifies the USP as weak,
+ * or nullopt if none was found within the budget. Unlike the
+ * complete solvers, nullopt does not prove the USP strong.
+ */
+std::optional<std::pair<Permutation, Permutation>> LocalSearchSolver(const Usp &puzzle, const LocalSearchOptions &options = {})
+{
+  LocalSearch search(puzzle, options);
+  if (!search.run()) {
+    spdlog::debug("Local search gave up after {} flips with {} violated rows", search.flips(), search.violations());
+    return std::nullopt;
+  }
+  spdlog::debug("Local search found a witness after {} flips", search.flips());
+
+  Permutation rho(puzzle.rows());
+  Permutation sigma(puzzle.rows());
+  for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+    rho.assign(i, search.rho()[i], true);
+    sigma.assign(i, search.sigma()[i], true);
+  }
+  return std::make_optional<std::pair<Permutation, Permutation>>(rho, sigma);
+}
+
+/* Complete solver using local search as a fast first stage.
+ * Weak USPs found by local search skip the CDCL solver, which
+ * decides every remaining puzzle.
+ */
+std::optional<std::pair<Permutation, Permutation>> LocalSearchCdclSolver(const Usp &puzzle, const LocalSearchOptions &options = {})
+{
+  auto solution = LocalSearchSolver(puzzle, options);
+  if (solution.has_value()) {
+    return solution;
+  }
+  return CdclSolver(puzzle);
+}
+
+}// namespace usp
+
+#endif
@@ -0,0 +1,115 @@
+#include "lockstepsolver.h"
+
+#include <stdexcept>
+
+namespace usp {
+
+LockstepBatch::LockstepBatch(unsigned int n) : m_rows(n)
+{
+  if (n > kLockstepMaxRows) {
+    throw std::invalid_argument("LockstepBatch::LockstepBatch");
+  }
+}
+
+std::size_t LockstepBatch::add(const Usp &puzzle)
+{
+  if (puzzle.rows() != m_rows) {
+    throw std::invalid_argument("LockstepBatch::add");
+  }
+  if (m_size == kLockstepLanes) {
+    throw std::length_error("LockstepBatch::add");
+  }
+  const std::size_t lane = m_size++;
+  const std::uint64_t bit = std::uint64_t{ 1 } << lane;
+  for (unsigned int i = 0; i < m_rows; ++i) {
+    for (unsigned int b = 0; b < m_rows; ++b) {
+      // At most kLockstepMaxRows rows, so a slab is a single word
+      const std::uint64_t slab = puzzle.slab(i, b)[0];
+      std::uint64_t *allowed = &m_allowed[(i * kLockstepMaxRows + b) * kLockstepMaxRows];
+      for (unsigned int c = 0; c < m_rows; ++c) {
+        allowed[c] = ((slab >> c) & 1) != 0 ? allowed[c] & ~bit : allowed[c] | bit;
+      }
+    }
+  }
+  return lane;
+}
+
+void LockstepBatch::clear()
+{
+  m_size = 0;
+  m_found = 0;
+}
+
+std::size_t LockstepBatch::size() const
+{
+  return m_size;
+}
+
+unsigned int LockstepBatch::rows() const
+{
+  return m_rows;
+}
+
+void LockstepBatch::solve()
+{
+  m_found = 0;
+  if (m_size == 0 || m_rows == 0) {
+    return;
+  }
+  const std::uint64_t lanes = m_size == kLockstepLanes ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << m_size) - 1;
+  search(0, lanes, 0, 0, true);
+}
+
+void LockstepBatch::search(unsigned int row, std::uint64_t alive, unsigned int usedRho, unsigned int usedSigma, bool identity)
+{
+  if (row == m_rows) {
+    // Both identities is no witness
+    if (identity) {
+      return;
+    }
+    for (std::uint64_t lanes = alive; lanes != 0; lanes &= lanes - 1) {
+      const auto lane = static_cast<std::size_t>(__builtin_ctzll(lanes));
+      m_rho[lane] = m_rhoPath;
+      m_sigma[lane] = m_sigmaPath;
+    }
+    m_found |= alive;
+    return;
+  }
+
+  const std::uint64_t *allowed = &m_allowed[row * kLockstepMaxRows * kLockstepMaxRows];
+  for (unsigned int b = 0; b < m_rows; ++b) {
+    if ((usedRho >> b) & 1) {
+      continue;
+    }
+    for (unsigned int c = 0; c < m_rows; ++c) {
+      // Lanes that found a witness since the parent drop out here
+      const std::uint64_t child = alive & allowed[b * kLockstepMaxRows + c] & ~m_found;
+      if (((usedSigma >> c) & 1) != 0 || child == 0) {
+        continue;
+      }
+      m_rhoPath[row] = static_cast<std::uint8_t>(b);
+      m_sigmaPath[row] = static_cast<std::uint8_t>(c);
+      search(row + 1, child, usedRho | (1U << b), usedSigma | (1U << c), identity && b == row && c == row);
+    }
+    if ((alive & ~m_found) == 0) {
+      return;
+    }
+  }
+}
+
+bool LockstepBatch::weak(std::size_t lane) const
+{
+  return lane < m_size && ((m_found >> lane) & 1) != 0;
+}
+
+std::vector<unsigned int> LockstepBatch::rho(std::size_t lane) const
+{
+  return std::vector<unsigned int>(m_rho.at(lane).begin(), m_rho.at(lane).begin() + m_rows);
+}
+
+std::vector<unsigned int> LockstepBatch::sigma(std::size_t lane) const
+{
+  return std::vector<unsigned int>(m_sigma.at(lane).begin(), m_sigma.at(lane).begin() + m_rows);
+}
+
+}// namespace usp
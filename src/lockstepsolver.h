@@ -0,0 +1,71 @@
+#ifndef LOCKSTEP_SOLVER_H
+#define LOCKSTEP_SOLVER_H
+
+#include "usp.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace usp {
+
+// Puzzles solved together by a batch, one per bit of a lane mask
+static constexpr std::size_t kLockstepLanes = 64;
+// Largest number of rows a batch solves
+static constexpr unsigned int kLockstepMaxRows = 6;
+
+/* Solves up to kLockstepLanes puzzles of the same tiny size at once.
+ * The query tables are bit sliced: the mask of (i, b, c) holds bit l when
+ * query(i, b, c) is false in the puzzle of lane l. A single search over
+ * pairs (rho(i), sigma(i)), row by row, then serves every lane: a node
+ * carries the mask of lanes its prefix satisfies, a child is one AND
+ * with a table mask, and a subtree is skipped once no lane is left in
+ * it. Lanes drop out of the search as soon as they find a witness, and
+ * the search ends once every lane has. The verdicts are those of the
+ * exhaustive solvers, as every pair of permutations is covered.
+ */
+class LockstepBatch
+{
+public:
+  // Batch of puzzles with n rows. Throws 'std::invalid_argument' if n is above kLockstepMaxRows
+  explicit LockstepBatch(unsigned int n);
+
+  /* Put puzzle in the next lane and return the lane. Throws 'std::invalid_argument'
+   * if it does not have n rows and 'std::length_error' if every lane is taken
+   */
+  std::size_t add(const Usp &puzzle);
+  // Empty every lane, keeping n
+  void clear();
+  // Number of lanes taken
+  std::size_t size() const;
+  unsigned int rows() const;
+
+  // Solve every lane
+  void solve();
+  // True if the puzzle of lane was found weak by solve()
+  bool weak(std::size_t lane) const;
+  // Witness of a weak lane as column arrays, rho[i] and sigma[i] being the columns of row i
+  std::vector<unsigned int> rho(std::size_t lane) const;
+  std::vector<unsigned int> sigma(std::size_t lane) const;
+
+private:
+  // Search the rows from row on, below the lanes of alive
+  void search(unsigned int row, std::uint64_t alive, unsigned int usedRho, unsigned int usedSigma, bool identity);
+
+  unsigned int m_rows;
+  std::size_t m_size{ 0 };
+  // Lanes where query(i, b, c) is false, at (i * kLockstepMaxRows + b) * kLockstepMaxRows + c
+  std::array<std::uint64_t, kLockstepMaxRows * kLockstepMaxRows * kLockstepMaxRows> m_allowed{};
+  std::uint64_t m_found{ 0 };
+  // Assignment of the current search path
+  std::array<std::uint8_t, kLockstepMaxRows> m_rhoPath{};
+  std::array<std::uint8_t, kLockstepMaxRows> m_sigmaPath{};
+  // Witness of each weak lane
+  std::array<std::array<std::uint8_t, kLockstepMaxRows>, kLockstepLanes> m_rho{};
+  std::array<std::array<std::uint8_t, kLockstepMaxRows>, kLockstepLanes> m_sigma{};
+};
+
+}// namespace usp
+
+#endif
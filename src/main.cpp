@@ -12,20 +12,224 @@
 #include "verifier.h"
 #include "dpllsolver.h"
 #include "cdclsolver.h"
+#include "cnfsolver.h"
+#include "matchingsolver.h"
+#include "dimacs.h"
+#include "corpus.h"
+#include "batchserver.h"
+#include "lockstepsolver.h"
+#include "solverregistry.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <csignal>
+#include <cstdint>
 #include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+
+#include <sys/resource.h>
 
 static constexpr auto USAGE =
-  R"(Usage: runsolver
-Computes mean and standard deviations of the runtime of a CDCL solver on USP-Weakness. 
+  R"(Usage:
+  runsolver [--timeout=<ms>] [--solver=<name>] [--session] [--lockstep] [--seed=<s>]
+  runsolver enumerate <n> <k> [--puzzles=<count>] [--threads=<count>] [--seed=<s>]
+  runsolver compare <n> <k> [--puzzles=<count>] [--timeout=<ms>] [--seed=<s>]
+  runsolver export <n> <k> <cnf> [--seed=<s>]
+  runsolver import <cnf> <model>
+  runsolver prove <cnf> <proof> [--timeout=<ms>]
+  runsolver corpus <file> <n> <k> [--puzzles=<count>] [--seed=<s>]
+  runsolver trace <n> <k> <file> [--solver=<name>] [--timeout=<ms>] [--binary] [--seed=<s>]
+  runsolver tensor <n> <k> [--lazy] [--cached-slabs=<count>] [--timeout=<ms>] [--seed=<s>]
+  runsolver serve [--solver=<name>] [--timeout=<ms>] [--threads=<count>] [--in-flight=<count>] [--unordered] [--binary]
+  runsolver (-h | --help)
+
+Computes mean and standard deviations of the runtime of a solver on USP-Weakness. 
 Outputs data into "runtime.csv" in the same directory.  
+Solves that time out are counted separately and left out of the mean.
+The enumerate command instead benchmarks witness enumeration and counting
+on random (n, k) puzzles, reporting witnesses per second.
+The compare command runs the CDCL, CNF and matching solvers on the same random (n, k)
+puzzles, checking that they agree and reporting the mean time of each.
+The export command writes a random (n, k) puzzle as a DIMACS CNF file for an
+external SAT solver, and import verifies that solver's model of the file.
+The prove command solves a DIMACS CNF file with the embedded SAT solver,
+logging a binary DRAT proof that uspcheck checks when the puzzle is strong.
+The corpus command writes random (n, k) puzzles to a binary corpus file
+and reports how long it takes to open and load them again.
+The trace command solves a random (n, k) puzzle with the dpll, cdcl, cnf or
+matching solver and writes its search as Chrome trace JSON, or with --binary as a
+compact binary log. It needs a build with ENABLE_SOLVER_TRACE.
+The tensor command builds one random (n, k) puzzle and solves it with the
+matching solver, reporting the time to build the query tensor, the solve time
+and the peak resident memory of the process. With --lazy the tensor computes
+slabs on first access, keeping every slab it computes unless --cached-slabs
+bounds the cache, so running it once per layout compares lazy and eager
+startup at large n. A cache smaller than the slabs the matching solver rescans
+makes it recompute slabs at every step and run many times slower.
+The serve command solves a stream of puzzles from stdin on a pool of
+workers, writing a line per puzzle to stdout. Each input line is a puzzle,
+its rows as digits separated by spaces, or with --binary each puzzle is a
+uint32 rows, uint32 cols and its packed cells. Each output line is
+"<index> <weak|strong|unknown> <us> <decisions> <conflicts> [<rho> <sigma>]",
+or "<index> error <message>" for a malformed puzzle or one over 256x256.
 
+Options:
+  -h --help           Show this screen.
+  --timeout=<ms>      Wall time limit of each solve in milliseconds, 0 for none [default: 10000].
+  --puzzles=<count>   Number of random puzzles to enumerate [default: 100].
+  --seed=<s>          Seed of the random puzzles, logged by every command that draws them [default: 0].
+  --threads=<count>   Threads used for counting or serving, 0 for every core [default: 0].
+  --in-flight=<count> Puzzles read but not yet written before serve stops reading [default: 64].
+  --lazy              Compute the slabs of the tensor command on first access.
+  --cached-slabs=<count> Slabs cached by a lazy tensor, 0 to keep every slab [default: 0].
+  --unordered         Write served results as they finish instead of in input order.
+  --binary            Read served puzzles in the packed binary form, or write a binary trace.
+  --solver=<name>     Solver of the sweep, trace or serve, dpll, cdcl, cnf or matching [default: cdcl].
+  --session           Run the sweep on one matching solver session and one puzzle, reused by every trial.
+  --lockstep          Solve the sweep cells of at most 6 rows in lockstep batches of 64 puzzles,
+                      timing each puzzle as its share of the batch.
 )";
 
 static constexpr unsigned int trials = 10000;
 static constexpr unsigned int maxHeight = 50;
+// Widths of the puzzles of each height in the sweep
+static constexpr std::array<unsigned int, 2> sweepWidths{ 10, 15 };
+
+// Set on SIGINT, cancelling the running solve and ending the sweep
+static std::atomic<bool> interrupted{ false };
+
+extern "C" void onInterrupt(int /*signal*/)
+{
+  interrupted = true;
+}
+
+// Generator of the random puzzles of a command, logging its seed so the run can be repeated
+static usp::UspGenerator SeededGenerator(std::uint64_t seed)
+{
+  spdlog::info("Random puzzles from seed {}", seed);
+  return usp::UspGenerator(seed);
+}
+
+// Report the throughput of each enumeration and counting mode over the same random puzzles
+static void benchmarkEnumeration(unsigned int n, unsigned int k, unsigned int puzzles, unsigned int threads, std::uint64_t seed)
+{
+  usp::UspGenerator generator = SeededGenerator(seed);
+  std::vector<usp::Usp> corpus;
+  corpus.reserve(puzzles);
+  for (unsigned int i = 0; i < puzzles; ++i) {
+    corpus.push_back(generator.generateRandomPuzzle(n, k));
+  }
+
+  auto measure = [&corpus](const std::string &name, const std::function<unsigned long long(const usp::Usp &)> &count) {
+    unsigned long long witnesses = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for (const usp::Usp &usp : corpus) {
+      witnesses += count(usp);
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    spdlog::info("{}: {} witnesses in {:.3f}s, {:.0f} witnesses/s", name, witnesses, duration.count(), static_cast<double>(witnesses) / duration.count());
+  };
+
+  measure("DPLL enumerate", [](const usp::Usp &usp) {
+    unsigned long long witnesses = 0;
+    usp::DpllEnumerate(usp, [&witnesses](const usp::Permutation &, const usp::Permutation &) {
+      ++witnesses;
+      return true;
+    });
+    return witnesses;
+  });
+  measure("CDCL enumerate", [](const usp::Usp &usp) {
+    unsigned long long witnesses = 0;
+    usp::CdclEnumerate(usp, [&witnesses](const usp::Permutation &, const usp::Permutation &) {
+      ++witnesses;
+      return true;
+    });
+    return witnesses;
+  });
+  measure("DPLL count", [threads](const usp::Usp &usp) { return usp::DpllCountWitnesses(usp, threads); });
+  measure("CDCL count", [threads](const usp::Usp &usp) { return usp::CdclCountWitnesses(usp, threads); });
+}
+
+// Report the startup time, solve time and peak memory of one random puzzle with an eager or lazy tensor
+static void benchmarkTensor(unsigned int n, unsigned int k, std::size_t cachedSlabs, const usp::SolverLimits &limits, std::uint64_t seed)
+{
+  usp::UspGenerator generator = SeededGenerator(seed);
+  std::vector<int> cells(static_cast<std::size_t>(n) * k);
+  generator.fill(cells.data(), cells.size());
+
+  auto startTime = std::chrono::steady_clock::now();
+  usp::Usp usp(std::move(cells), n, k, cachedSlabs);
+  std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - startTime;
+  startTime = std::chrono::steady_clock::now();
+  auto result = usp::MatchingSolve(usp, limits);
+  std::chrono::duration<double> solveTime = std::chrono::steady_clock::now() - startTime;
+
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  const char *verdict = result.status == usp::SolverStatus::WEAK ? "weak" : result.status == usp::SolverStatus::STRONG ? "strong" : "unknown";
+  spdlog::info("{} tensor of ({}, {}): built in {:.3f}ms, {} in {:.3f}ms computing {} slabs, peak RSS {} KiB",
+    usp.lazy() ? "Lazy" : "Eager",
+    n,
+    k,
+    buildTime.count() * 1000,
+    verdict,
+    solveTime.count() * 1000,
+    usp.lazy() ? usp.slabsComputed() : static_cast<std::size_t>(n) * n,
+    usage.ru_maxrss);
+}
+
+// Run the CDCL, CNF and matching solvers head to head over the same random puzzles
+static void compareSolvers(unsigned int n, unsigned int k, unsigned int puzzles, const usp::SolverLimits &limits, std::uint64_t seed)
+{
+  usp::UspGenerator generator = SeededGenerator(seed);
+  unsigned int disagreements = 0;
+  unsigned int solved = 0;
+  std::map<std::string, double> totalTimes;
+  std::map<std::string, unsigned int> timeouts;
+  for (unsigned int i = 0; i < puzzles && !interrupted; ++i) {
+    usp::Usp usp = generator.generateRandomPuzzle(n, k);
+    std::optional<usp::SolverStatus> verdict;
+    bool disagreed = false;
+    std::map<std::string, double> times;
+    std::map<std::string, unsigned int> timedOut;
+    for (const auto &[name, solve] : { std::make_pair("CDCL", &usp::CdclSolve), std::make_pair("CNF", &usp::CnfSolve), std::make_pair("Matching", &usp::MatchingSolve) }) {
+      auto startTime = std::chrono::steady_clock::now();
+      auto result = solve(usp, limits);
+      std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+      times[name] = duration.count();
+      if (result.status == usp::SolverStatus::UNKNOWN) {
+        timedOut[name] = 1;
+        continue;
+      }
+      if (result.witness.has_value() && !usp::VerifyUspWeakness(usp, result.witness->first, result.witness->second)) {
+        spdlog::info("{} solver failure", name);
+      }
+      disagreed = disagreed || (verdict.has_value() && verdict != result.status);
+      verdict = result.status;
+    }
+    // A puzzle cut short by SIGINT is left out of the means
+    if (interrupted) {
+      break;
+    }
+    ++solved;
+    if (disagreed) {
+      ++disagreements;
+    }
+    for (const auto &[name, time] : times) {
+      totalTimes[name] += time;
+      timeouts[name] += timedOut[name];
+    }
+  }
+  for (const auto &[name, time] : totalTimes) {
+    spdlog::info("{}: {:.3f}ms mean, {} timeouts", name, time * 1000 / solved, timeouts[name]);
+  }
+  spdlog::info("{} disagreements over {} puzzles", disagreements, solved);
+}
 
 int main(int argc, const char **argv)
 {
@@ -34,19 +238,191 @@ int main(int argc, const char **argv)
     true,// show help if requested
     "USP");// version string
 
-  for (auto const &arg : args) {
-    std::cout << arg.first << arg.second << std::endl;
+  // Standard output carries the results of serve
+  if (!args["serve"].asBool()) {
+    for (auto const &arg : args) {
+      std::cout << arg.first << arg.second << std::endl;
+    }
   }
 
   // Use the default logger (stdout, multi-threaded, colored)
   spdlog::set_level(spdlog::level::info);
   spdlog::debug("Debug Logging ON");
+  const auto seed = static_cast<std::uint64_t>(args["--seed"].asLong());
+
+  if (args["export"].asBool()) {
+    usp::UspGenerator generator = SeededGenerator(seed);
+    usp::Usp usp = generator.generateRandomPuzzle(static_cast<unsigned int>(args["<n>"].asLong()), static_cast<unsigned int>(args["<k>"].asLong()));
+    std::ofstream cnfFile(args["<cnf>"].asString());
+    auto startTime = std::chrono::steady_clock::now();
+    usp::WriteDimacs(usp, cnfFile);
+    cnfFile.close();
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    spdlog::info("Wrote {} clauses in {:.3f}s", usp::DimacsClauseCount(usp), duration.count());
+    return 0;
+  }
+
+  if (args["import"].asBool()) {
+    std::ifstream cnfFile(args["<cnf>"].asString());
+    std::ifstream modelFile(args["<model>"].asString());
+    try {
+      usp::Usp usp = usp::ReadDimacsPuzzle(cnfFile);
+      auto witness = usp::ReadDimacsWitness(usp, modelFile);
+      spdlog::info("Puzzle is {}", witness.has_value() ? "weak, the model is a verified witness" : "strong according to the solver");
+    } catch (const std::runtime_error &error) {
+      spdlog::error("{}", error.what());
+      return 1;
+    }
+    return 0;
+  }
+
+  if (args["corpus"].asBool()) {
+    const std::string path = args["<file>"].asString();
+    const auto puzzles = static_cast<unsigned int>(args["--puzzles"].asLong());
+    usp::UspGenerator generator = SeededGenerator(seed);
+    {
+      usp::CorpusWriter writer(path);
+      for (unsigned int i = 0; i < puzzles; ++i) {
+        writer.add(generator.generateRandomPuzzle(static_cast<unsigned int>(args["<n>"].asLong()), static_cast<unsigned int>(args["<k>"].asLong())));
+      }
+      writer.finish();
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    usp::CorpusReader reader(path);
+    std::chrono::duration<double> openTime = std::chrono::steady_clock::now() - startTime;
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < reader.size(); ++i) {
+      bytes += reader.view(i).bytes();
+    }
+    std::chrono::duration<double> viewTime = std::chrono::steady_clock::now() - startTime;
+    spdlog::info("Opened {} puzzles in {:.3f}ms, viewed {} bytes of cells in {:.3f}ms", reader.size(), openTime.count() * 1000, bytes, viewTime.count() * 1000);
+    return 0;
+  }
+
+  if (args["enumerate"].asBool()) {
+    benchmarkEnumeration(static_cast<unsigned int>(args["<n>"].asLong()),
+      static_cast<unsigned int>(args["<k>"].asLong()),
+      static_cast<unsigned int>(args["--puzzles"].asLong()),
+      static_cast<unsigned int>(args["--threads"].asLong()),
+      seed);
+    return 0;
+  }
+
+  std::signal(SIGINT, onInterrupt);
+
+  usp::SolverLimits limits;
+  limits.wallTime = std::chrono::milliseconds(args["--timeout"].asLong());
+  limits.cancel = &interrupted;
+
+  if (args["prove"].asBool()) {
+    std::ifstream cnfFile(args["<cnf>"].asString());
+    std::ofstream proofFile(args["<proof>"].asString(), std::ios::binary);
+    usp::IncrementalSatSolver solver;
+    usp::DratWriter proof(proofFile);
+    // Clauses shortened by units while loading are lemmas of the proof too
+    solver.setProof(&proof);
+    auto startTime = std::chrono::steady_clock::now();
+    try {
+      usp::LoadDimacs(cnfFile, solver);
+    } catch (const std::runtime_error &error) {
+      spdlog::error("{}", error.what());
+      return 1;
+    }
+    auto result = solver.solve({}, limits);
+    proof.flush();
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    const char *verdict = result == usp::IncrementalSatSolver::Result::UNSATISFIABLE ? "strong" : result == usp::IncrementalSatSolver::Result::SATISFIABLE ? "weak" : "unknown";
+    spdlog::info("Puzzle is {} after {:.3f}ms and {} conflicts, {} bytes of proof", verdict, duration.count() * 1000, solver.stats().conflicts, proof.bytes());
+    return 0;
+  }
+
+  if (args["trace"].asBool()) {
+#if defined(USP_ENABLE_TRACE)
+    usp::UspGenerator generator(seed);
+    usp::Usp usp = generator.generateRandomPuzzle(static_cast<unsigned int>(args["<n>"].asLong()), static_cast<unsigned int>(args["<k>"].asLong()));
+    usp::SolveFunction solve = nullptr;
+    try {
+      solve = usp::SolverByName(args["--solver"].asString());
+    } catch (const std::invalid_argument &error) {
+      spdlog::error("{}", error.what());
+      return 1;
+    }
+    usp::SolverTrace trace;
+    limits.trace = &trace;
+    usp::SolverResult result = solve(usp, limits);
+    std::ofstream traceFile(args["<file>"].asString(), std::ios::binary);
+    if (args["--binary"].asBool()) {
+      trace.writeBinary(traceFile);
+    } else {
+      trace.writeChromeJson(traceFile);
+    }
+    spdlog::info("Seed {}: {} decisions, {} conflicts, traced {} events ({} dropped)", generator.seed(), result.stats.decisions, result.stats.conflicts, trace.records().size(), trace.dropped());
+    return 0;
+#else
+    spdlog::error("Tracing needs a build with ENABLE_SOLVER_TRACE");
+    return 1;
+#endif
+  }
+
+  if (args["tensor"].asBool()) {
+    benchmarkTensor(static_cast<unsigned int>(args["<n>"].asLong()),
+      static_cast<unsigned int>(args["<k>"].asLong()),
+      !args["--lazy"].asBool() ? 0 : args["--cached-slabs"].asLong() == 0 ? usp::Usp::kCacheEverySlab : static_cast<std::size_t>(args["--cached-slabs"].asLong()),
+      limits,
+      seed);
+    return 0;
+  }
+
+  if (args["compare"].asBool()) {
+    compareSolvers(static_cast<unsigned int>(args["<n>"].asLong()),
+      static_cast<unsigned int>(args["<k>"].asLong()),
+      static_cast<unsigned int>(args["--puzzles"].asLong()),
+      limits,
+      seed);
+    return 0;
+  }
+
+  const std::string solverName = args["--solver"].asString();
+  usp::SolveFunction solve = nullptr;
+  try {
+    solve = usp::SolverByName(solverName);
+  } catch (const std::invalid_argument &error) {
+    spdlog::error("{}", error.what());
+    return 1;
+  }
+  if (args["--session"].asBool() && solverName != "matching") {
+    spdlog::error("A solver session runs the matching solver, use --solver=matching");
+    return 1;
+  }
+
+  if (args["serve"].asBool()) {
+    usp::BatchServerOptions options;
+    options.threads = static_cast<unsigned int>(args["--threads"].asLong());
+    options.maxInFlight = static_cast<unsigned int>(args["--in-flight"].asLong());
+    options.ordered = !args["--unordered"].asBool();
+    options.binary = args["--binary"].asBool();
+    options.limits = limits;
+    std::ios::sync_with_stdio(false);
+    usp::BatchServer server(solve, options);
+    try {
+      usp::BatchServerStats stats = server.run(std::cin, std::cout);
+      std::cerr << stats.puzzles << " puzzles: " << stats.weak << " weak, " << stats.strong << " strong, " << stats.unknown << " unknown, " << stats.errors << " errors\n";
+    } catch (const std::runtime_error &error) {
+      std::cerr << error.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
 
   std::ofstream csvFile;
   csvFile.open("runtime.csv");
-  csvFile << "Depth,Width,Mean(ms),Deviation(ms)\n";
+  csvFile << "Depth,Width,Mean(ms),Deviation(ms),Timeouts\n";
 
   auto calculateMeanAndDeviation = [](std::vector<double> times) -> std::pair<double, double> {
+    if (times.empty()) {
+      return { 0.0, 0.0 };
+    }
     double sum = std::accumulate(times.begin(), times.end(), 0.0);
     double mean = sum / static_cast<double>(times.size());
     auto variance = std::accumulate(times.begin(), times.end(), 0.0, [&mean](double acc, double elt) {
@@ -55,35 +431,86 @@ int main(int argc, const char **argv)
     return std::make_pair<double, double>(sum / static_cast<double>(times.size()), std::sqrt(variance / static_cast<double>(times.size())));
   };
 
-  usp::UspGenerator generator;
+  usp::UspGenerator generator = SeededGenerator(seed);
+  // With --session every trial refills one puzzle and solves it on one session, so trials do not allocate
+  std::optional<usp::SolverSession> session;
+  usp::Usp sessionPuzzle({}, 0, 0);
+  if (args["--session"].asBool()) {
+    session.emplace(maxHeight, limits);
+    const unsigned int maxWidth = *std::max_element(sweepWidths.begin(), sweepWidths.end());
+    sessionPuzzle.reserve(maxHeight, maxWidth);
+    generator.reserve(maxHeight, maxWidth);
+  }
+  std::vector<double> executionTimes;
+  executionTimes.reserve(trials);
   // Generate and write data for (i, j) USPs
-  auto generateData = [&generator, &csvFile, &calculateMeanAndDeviation](unsigned int i, unsigned int j) {
-    std::vector<double> executionTimes;
-    executionTimes.reserve(trials);
-    for (unsigned int k = 0; k < trials; ++k) {
-      usp::Usp usp = generator.generateRandomPuzzle(i, j);
+  const bool lockstep = args["--lockstep"].asBool();
+  auto generateData = [&](unsigned int i, unsigned int j) {
+    executionTimes.clear();
+    unsigned int timeouts = 0;
+    if (lockstep && i <= usp::kLockstepMaxRows) {
+      usp::LockstepBatch batch(i);
+      std::vector<usp::Usp> puzzles;
+      for (unsigned int k = 0; k < trials && !interrupted; k += static_cast<unsigned int>(batch.size())) {
+        batch.clear();
+        puzzles.clear();
+        for (unsigned int lane = 0; lane < usp::kLockstepLanes && k + lane < trials; ++lane) {
+          puzzles.push_back(generator.generateRandomPuzzle(i, j));
+        }
+        auto startTime = std::chrono::steady_clock::now();
+        for (const usp::Usp &usp : puzzles) {
+          batch.add(usp);
+        }
+        batch.solve();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+        executionTimes.insert(executionTimes.end(), puzzles.size(), duration.count() / static_cast<double>(puzzles.size()));
+        for (std::size_t lane = 0; lane < puzzles.size(); ++lane) {
+          if (batch.weak(lane) && (usp::IsIdentityWitness(batch.rho(lane), batch.sigma(lane)) || usp::FirstFailingRow(puzzles[lane], batch.rho(lane), batch.sigma(lane)) != usp::kNoFailingRow)) {
+            spdlog::info("Lockstep solver failure");
+          }
+        }
+      }
+    }
+    for (unsigned int k = 0; k < trials && !interrupted && !(lockstep && i <= usp::kLockstepMaxRows); ++k) {
+      std::optional<usp::Usp> fresh;
+      if (session.has_value()) {
+        generator.generateRandomPuzzle(sessionPuzzle, i, j);
+      } else {
+        fresh.emplace(generator.generateRandomPuzzle(i, j));
+      }
+      const usp::Usp &usp = fresh.has_value() ? *fresh : sessionPuzzle;
+
       auto startTime = std::chrono::steady_clock::now();
-      auto solution = usp::CdclSolver(usp);
+      std::optional<usp::SolverResult> result;
+      auto status = session.has_value() ? session->solve(usp) : result.emplace(solve(usp, limits)).status;
       auto endTime = std::chrono::steady_clock::now();
+      if (status == usp::SolverStatus::UNKNOWN) {
+        ++timeouts;
+        continue;
+      }
       // Time in seconds
       std::chrono::duration<double> duration = endTime - startTime;
       executionTimes.push_back(duration.count());
       // Verify solution
-      if (solution.has_value()) {
-        auto [rho, sigma] = solution.value();
-        if (!usp::VerifyUspWeakness(usp, rho, sigma)) {
-          spdlog::info("CDCL solver failure");
-        }
+      bool verified = true;
+      if (session.has_value() && status == usp::SolverStatus::WEAK) {
+        verified = !usp::IsIdentityWitness(session->rho(), session->sigma()) && usp::FirstFailingRow(usp, session->rho(), session->sigma()) == usp::kNoFailingRow;
+      } else if (result.has_value() && result->witness.has_value()) {
+        verified = usp::VerifyUspWeakness(usp, result->witness->first, result->witness->second);
+      }
+      if (!verified) {
+        spdlog::info("{} solver failure", solverName);
       }
     }
     // Report mean and standard deviation of runtimes to file
     auto [mean, deviation] = calculateMeanAndDeviation(executionTimes);
-    csvFile << i << "," << j << "," << mean * 1000 << "," << deviation * 1000 << std::endl;
+    csvFile << i << "," << j << "," << mean * 1000 << "," << deviation * 1000 << "," << timeouts << std::endl;
   };
 
-  for (unsigned int i = 1; i < maxHeight + 1; ++i) {
-    generateData(i, 10);
-    generateData(i, 15);
+  for (unsigned int i = 1; i < maxHeight + 1 && !interrupted; ++i) {
+    for (unsigned int width : sweepWidths) {
+      generateData(i, width);
+    }
   }
 
   csvFile.close();
@@ -0,0 +1,381 @@
+#ifndef MATCHING_SOLVER_H
+#define MATCHING_SOLVER_H
+
+#include "usp.h"
+#include "solverlimits.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace usp {
+
+/* Search over rho alone. Once rho is fixed, sigma is a perfect matching of
+ * rows to columns in the bipartite graph with an edge (i, c) iff
+ * !query(i, rho(i), c). While rho is partial, an unassigned row keeps the
+ * edges allowed by any of the values still free for it, a superset of its
+ * final edges, so the lack of a perfect matching prunes the whole subtree.
+ * Only the matching is kept incrementally: a node only drops the edges it
+ * made invalid and augments the rows they left unmatched. The candidate
+ * columns of every unassigned row are rebuilt on each decision and
+ * backtrack, ORing one slab per free value, so a node costs O(n^2 slabWords)
+ * slab reads. Counting per column the free values that allow it would read
+ * one slab per row instead, but is slower up to a hundred rows, where a slab
+ * is a word or two. Rows are branched on fewest remaining values first.
+ */
+class RhoMatchingSearch
+{
+public:
+  // Buffers sized for puzzles of up to maxN rows, which grow if a larger one is searched
+  explicit RhoMatchingSearch(unsigned int maxN = 0)
+  {
+    const std::size_t words = (maxN + 63) / 64;
+    for (auto *buffer : { &m_rho, &m_matchRow, &m_matchCol, &m_visited }) {
+      buffer->reserve(maxN);
+    }
+    for (auto *buffer : { &m_rhoValues, &m_candidates }) {
+      buffer->reserve(maxN * words);
+    }
+    m_used.reserve(words);
+  }
+
+  // Search puzzle for a witness within budget. Returns true if one was found
+  bool run(const Usp &puzzle, SolverBudget &budget)
+  {
+    m_puzzle = &puzzle;
+    m_budget = &budget;
+    m_n = puzzle.rows();
+    m_words = puzzle.slabWords();
+    m_rho.assign(m_n, kUnassigned);
+    m_used.assign(m_words, 0);
+    m_candidates.assign(static_cast<std::size_t>(m_n) * m_words, 0);
+    m_matchRow.assign(m_n, kUnassigned);
+    m_matchCol.assign(m_n, kUnassigned);
+    m_visited.assign(m_n, 0);
+    m_epoch = 0;
+    m_found = false;
+
+    // Values of rho(i) that leave row i some column, which never changes
+    m_rhoValues.assign(static_cast<std::size_t>(m_n) * m_words, 0);
+    for (unsigned int i = 0; i < m_n; ++i) {
+      for (unsigned int b = 0; b < m_n; ++b) {
+        if (!full(puzzle.slab(i, b))) {
+          m_rhoValues[i * m_words + b / 64] |= std::uint64_t{ 1 } << (b % 64);
+        }
+      }
+    }
+    return m_n > 0 && search(0) && m_found;
+  }
+
+  // rho and sigma of the witness found
+  const std::vector<unsigned int> &rho() const
+  {
+    return m_rho;
+  }
+
+  const std::vector<unsigned int> &sigma() const
+  {
+    return m_matchRow;
+  }
+
+private:
+  static constexpr unsigned int kUnassigned = std::numeric_limits<unsigned int>::max();
+
+  // True if slab has every column set, leaving no column to sigma
+  bool full(const std::uint64_t *slab) const
+  {
+    for (unsigned int word = 0; word < m_words; ++word) {
+      if (~slab[word] & mask(word)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Bits of the columns that exist in word
+  std::uint64_t mask(unsigned int word) const
+  {
+    return (word + 1 == m_words && m_n % 64 != 0) ? (std::uint64_t{ 1 } << (m_n % 64)) - 1 : ~std::uint64_t{ 0 };
+  }
+
+  bool edge(unsigned int row, unsigned int col) const
+  {
+    return (m_candidates[row * m_words + col / 64] >> (col % 64)) & 1;
+  }
+
+  // Recompute the columns of every unassigned row from the values still free, and of row
+  void updateCandidates(unsigned int row)
+  {
+    for (unsigned int i = 0; i < m_n; ++i) {
+      if (i != row && m_rho[i] != kUnassigned) {
+        continue;
+      }
+      std::uint64_t *candidates = &m_candidates[i * m_words];
+      if (m_rho[i] != kUnassigned) {
+        const std::uint64_t *slab = m_puzzle->slab(i, m_rho[i]);
+        for (unsigned int word = 0; word < m_words; ++word) {
+          candidates[word] = ~slab[word] & mask(word);
+        }
+        continue;
+      }
+      std::fill(candidates, candidates + m_words, 0);
+      for (unsigned int word = 0; word < m_words; ++word) {
+        for (std::uint64_t free = m_rhoValues[i * m_words + word] & ~m_used[word]; free != 0; free &= free - 1) {
+          const std::uint64_t *slab = m_puzzle->slab(i, word * 64 + static_cast<unsigned int>(__builtin_ctzll(free)));
+          for (unsigned int w = 0; w < m_words; ++w) {
+            candidates[w] |= ~slab[w] & mask(w);
+          }
+        }
+      }
+    }
+  }
+
+  // Kuhn's augmenting path from row, never matching row to forbidden
+  bool augment(unsigned int row, unsigned int forbidden = kUnassigned)
+  {
+    const std::uint64_t *candidates = &m_candidates[row * m_words];
+    for (unsigned int word = 0; word < m_words; ++word) {
+      for (std::uint64_t bits = candidates[word]; bits != 0; bits &= bits - 1) {
+        const unsigned int col = word * 64 + static_cast<unsigned int>(__builtin_ctzll(bits));
+        if (col == forbidden || m_visited[col] == m_epoch) {
+          continue;
+        }
+        m_visited[col] = m_epoch;
+        if (m_matchCol[col] == kUnassigned || augment(m_matchCol[col])) {
+          m_matchRow[row] = col;
+          m_matchCol[col] = row;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Drop the matched edges that are no longer candidates, and augment until the matching is perfect
+  bool repairMatching()
+  {
+    for (unsigned int i = 0; i < m_n; ++i) {
+      if (m_matchRow[i] != kUnassigned && !edge(i, m_matchRow[i])) {
+        m_matchCol[m_matchRow[i]] = kUnassigned;
+        m_matchRow[i] = kUnassigned;
+      }
+    }
+    for (unsigned int i = 0; i < m_n; ++i) {
+      if (m_matchRow[i] == kUnassigned) {
+        ++m_epoch;
+        if (!augment(i)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  /* With rho the identity, sigma must differ from it too. Look for a
+   * perfect matching without some edge (i, i), through an alternating
+   * path from row i back to column i.
+   */
+  bool nonIdentityMatching()
+  {
+    for (unsigned int i = 0; i < m_n; ++i) {
+      if (m_matchRow[i] != i) {
+        return true;
+      }
+    }
+    for (unsigned int i = 0; i < m_n; ++i) {
+      m_matchRow[i] = kUnassigned;
+      m_matchCol[i] = kUnassigned;
+      ++m_epoch;
+      if (augment(i, i)) {
+        return true;
+      }
+      m_matchRow[i] = i;
+      m_matchCol[i] = i;
+    }
+    return false;
+  }
+
+  // Returns true if the search must stop, with a witness or out of budget
+  bool search(unsigned int depth)
+  {
+    // Branch on the row with the fewest free values
+    unsigned int row = kUnassigned;
+    unsigned int fewest = kUnassigned;
+    for (unsigned int i = 0; i < m_n; ++i) {
+      if (m_rho[i] != kUnassigned) {
+        continue;
+      }
+      unsigned int values = 0;
+      for (unsigned int word = 0; word < m_words; ++word) {
+        values += static_cast<unsigned int>(__builtin_popcountll(m_rhoValues[i * m_words + word] & ~m_used[word]));
+      }
+      if (values < fewest) {
+        row = i;
+        fewest = values;
+      }
+    }
+
+    if (row == kUnassigned) {
+      bool identity = true;
+      for (unsigned int i = 0; i < m_n && identity; ++i) {
+        identity = m_rho[i] == i;
+      }
+      m_found = !identity || nonIdentityMatching();
+      if (m_found) {
+        USP_TRACE(*m_budget, TraceEvent::WITNESS, static_cast<int>(depth));
+      }
+      return m_found;
+    }
+
+    for (unsigned int word = 0; word < m_words; ++word) {
+      for (std::uint64_t free = m_rhoValues[row * m_words + word] & ~m_used[word]; free != 0; free &= free - 1) {
+        const unsigned int value = word * 64 + static_cast<unsigned int>(__builtin_ctzll(free));
+        if (m_budget->decide()) {
+          return true;
+        }
+        USP_TRACE(*m_budget, TraceEvent::DECISION, static_cast<int>(depth), row, value, 1);
+        m_rho[row] = value;
+        m_used[word] |= std::uint64_t{ 1 } << (value % 64);
+        USP_TRACE(*m_budget, TraceEvent::PROPAGATION_BEGIN, static_cast<int>(depth));
+        updateCandidates(row);
+        const bool matched = repairMatching();
+        USP_TRACE(*m_budget, TraceEvent::PROPAGATION_END, static_cast<int>(depth));
+
+        bool stopped = false;
+        if (!matched) {
+          USP_TRACE(*m_budget, TraceEvent::CONFLICT, static_cast<int>(depth));
+          stopped = m_budget->conflict();
+        } else {
+          stopped = search(depth + 1);
+        }
+        if (stopped) {
+          return true;
+        }
+        m_rho[row] = kUnassigned;
+        m_used[word] &= ~(std::uint64_t{ 1 } << (value % 64));
+      }
+    }
+    // The candidates of the parent are restored by its next branch, and its
+    // matching stays valid for them since they only grow back
+    updateCandidates(kUnassigned);
+    USP_TRACE(*m_budget, TraceEvent::BACKTRACK, static_cast<int>(depth), depth == 0 ? 0 : depth - 1, 1);
+    return false;
+  }
+
+  const Usp *m_puzzle{ nullptr };
+  SolverBudget *m_budget{ nullptr };
+  unsigned int m_n{ 0 };
+  unsigned int m_words{ 0 };
+  // Value of rho(i), or kUnassigned
+  std::vector<unsigned int> m_rho;
+  // Values taken by rho, as a bitset
+  std::vector<std::uint64_t> m_used;
+  std::vector<std::uint64_t> m_rhoValues;
+  // Columns row i may match under the current rho, m_words words per row
+  std::vector<std::uint64_t> m_candidates;
+  std::vector<unsigned int> m_matchRow;
+  std::vector<unsigned int> m_matchCol;
+  // Column visited in the augmenting search of epoch
+  std::vector<unsigned int> m_visited;
+  unsigned int m_epoch{ 0 };
+  bool m_found{ false };
+};
+
+/* Solve within limits by searching rho with a matching over sigma.
+ */
+SolverResult MatchingSolve(const Usp &puzzle, const SolverLimits &limits = {})
+{
+  SolverResult result;
+  SolverBudget budget(limits);
+  RhoMatchingSearch search(puzzle.rows());
+  if (search.run(puzzle, budget)) {
+    Permutation rho(puzzle.rows());
+    Permutation sigma(puzzle.rows());
+    for (unsigned int i = 0; i < puzzle.rows(); ++i) {
+      rho.assign(i, search.rho()[i], true);
+      sigma.assign(i, search.sigma()[i], true);
+    }
+    result.witness = std::make_pair(rho, sigma);
+  }
+  result.status = result.witness.has_value() ? SolverStatus::WEAK : budget.exhausted() ? SolverStatus::UNKNOWN : SolverStatus::STRONG;
+  result.stats = budget.stats();
+  return result;
+}
+
+/* Solves many puzzles in a row with the matching search, reusing its
+ * buffers, which are sized up front for puzzles of up to maxN rows. The
+ * witness stays in the session as column vectors rather than Permutations,
+ * so once the buffers are sized, solving never allocates. Used by the
+ * sweep of runsolver, together with a Usp refilled in place, so that small
+ * puzzles are not dominated by setting up each solve.
+ */
+class SolverSession
+{
+public:
+  explicit SolverSession(unsigned int maxN, const SolverLimits &limits = {}) : m_search(maxN), m_limits(limits)
+  {
+    m_rho.reserve(maxN);
+    m_sigma.reserve(maxN);
+  }
+
+  // Solve puzzle, replacing the witness and stats of the previous solve
+  SolverStatus solve(const Usp &puzzle)
+  {
+    SolverBudget budget(m_limits);
+    const bool weak = m_search.run(puzzle, budget);
+    m_rho.clear();
+    m_sigma.clear();
+    if (weak) {
+      m_rho.assign(m_search.rho().begin(), m_search.rho().end());
+      m_sigma.assign(m_search.sigma().begin(), m_search.sigma().end());
+    }
+    m_stats = budget.stats();
+    m_status = weak ? SolverStatus::WEAK : budget.exhausted() ? SolverStatus::UNKNOWN : SolverStatus::STRONG;
+    return m_status;
+  }
+
+  SolverStatus status() const
+  {
+    return m_status;
+  }
+
+  // Columns of rho and sigma if the last solve found a witness, empty otherwise
+  const std::vector<unsigned int> &rho() const
+  {
+    return m_rho;
+  }
+
+  const std::vector<unsigned int> &sigma() const
+  {
+    return m_sigma;
+  }
+
+  const SolverStats &stats() const
+  {
+    return m_stats;
+  }
+
+private:
+  RhoMatchingSearch m_search;
+  SolverLimits m_limits;
+  SolverStatus m_status{ SolverStatus::UNKNOWN };
+  std::vector<unsigned int> m_rho;
+  std::vector<unsigned int> m_sigma;
+  SolverStats m_stats;
+};
+
+/* Solver for USP Weakness searching only rho.
+ * Returns a pair of permutations if one has been found
+ * which verifies the USP as weak.
+ */
+std::optional<std::pair<Permutation, Permutation>> MatchingSolver(const Usp &puzzle)
+{
+  return MatchingSolve(puzzle, {}).witness;
+}
+
+}// namespace usp
+
+#endif
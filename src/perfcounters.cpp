@@ -0,0 +1,141 @@
+#include "perfcounters.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define USP_PERF_EVENTS
+#endif
+
+namespace usp {
+
+#if defined(USP_PERF_EVENTS)
+
+namespace {
+
+  int OpenCounter(std::uint32_t type, std::uint64_t config, int groupFd)
+  {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // This thread on any cpu
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+  }
+
+}// namespace
+
+PerfCounters::PerfCounters()
+{
+  const std::array<std::pair<std::uint32_t, std::uint64_t>, kPerfCounters> events{ {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  } };
+  for (std::size_t i = 0; i < kPerfCounters; ++i) {
+    m_fds[i] = OpenCounter(events[i].first, events[i].second, m_leader);
+    if (m_fds[i] >= 0 && m_leader == -1) {
+      m_leader = m_fds[i];
+    }
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  for (int fd : m_fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+void PerfCounters::start()
+{
+  if (m_leader >= 0) {
+    ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+PerfSample PerfCounters::stop()
+{
+  PerfSample sample;
+  if (m_leader < 0) {
+    return sample;
+  }
+  ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  // nr, time enabled, time running, then a value per open counter in the order they were opened
+  std::vector<std::uint64_t> data(3 + kPerfCounters, 0);
+  const auto bytes = read(m_leader, data.data(), data.size() * sizeof(std::uint64_t));
+  if (bytes < static_cast<ssize_t>(3 * sizeof(std::uint64_t)) || data[2] == 0) {
+    return sample;
+  }
+  // Scale up if the group only ran for part of the interval
+  const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+  std::size_t value = 3;
+  for (std::size_t i = 0; i < kPerfCounters && value < 3 + data[0]; ++i) {
+    if (m_fds[i] >= 0) {
+      sample.values[i] = static_cast<unsigned long long>(static_cast<double>(data[value++]) * scale);
+    }
+  }
+  return sample;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+  m_fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void PerfCounters::start()
+{}
+
+PerfSample PerfCounters::stop()
+{
+  return {};
+}
+
+#endif
+
+bool PerfCounters::available(PerfCounter counter) const
+{
+  return m_fds[static_cast<std::size_t>(counter)] >= 0;
+}
+
+bool PerfCounters::anyAvailable() const
+{
+  return m_leader >= 0;
+}
+
+const char *PerfCounters::Name(PerfCounter counter)
+{
+  switch (counter) {
+  case PerfCounter::CYCLES:
+    return "Cycles";
+  case PerfCounter::INSTRUCTIONS:
+    return "Instructions";
+  case PerfCounter::L1D_MISSES:
+    return "L1DMisses";
+  case PerfCounter::LLC_MISSES:
+    return "LLCMisses";
+  case PerfCounter::BRANCH_MISSES:
+    return "BranchMisses";
+  }
+  return "Unknown";
+}
+
+}// namespace usp
@@ -0,0 +1,67 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <cstddef>
+#include <optional>
+
+namespace usp {
+
+enum class PerfCounter {
+  CYCLES,
+  INSTRUCTIONS,
+  L1D_MISSES,
+  LLC_MISSES,
+  BRANCH_MISSES
+};
+
+static constexpr std::size_t kPerfCounters = 5;
+
+/* Counter values over a measured interval, nullopt for counters that are not available
+ */
+struct PerfSample
+{
+  std::array<std::optional<unsigned long long>, kPerfCounters> values{};
+
+  const std::optional<unsigned long long> &operator[](PerfCounter counter) const
+  {
+    return values[static_cast<std::size_t>(counter)];
+  }
+};
+
+/* Hardware performance counters of the calling thread, user space only.
+ * On Linux the counters are opened with perf_event_open as one group, so
+ * they are scheduled together and scaled by the time they ran if the PMU
+ * is multiplexed. A counter the kernel or the hardware refuses, for
+ * instance under perf_event_paranoid or in a virtual machine, is left out,
+ * and elsewhere none are available. start() and stop() never fail.
+ */
+class PerfCounters
+{
+public:
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+
+  bool available(PerfCounter counter) const;
+  // True if at least one counter is available
+  bool anyAvailable() const;
+
+  // Reset the counters and start counting
+  void start();
+  // Stop counting and return the counts since start()
+  PerfSample stop();
+
+  static const char *Name(PerfCounter counter);
+
+private:
+  // File descriptor of each counter, -1 if not available. The first open one leads the group
+  std::array<int, kPerfCounters> m_fds{};
+  int m_leader{ -1 };
+};
+
+}// namespace usp
+
+#endif
@@ -0,0 +1,695 @@
+#include "satsolver.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <spdlog/spdlog.h>
+
+namespace usp {
+
+namespace {
+
+  // Flags stored in the second header word of a clause, above them the LBD
+  constexpr std::uint32_t kLearntFlag = 1;
+  constexpr std::uint32_t kDeletedFlag = 2;
+  constexpr std::uint32_t kLbdShift = 2;
+
+  constexpr double kVariableDecay = 0.95;
+  constexpr unsigned long long kRestartUnit = 100;
+  constexpr std::size_t kInitialMaxLearnts = 2000;
+  constexpr std::size_t kLearntIncrement = 300;
+
+  // Luby sequence 1, 1, 2, 1, 1, 2, 4, ... scaling the restart intervals
+  unsigned long long luby(unsigned long long index)
+  {
+    unsigned long long size = 1;
+    unsigned long long sequence = 0;
+    while (size < index + 1) {
+      ++sequence;
+      size = 2 * size + 1;
+    }
+    while (size - 1 != index) {
+      size = (size - 1) / 2;
+      --sequence;
+      index %= size;
+    }
+    return 1ULL << sequence;
+  }
+
+}// namespace
+
+IncrementalSatSolver::Lit IncrementalSatSolver::toLit(int literal)
+{
+  auto variable = static_cast<std::uint32_t>(std::abs(literal) - 1);
+  return 2 * variable + (literal < 0 ? 1U : 0U);
+}
+
+std::uint32_t IncrementalSatSolver::var(Lit lit)
+{
+  return lit >> 1;
+}
+
+int IncrementalSatSolver::value(Lit lit) const
+{
+  int assigned = m_assigns[var(lit)];
+  return (lit & 1) ? -assigned : assigned;
+}
+
+std::uint32_t IncrementalSatSolver::decisionLevel() const
+{
+  return static_cast<std::uint32_t>(m_trailLimits.size());
+}
+
+int IncrementalSatSolver::newVariable()
+{
+  auto variable = static_cast<std::uint32_t>(m_assigns.size());
+  m_assigns.push_back(0);
+  m_levels.push_back(0);
+  m_reasons.push_back(kNoReason);
+  m_phases.push_back(false);
+  m_activity.push_back(0.0);
+  m_seen.push_back(0);
+  m_levelStamp.push_back(0);
+  m_heapIndex.push_back(SIZE_MAX);
+  m_watches.emplace_back();
+  m_watches.emplace_back();
+  heapInsert(variable);
+  return static_cast<int>(variable) + 1;
+}
+
+int IncrementalSatSolver::variables() const
+{
+  return static_cast<int>(m_assigns.size());
+}
+
+const SolverStats &IncrementalSatSolver::stats() const
+{
+  return m_stats;
+}
+
+void IncrementalSatSolver::setProof(DratWriter *proof)
+{
+  m_proof = proof;
+}
+
+void IncrementalSatSolver::logClause(const Lit *lits, std::size_t count, bool deletion)
+{
+  if (m_proof == nullptr) {
+    return;
+  }
+  // DRAT numbers variables from 1, so each literal is two above its Lit
+  m_proofLits.resize(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    m_proofLits[i] = lits[i] + 2;
+  }
+  if (deletion) {
+    m_proof->remove(m_proofLits.data(), count);
+  } else {
+    m_proof->add(m_proofLits.data(), count);
+  }
+}
+
+bool IncrementalSatSolver::modelValue(int variable) const
+{
+  return m_model.at(static_cast<std::size_t>(variable - 1));
+}
+
+std::uint32_t IncrementalSatSolver::clauseSize(ClauseRef clause) const
+{
+  return m_arena[clause];
+}
+
+IncrementalSatSolver::Lit *IncrementalSatSolver::clauseLits(ClauseRef clause)
+{
+  return &m_arena[clause + kHeaderWords];
+}
+
+bool IncrementalSatSolver::clauseLearnt(ClauseRef clause) const
+{
+  return m_arena[clause + 1] & kLearntFlag;
+}
+
+std::uint32_t IncrementalSatSolver::clauseLbd(ClauseRef clause) const
+{
+  return m_arena[clause + 1] >> kLbdShift;
+}
+
+IncrementalSatSolver::ClauseRef IncrementalSatSolver::allocateClause(const std::vector<Lit> &lits, bool learnt, std::uint32_t lbd)
+{
+  auto clause = static_cast<ClauseRef>(m_arena.size());
+  m_arena.push_back(static_cast<std::uint32_t>(lits.size()));
+  m_arena.push_back((lbd << kLbdShift) | (learnt ? kLearntFlag : 0));
+  m_arena.insert(m_arena.end(), lits.begin(), lits.end());
+  return clause;
+}
+
+void IncrementalSatSolver::attachClause(ClauseRef clause)
+{
+  const Lit *lits = clauseLits(clause);
+  m_watches[lits[0] ^ 1].push_back({ clause, lits[1] });
+  m_watches[lits[1] ^ 1].push_back({ clause, lits[0] });
+}
+
+bool IncrementalSatSolver::addClause(const std::vector<int> &literals)
+{
+  if (!m_ok) {
+    return false;
+  }
+  cancelUntil(0);
+
+  std::vector<Lit> lits;
+  lits.reserve(literals.size());
+  for (int literal : literals) {
+    while (static_cast<int>(m_assigns.size()) < std::abs(literal)) {
+      newVariable();
+    }
+    lits.push_back(toLit(literal));
+  }
+  std::sort(lits.begin(), lits.end());
+
+  // Drop duplicates and literals false at the root, skip tautologies and satisfied clauses
+  std::size_t kept = 0;
+  bool shortened = false;
+  for (std::size_t i = 0; i < lits.size(); ++i) {
+    if (value(lits[i]) > 0 || (i + 1 < lits.size() && lits[i + 1] == (lits[i] ^ 1))) {
+      return true;
+    }
+    shortened = shortened || value(lits[i]) < 0;
+    if (value(lits[i]) == 0 && (kept == 0 || lits[kept - 1] != lits[i])) {
+      lits[kept++] = lits[i];
+    }
+  }
+  lits.resize(kept);
+  // The clause kept is derived from the one added, which the proof checks against
+  if (shortened || lits.empty()) {
+    logClause(lits.data(), lits.size(), false);
+  }
+
+  if (lits.empty()) {
+    m_ok = false;
+  } else if (lits.size() == 1) {
+    enqueue(lits[0], kNoReason);
+    m_ok = propagate() == kNoReason;
+    if (!m_ok) {
+      logClause(nullptr, 0, false);
+    }
+  } else {
+    ClauseRef clause = allocateClause(lits, false, 0);
+    m_clauses.push_back(clause);
+    attachClause(clause);
+  }
+  return m_ok;
+}
+
+void IncrementalSatSolver::enqueue(Lit lit, ClauseRef reason)
+{
+  std::uint32_t variable = var(lit);
+  m_assigns[variable] = (lit & 1) ? -1 : 1;
+  m_levels[variable] = decisionLevel();
+  m_reasons[variable] = reason;
+  m_trail.push_back(lit);
+}
+
+IncrementalSatSolver::ClauseRef IncrementalSatSolver::propagate()
+{
+  ClauseRef conflict = kNoReason;
+  while (m_propagated < m_trail.size()) {
+    Lit lit = m_trail[m_propagated++];
+    Lit falseLit = lit ^ 1;
+    std::vector<Watcher> &watchers = m_watches[lit];
+
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < watchers.size()) {
+      // A true blocker satisfies the clause without touching it
+      if (value(watchers[i].blocker) > 0) {
+        watchers[j++] = watchers[i++];
+        continue;
+      }
+
+      ClauseRef clause = watchers[i].clause;
+      Lit *lits = clauseLits(clause);
+      if (lits[0] == falseLit) {
+        std::swap(lits[0], lits[1]);
+      }
+      ++i;
+
+      Watcher watcher{ clause, lits[0] };
+      if (value(lits[0]) > 0) {
+        watchers[j++] = watcher;
+        continue;
+      }
+
+      // Look for a new literal to watch
+      bool moved = false;
+      std::uint32_t size = clauseSize(clause);
+      for (std::uint32_t k = 2; k < size; ++k) {
+        if (value(lits[k]) >= 0) {
+          std::swap(lits[1], lits[k]);
+          m_watches[lits[1] ^ 1].push_back(watcher);
+          moved = true;
+          break;
+        }
+      }
+      if (moved) {
+        continue;
+      }
+
+      // Clause is unit or conflicting
+      watchers[j++] = watcher;
+      if (value(lits[0]) < 0) {
+        conflict = clause;
+        m_propagated = m_trail.size();
+        while (i < watchers.size()) {
+          watchers[j++] = watchers[i++];
+        }
+      } else {
+        enqueue(lits[0], clause);
+      }
+    }
+    watchers.resize(j);
+    if (conflict != kNoReason) {
+      break;
+    }
+  }
+  return conflict;
+}
+
+void IncrementalSatSolver::analyze(ClauseRef conflict, std::vector<Lit> &learnt, std::uint32_t &backtrackLevel)
+{
+  // Walk the trail backwards resolving on literals of the current level until one is left
+  learnt.clear();
+  learnt.push_back(0);
+  int pathCount = 0;
+  bool first = true;
+  Lit lit = 0;
+  std::size_t index = m_trail.size();
+
+  do {
+    const Lit *lits = clauseLits(conflict);
+    std::uint32_t size = clauseSize(conflict);
+    for (std::uint32_t k = first ? 0 : 1; k < size; ++k) {
+      std::uint32_t variable = var(lits[k]);
+      if (!m_seen[variable] && m_levels[variable] > 0) {
+        bumpVariable(variable);
+        m_seen[variable] = 1;
+        if (m_levels[variable] >= decisionLevel()) {
+          ++pathCount;
+        } else {
+          learnt.push_back(lits[k]);
+        }
+      }
+    }
+    first = false;
+
+    while (!m_seen[var(m_trail[--index])]) {
+    }
+    lit = m_trail[index];
+    conflict = m_reasons[var(lit)];
+    m_seen[var(lit)] = 0;
+    --pathCount;
+  } while (pathCount > 0);
+  learnt[0] = lit ^ 1;
+
+  // Drop literals implied by the rest of the clause
+  std::vector<Lit> analyzed(learnt.begin() + 1, learnt.end());
+  std::size_t kept = 1;
+  for (std::size_t i = 1; i < learnt.size(); ++i) {
+    if (!redundant(learnt[i])) {
+      learnt[kept++] = learnt[i];
+    }
+  }
+  learnt.resize(kept);
+  for (Lit seen : analyzed) {
+    m_seen[var(seen)] = 0;
+  }
+
+  // Watch the literal of the highest remaining level second
+  backtrackLevel = 0;
+  for (std::size_t i = 1; i < learnt.size(); ++i) {
+    if (m_levels[var(learnt[i])] > backtrackLevel) {
+      backtrackLevel = m_levels[var(learnt[i])];
+      std::swap(learnt[1], learnt[i]);
+    }
+  }
+}
+
+bool IncrementalSatSolver::redundant(Lit lit) const
+{
+  ClauseRef reason = m_reasons[var(lit)];
+  if (reason == kNoReason) {
+    return false;
+  }
+  const Lit *lits = &m_arena[reason + kHeaderWords];
+  for (std::uint32_t k = 1; k < clauseSize(reason); ++k) {
+    std::uint32_t variable = var(lits[k]);
+    if (!m_seen[variable] && m_levels[variable] > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::uint32_t IncrementalSatSolver::computeLbd(const std::vector<Lit> &lits)
+{
+  ++m_stamp;
+  std::uint32_t lbd = 0;
+  for (Lit lit : lits) {
+    std::uint32_t level = m_levels[var(lit)];
+    if (level >= m_levelStamp.size()) {
+      m_levelStamp.resize(level + 1, 0);
+    }
+    if (m_levelStamp[level] != m_stamp) {
+      m_levelStamp[level] = m_stamp;
+      ++lbd;
+    }
+  }
+  return lbd;
+}
+
+void IncrementalSatSolver::cancelUntil(std::uint32_t level)
+{
+  if (decisionLevel() <= level) {
+    return;
+  }
+  for (std::size_t i = m_trail.size(); i > m_trailLimits[level]; --i) {
+    std::uint32_t variable = var(m_trail[i - 1]);
+    m_phases[variable] = m_assigns[variable] > 0;
+    m_assigns[variable] = 0;
+    m_reasons[variable] = kNoReason;
+    heapInsert(variable);
+  }
+  m_trail.resize(m_trailLimits[level]);
+  m_trailLimits.resize(level);
+  m_propagated = m_trail.size();
+}
+
+IncrementalSatSolver::Lit IncrementalSatSolver::pickBranchLit()
+{
+  while (!m_heap.empty()) {
+    std::uint32_t variable = heapPop();
+    if (m_assigns[variable] == 0) {
+      return 2 * variable + (m_phases[variable] ? 0 : 1);
+    }
+  }
+  return UINT32_MAX;
+}
+
+bool IncrementalSatSolver::locked(ClauseRef clause)
+{
+  Lit first = clauseLits(clause)[0];
+  return value(first) > 0 && m_reasons[var(first)] == clause;
+}
+
+void IncrementalSatSolver::reduceLearnts(SolverBudget &budget)
+{
+  // Keep glue clauses and the better half of the rest, ordered by LBD then size
+  std::sort(m_learnts.begin(), m_learnts.end(), [this](ClauseRef a, ClauseRef b) {
+    return clauseLbd(a) != clauseLbd(b) ? clauseLbd(a) < clauseLbd(b) : clauseSize(a) < clauseSize(b);
+  });
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < m_learnts.size(); ++i) {
+    ClauseRef clause = m_learnts[i];
+    if (i < m_learnts.size() / 2 || clauseLbd(clause) <= 2 || locked(clause)) {
+      m_learnts[kept++] = clause;
+    } else {
+      logClause(clauseLits(clause), clauseSize(clause), true);
+      m_arena[clause + 1] |= kDeletedFlag;
+      m_wasted += clauseSize(clause) + kHeaderWords;
+      budget.forget((clauseSize(clause) + kHeaderWords) * sizeof(std::uint32_t));
+    }
+  }
+  m_learnts.resize(kept);
+  detachDeleted();
+}
+
+void IncrementalSatSolver::simplify(SolverBudget &budget)
+{
+  // Delete clauses satisfied at the root, such as those guarded by a retired assumption
+  if (m_trail.size() == m_simplifiedTrail) {
+    return;
+  }
+  m_simplifiedTrail = m_trail.size();
+  for (Lit lit : m_trail) {
+    m_reasons[var(lit)] = kNoReason;
+  }
+
+  auto removeSatisfied = [this, &budget](std::vector<ClauseRef> &clauses) {
+    std::size_t kept = 0;
+    for (ClauseRef clause : clauses) {
+      const Lit *lits = clauseLits(clause);
+      if (std::none_of(lits, lits + clauseSize(clause), [this](Lit lit) { return value(lit) > 0; })) {
+        clauses[kept++] = clause;
+        continue;
+      }
+      if (clauseLearnt(clause)) {
+        budget.forget((clauseSize(clause) + kHeaderWords) * sizeof(std::uint32_t));
+      }
+      logClause(lits, clauseSize(clause), true);
+      m_arena[clause + 1] |= kDeletedFlag;
+      m_wasted += clauseSize(clause) + kHeaderWords;
+    }
+    clauses.resize(kept);
+  };
+  removeSatisfied(m_clauses);
+  removeSatisfied(m_learnts);
+  detachDeleted();
+}
+
+void IncrementalSatSolver::detachDeleted()
+{
+  for (auto &watchers : m_watches) {
+    watchers.erase(std::remove_if(watchers.begin(), watchers.end(), [this](const Watcher &watcher) {
+      return m_arena[watcher.clause + 1] & kDeletedFlag;
+    }),
+      watchers.end());
+  }
+  if (m_wasted > m_arena.size() / 2) {
+    collectGarbage();
+  }
+}
+
+void IncrementalSatSolver::collectGarbage()
+{
+  // Move live clauses to a new arena, remembering where each one went in its old size word
+  std::vector<std::uint32_t> arena;
+  arena.reserve(m_arena.size() - m_wasted);
+  auto relocate = [this, &arena](std::vector<ClauseRef> &clauses) {
+    for (ClauseRef &clause : clauses) {
+      auto moved = static_cast<ClauseRef>(arena.size());
+      std::uint32_t size = clauseSize(clause);
+      arena.insert(arena.end(), m_arena.begin() + clause, m_arena.begin() + clause + kHeaderWords + size);
+      m_arena[clause + 1] |= kDeletedFlag;
+      m_arena[clause] = moved;
+      clause = moved;
+    }
+  };
+
+  relocate(m_clauses);
+  relocate(m_learnts);
+  for (auto &watchers : m_watches) {
+    for (Watcher &watcher : watchers) {
+      watcher.clause = m_arena[watcher.clause];
+    }
+  }
+  for (Lit lit : m_trail) {
+    ClauseRef &reason = m_reasons[var(lit)];
+    if (reason != kNoReason) {
+      reason = m_arena[reason];
+    }
+  }
+  m_arena = std::move(arena);
+  m_wasted = 0;
+}
+
+IncrementalSatSolver::Result IncrementalSatSolver::search(unsigned long long conflictsBeforeRestart, const std::vector<Lit> &assumptions, SolverBudget &budget)
+{
+  unsigned long long conflicts = 0;
+  std::vector<Lit> learnt;
+  while (true) {
+    USP_TRACE(budget, TraceEvent::PROPAGATION_BEGIN, static_cast<int>(decisionLevel()));
+    [[maybe_unused]] const std::size_t assigned = m_trail.size();
+    ClauseRef conflict = propagate();
+    USP_TRACE(budget, TraceEvent::PROPAGATION_END, static_cast<int>(decisionLevel()), static_cast<std::uint32_t>(m_trail.size() - assigned));
+    if (conflict != kNoReason) {
+      ++conflicts;
+      USP_TRACE(budget, TraceEvent::CONFLICT, static_cast<int>(decisionLevel()));
+      if (budget.conflict()) {
+        return Result::UNKNOWN;
+      }
+      if (decisionLevel() == 0) {
+        m_ok = false;
+        logClause(nullptr, 0, false);
+        return Result::UNSATISFIABLE;
+      }
+
+      std::uint32_t backtrackLevel = 0;
+      analyze(conflict, learnt, backtrackLevel);
+      logClause(learnt.data(), learnt.size(), false);
+      USP_TRACE(budget, TraceEvent::LEARN, static_cast<int>(decisionLevel()), static_cast<std::uint32_t>(learnt.size()));
+      USP_TRACE(budget, TraceEvent::BACKTRACK, static_cast<int>(decisionLevel()), backtrackLevel, decisionLevel() - backtrackLevel);
+      cancelUntil(backtrackLevel);
+      if (learnt.size() == 1) {
+        enqueue(learnt[0], kNoReason);
+      } else {
+        ClauseRef clause = allocateClause(learnt, true, computeLbd(learnt));
+        m_learnts.push_back(clause);
+        attachClause(clause);
+        enqueue(learnt[0], clause);
+        if (budget.learn((learnt.size() + kHeaderWords) * sizeof(std::uint32_t))) {
+          return Result::UNKNOWN;
+        }
+      }
+      m_activityIncrement /= kVariableDecay;
+      continue;
+    }
+
+    if (conflicts >= conflictsBeforeRestart) {
+      cancelUntil(0);
+      return Result::UNKNOWN;
+    }
+    if (m_learnts.size() >= m_maxLearnts) {
+      reduceLearnts(budget);
+      m_maxLearnts += kLearntIncrement;
+    }
+
+    // Assumptions take the first decision levels
+    Lit next = UINT32_MAX;
+    while (decisionLevel() < assumptions.size()) {
+      Lit assumption = assumptions[decisionLevel()];
+      if (value(assumption) > 0) {
+        m_trailLimits.push_back(m_trail.size());
+      } else if (value(assumption) < 0) {
+        return Result::UNSATISFIABLE;
+      } else {
+        next = assumption;
+        break;
+      }
+    }
+    if (next == UINT32_MAX) {
+      if (budget.decide()) {
+        return Result::UNKNOWN;
+      }
+      next = pickBranchLit();
+      if (next == UINT32_MAX) {
+        return Result::SATISFIABLE;
+      }
+    }
+    m_trailLimits.push_back(m_trail.size());
+    USP_TRACE(budget, TraceEvent::DECISION, static_cast<int>(decisionLevel()), var(next), next);
+    enqueue(next, kNoReason);
+  }
+}
+
+IncrementalSatSolver::Result IncrementalSatSolver::solve(const std::vector<int> &assumptions, const SolverLimits &limits)
+{
+  SolverBudget budget(limits);
+  Result result = m_ok ? Result::UNKNOWN : Result::UNSATISFIABLE;
+
+  std::vector<Lit> assumed;
+  assumed.reserve(assumptions.size());
+  for (int literal : assumptions) {
+    while (static_cast<int>(m_assigns.size()) < std::abs(literal)) {
+      newVariable();
+    }
+    assumed.push_back(toLit(literal));
+  }
+
+  if (result == Result::UNKNOWN) {
+    simplify(budget);
+    // Learned clauses of earlier solves start over from the initial limit
+    m_maxLearnts = kInitialMaxLearnts;
+    if (m_learnts.size() >= m_maxLearnts) {
+      reduceLearnts(budget);
+    }
+  }
+  for (unsigned long long restart = 0; result == Result::UNKNOWN && !budget.exhausted(); ++restart) {
+    result = search(luby(restart) * kRestartUnit, assumed, budget);
+  }
+
+  if (result == Result::SATISFIABLE) {
+    m_model.resize(m_assigns.size());
+    for (std::size_t i = 0; i < m_assigns.size(); ++i) {
+      m_model[i] = m_assigns[i] > 0;
+    }
+  }
+  cancelUntil(0);
+  m_stats = budget.stats();
+  spdlog::debug("SAT solve: {} decisions, {} conflicts, {} learned clauses", m_stats.decisions, m_stats.conflicts, m_learnts.size());
+  return result;
+}
+
+void IncrementalSatSolver::bumpVariable(std::uint32_t variable)
+{
+  m_activity[variable] += m_activityIncrement;
+  if (m_activity[variable] > 1e100) {
+    for (double &activity : m_activity) {
+      activity *= 1e-100;
+    }
+    m_activityIncrement *= 1e-100;
+  }
+  if (m_heapIndex[variable] != SIZE_MAX) {
+    heapUp(m_heapIndex[variable]);
+  }
+}
+
+bool IncrementalSatSolver::heapLess(std::uint32_t a, std::uint32_t b) const
+{
+  return m_activity[a] > m_activity[b];
+}
+
+void IncrementalSatSolver::heapInsert(std::uint32_t variable)
+{
+  if (m_heapIndex[variable] != SIZE_MAX) {
+    return;
+  }
+  m_heapIndex[variable] = m_heap.size();
+  m_heap.push_back(variable);
+  heapUp(m_heap.size() - 1);
+}
+
+std::uint32_t IncrementalSatSolver::heapPop()
+{
+  std::uint32_t top = m_heap.front();
+  m_heap.front() = m_heap.back();
+  m_heapIndex[m_heap.front()] = 0;
+  m_heap.pop_back();
+  m_heapIndex[top] = SIZE_MAX;
+  if (!m_heap.empty()) {
+    heapDown(0);
+  }
+  return top;
+}
+
+void IncrementalSatSolver::heapUp(std::size_t index)
+{
+  std::uint32_t variable = m_heap[index];
+  while (index > 0 && heapLess(variable, m_heap[(index - 1) / 2])) {
+    m_heap[index] = m_heap[(index - 1) / 2];
+    m_heapIndex[m_heap[index]] = index;
+    index = (index - 1) / 2;
+  }
+  m_heap[index] = variable;
+  m_heapIndex[variable] = index;
+}
+
+void IncrementalSatSolver::heapDown(std::size_t index)
+{
+  std::uint32_t variable = m_heap[index];
+  while (2 * index + 1 < m_heap.size()) {
+    std::size_t child = 2 * index + 1;
+    if (child + 1 < m_heap.size() && heapLess(m_heap[child + 1], m_heap[child])) {
+      ++child;
+    }
+    if (!heapLess(m_heap[child], variable)) {
+      break;
+    }
+    m_heap[index] = m_heap[child];
+    m_heapIndex[m_heap[index]] = index;
+    index = child;
+  }
+  m_heap[index] = variable;
+  m_heapIndex[variable] = index;
+}
+
+}// namespace usp
@@ -0,0 +1,133 @@
+#ifndef SAT_SOLVER_H
+#define SAT_SOLVER_H
+
+#include "solverlimits.h"
+#include "drat.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace usp {
+
+/* Incremental CDCL SAT solver over DIMACS literals.
+ * Variables are numbered from 1 and a literal is +v or -v.
+ * Two watched literals, first-UIP learning with clause minimization,
+ * VSIDS branching with phase saving, Luby restarts and LBD based
+ * learned-clause deletion. Clauses may be added between solves, and
+ * each solve may assume a set of literals, so learned clauses and
+ * heuristics carry over from one solve to the next.
+ * A DratWriter given to setProof receives every learned and deleted
+ * clause, so that an unsatisfiable verdict reached without assumptions
+ * can be checked by DratChecker against the clauses added.
+ */
+class IncrementalSatSolver
+{
+public:
+  enum class Result {
+    SATISFIABLE,
+    UNSATISFIABLE,
+    UNKNOWN
+  };
+
+  // Create a new variable and return it
+  int newVariable();
+  // Return the number of variables
+  int variables() const;
+  // Add a clause. Returns false if the formula is now unsatisfiable
+  bool addClause(const std::vector<int> &literals);
+  // Solve the formula with every literal in assumptions set to true
+  Result solve(const std::vector<int> &assumptions = {}, const SolverLimits &limits = {});
+  // Value of variable in the model of the last satisfiable solve
+  bool modelValue(int variable) const;
+  // Counters of the last solve
+  const SolverStats &stats() const;
+  // Log clauses to proof from now on, or stop logging if nullptr. proof must outlive the solves it logs
+  void setProof(DratWriter *proof);
+
+private:
+  using Lit = std::uint32_t;
+  using ClauseRef = std::uint32_t;
+
+  static constexpr ClauseRef kNoReason = UINT32_MAX;
+  static constexpr ClauseRef kHeaderWords = 2;
+
+  struct Watcher
+  {
+    ClauseRef clause;
+    Lit blocker;
+  };
+
+  static Lit toLit(int literal);
+  static std::uint32_t var(Lit lit);
+
+  // Value of a literal, 1 if true, -1 if false and 0 if unassigned
+  int value(Lit lit) const;
+  std::uint32_t decisionLevel() const;
+
+  // Clauses live in one arena: a size word, a word of flags and LBD, then the literals
+  std::uint32_t clauseSize(ClauseRef clause) const;
+  Lit *clauseLits(ClauseRef clause);
+  bool clauseLearnt(ClauseRef clause) const;
+  std::uint32_t clauseLbd(ClauseRef clause) const;
+  ClauseRef allocateClause(const std::vector<Lit> &lits, bool learnt, std::uint32_t lbd);
+  void attachClause(ClauseRef clause);
+  // Log the addition or deletion of a clause to the proof, if any
+  void logClause(const Lit *lits, std::size_t count, bool deletion);
+
+  void enqueue(Lit lit, ClauseRef reason);
+  ClauseRef propagate();
+  void analyze(ClauseRef conflict, std::vector<Lit> &learnt, std::uint32_t &backtrackLevel);
+  bool redundant(Lit lit) const;
+  std::uint32_t computeLbd(const std::vector<Lit> &lits);
+  void cancelUntil(std::uint32_t level);
+  Lit pickBranchLit();
+  Result search(unsigned long long conflictsBeforeRestart, const std::vector<Lit> &assumptions, SolverBudget &budget);
+  void reduceLearnts(SolverBudget &budget);
+  void simplify(SolverBudget &budget);
+  void detachDeleted();
+  bool locked(ClauseRef clause);
+  void collectGarbage();
+
+  // VSIDS activity and the heap of variables ordered by it
+  void bumpVariable(std::uint32_t variable);
+  void heapInsert(std::uint32_t variable);
+  std::uint32_t heapPop();
+  void heapUp(std::size_t index);
+  void heapDown(std::size_t index);
+  bool heapLess(std::uint32_t a, std::uint32_t b) const;
+
+  bool m_ok{ true };
+  std::vector<std::uint32_t> m_arena;
+  std::size_t m_wasted{ 0 };
+  std::vector<ClauseRef> m_clauses;
+  std::vector<ClauseRef> m_learnts;
+  std::vector<std::vector<Watcher>> m_watches;
+
+  std::vector<std::int8_t> m_assigns;
+  std::vector<std::uint32_t> m_levels;
+  std::vector<ClauseRef> m_reasons;
+  std::vector<bool> m_phases;
+  std::vector<Lit> m_trail;
+  std::vector<std::size_t> m_trailLimits;
+  std::size_t m_propagated{ 0 };
+  std::size_t m_simplifiedTrail{ 0 };
+
+  std::vector<double> m_activity;
+  double m_activityIncrement{ 1.0 };
+  std::vector<std::uint32_t> m_heap;
+  std::vector<std::size_t> m_heapIndex;
+
+  std::vector<char> m_seen;
+  std::vector<std::uint32_t> m_levelStamp;
+  std::uint32_t m_stamp{ 0 };
+  std::size_t m_maxLearnts{ 2000 };
+
+  std::vector<bool> m_model;
+  SolverStats m_stats;
+  DratWriter *m_proof{ nullptr };
+  std::vector<std::uint32_t> m_proofLits;
+};
+
+}// namespace usp
+
+#endif
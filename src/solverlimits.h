@@ -0,0 +1,178 @@
+#ifndef SOLVER_LIMITS_H
+#define SOLVER_LIMITS_H
+
+#include "usp.h"
+#include "solvertrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <utility>
+
+namespace usp {
+
+/* Verdict of a bounded solve. UNKNOWN if a limit was reached
+ * or the solve was cancelled before it was decided.
+ */
+enum class SolverStatus {
+  WEAK,
+  STRONG,
+  UNKNOWN
+};
+
+/* Budget of the failed-literal probing of the DPLL and CDCL solvers.
+ * Once a solve has had minConflicts conflicts, each node probes up to
+ * rows unassigned rows, as long as the probes of the solve stay under
+ * probesPerDecision for every decision made. Puzzles solved before then
+ * never pay for probing. Zero rows disables it.
+ */
+struct LookaheadLimits
+{
+  unsigned int rows{ 8 };
+  unsigned long long minConflicts{ 100 };
+  unsigned long long probesPerDecision{ 8 };
+};
+
+/* Limits on a single solve. A limit of zero is unlimited.
+ * cancel may point to a flag set from another thread to stop the solve.
+ * trace may point to a trace receiving the events of the solve, when built with USP_ENABLE_TRACE.
+ */
+struct SolverLimits
+{
+  std::chrono::milliseconds wallTime{ 0 };
+  unsigned long long maxDecisions{ 0 };
+  unsigned long long maxConflicts{ 0 };
+  std::size_t maxLearnedBytes{ 0 };
+  const std::atomic<bool> *cancel{ nullptr };
+  SolverTrace *trace{ nullptr };
+  LookaheadLimits lookahead;
+};
+
+/* Counters collected during a solve
+ */
+struct SolverStats
+{
+  unsigned long long decisions{ 0 };
+  unsigned long long conflicts{ 0 };
+  unsigned long long learnedClauses{ 0 };
+  std::size_t learnedBytes{ 0 };
+  unsigned long long probes{ 0 };
+  unsigned long long failedLiterals{ 0 };
+};
+
+/* Tracks a solve against its limits. The search calls decide(), conflict()
+ * and learn() as it goes, and unwinds once one of them returns true.
+ * The cancellation flag is a relaxed load, and the clock is only read
+ * every kClockInterval decisions.
+ */
+class SolverBudget
+{
+public:
+  explicit SolverBudget(const SolverLimits &limits = {}) : m_limits(limits), m_start(std::chrono::steady_clock::now())
+  {}
+
+  // Count a decision. Returns true if the search must stop
+  bool decide()
+  {
+    ++m_stats.decisions;
+    if (m_limits.maxDecisions != 0 && m_stats.decisions > m_limits.maxDecisions) {
+      m_exhausted = true;
+    }
+    if (m_limits.cancel != nullptr && m_limits.cancel->load(std::memory_order_relaxed)) {
+      m_exhausted = true;
+    }
+    if (m_limits.wallTime.count() != 0 && m_stats.decisions % kClockInterval == 0 && std::chrono::steady_clock::now() - m_start > m_limits.wallTime) {
+      m_exhausted = true;
+    }
+    return m_exhausted;
+  }
+
+  // Count a conflict. Returns true if the search must stop
+  bool conflict()
+  {
+    ++m_stats.conflicts;
+    if (m_limits.maxConflicts != 0 && m_stats.conflicts > m_limits.maxConflicts) {
+      m_exhausted = true;
+    }
+    return m_exhausted;
+  }
+
+  // Count a learned clause of the given size in bytes. Returns true if the search must stop
+  bool learn(std::size_t bytes)
+  {
+    ++m_stats.learnedClauses;
+    m_stats.learnedBytes += bytes;
+    if (m_limits.maxLearnedBytes != 0 && m_stats.learnedBytes > m_limits.maxLearnedBytes) {
+      m_exhausted = true;
+    }
+    return m_exhausted;
+  }
+
+  // True if the lookahead may probe another candidate
+  bool probeAllowed() const
+  {
+    return m_limits.lookahead.rows != 0 && m_stats.conflicts >= m_limits.lookahead.minConflicts && m_stats.probes < m_limits.lookahead.probesPerDecision * m_stats.decisions;
+  }
+
+  // Count a probe of the lookahead, and whether it failed
+  void probe(bool failed)
+  {
+    ++m_stats.probes;
+    if (failed) {
+      ++m_stats.failedLiterals;
+    }
+  }
+
+  // Rows the lookahead probes at each node
+  unsigned int lookaheadRows() const
+  {
+    return m_limits.lookahead.rows;
+  }
+
+  // Release the memory of a deleted learned clause, which may have been learned by an earlier solve
+  void forget(std::size_t bytes)
+  {
+    m_stats.learnedBytes -= std::min(bytes, m_stats.learnedBytes);
+  }
+
+  // Record an event in the trace of the limits, if any. Called through USP_TRACE
+  void trace(TraceEvent event, int depth, std::uint32_t a = 0, std::uint32_t b = 0, std::uint8_t flags = 0)
+  {
+    if (m_limits.trace != nullptr) {
+      m_limits.trace->record(event, static_cast<std::uint32_t>(depth), a, b, flags);
+    }
+  }
+
+  // True once any limit was reached
+  bool exhausted() const
+  {
+    return m_exhausted;
+  }
+
+  const SolverStats &stats() const
+  {
+    return m_stats;
+  }
+
+private:
+  static constexpr unsigned long long kClockInterval = 16;
+
+  SolverLimits m_limits;
+  std::chrono::steady_clock::time_point m_start;
+  SolverStats m_stats;
+  bool m_exhausted{ false };
+};
+
+/* Result of a bounded solve. witness is set iff status is WEAK.
+ */
+struct SolverResult
+{
+  SolverStatus status{ SolverStatus::UNKNOWN };
+  std::optional<std::pair<Permutation, Permutation>> witness;
+  SolverStats stats;
+};
+
+}// namespace usp
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SOLVER_REGISTRY_H
+#define SOLVER_REGISTRY_H
+
+#include "usp.h"
+#include "solverlimits.h"
+#include "dpllsolver.h"
+#include "cdclsolver.h"
+#include "cnfsolver.h"
+#include "matchingsolver.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace usp {
+
+// A bounded solver of USP weakness
+using SolveFunction = SolverResult (*)(const Usp &, const SolverLimits &);
+
+/* Solver of a --solver name: dpll, cdcl, cnf or matching.
+ * Throws 'std::invalid_argument' for any other name.
+ * The DPLL, CDCL and matching solver headers define their functions without
+ * inline, so this header, like them, may be included in only one translation unit per binary.
+ */
+inline SolveFunction SolverByName(const std::string &name)
+{
+  static const std::map<std::string, SolveFunction> solvers{ { "dpll", &DpllSolve }, { "cdcl", &CdclSolve }, { "cnf", &CnfSolve }, { "matching", &MatchingSolve } };
+  auto solver = solvers.find(name);
+  if (solver == solvers.end()) {
+    throw std::invalid_argument("Unknown solver " + name);
+  }
+  return solver->second;
+}
+
+}// namespace usp
+
+#endif
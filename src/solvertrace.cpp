@@ -0,0 +1,168 @@
+#include "solvertrace.h"
+#include "littleendian.h"
+
+#include <array>
+#include <stdexcept>
+
+namespace usp {
+
+namespace {
+
+  constexpr std::array<char, 4> kTraceMagic{ 'U', 'S', 'P', 'T' };
+  constexpr std::uint32_t kTraceVersion = 1;
+
+  // Read the next little endian T of a binary trace
+  template<typename T>
+  T ReadField(std::istream &in)
+  {
+    std::array<std::uint8_t, sizeof(T)> bytes{};
+    if (!in.read(reinterpret_cast<char *>(bytes.data()), bytes.size())) {
+      throw std::runtime_error("Truncated binary trace");
+    }
+    return ReadLittleEndian<T>(bytes.data());
+  }
+
+  const char *EventName(TraceEvent event)
+  {
+    switch (event) {
+    case TraceEvent::DECISION:
+      return "decision";
+    case TraceEvent::PROPAGATION_BEGIN:
+    case TraceEvent::PROPAGATION_END:
+      return "propagation";
+    case TraceEvent::CONFLICT:
+      return "conflict";
+    case TraceEvent::LEARN:
+      return "learn";
+    case TraceEvent::BACKTRACK:
+      return "backtrack";
+    case TraceEvent::WITNESS:
+      return "witness";
+    }
+    return "unknown";
+  }
+
+}// namespace
+
+SolverTrace::SolverTrace(std::size_t capacity)
+{
+  std::size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  m_records.resize(size);
+  m_mask = size - 1;
+  // Time from after the allocation, which is not part of any solve
+  m_start = std::chrono::steady_clock::now();
+}
+
+std::vector<TraceRecord> SolverTrace::records() const
+{
+  const std::uint64_t kept = m_recorded - dropped();
+  std::vector<TraceRecord> records;
+  records.reserve(static_cast<std::size_t>(kept));
+  for (std::uint64_t i = m_recorded - kept; i < m_recorded; ++i) {
+    records.push_back(m_records[i & m_mask]);
+  }
+  return records;
+}
+
+std::uint64_t SolverTrace::dropped() const
+{
+  return m_recorded > m_records.size() ? m_recorded - m_records.size() : 0;
+}
+
+void SolverTrace::clear()
+{
+  m_recorded = 0;
+  m_start = std::chrono::steady_clock::now();
+}
+
+void SolverTrace::writeChromeJson(std::ostream &out) const
+{
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  const char *separator = "\n";
+  auto write = [&out, &separator](const TraceRecord &record, const char *phase) {
+    out << separator << "{\"name\":\"" << EventName(record.event) << "\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":1,\"ts\":"
+        << record.nanoseconds / 1000 << "." << record.nanoseconds % 1000 / 100 << record.nanoseconds % 100 / 10 << record.nanoseconds % 10;
+    if (phase[0] == 'i') {
+      out << ",\"s\":\"t\"";
+    }
+    out << ",\"args\":{\"depth\":" << record.depth << ",\"a\":" << record.a << ",\"b\":" << record.b << ",\"rho\":" << (record.flags != 0 ? "true" : "false") << "}}";
+    separator = ",\n";
+  };
+
+  // Propagation batches are duration events, the rest are instants on the same track.
+  // Once the ring has wrapped, the first ends may have lost their begins and the last
+  // begins may have no end yet, which viewers would mismatch, so the output stays balanced.
+  const std::vector<TraceRecord> kept = records();
+  std::vector<TraceRecord> open;
+  for (const TraceRecord &record : kept) {
+    if (record.event == TraceEvent::PROPAGATION_BEGIN) {
+      open.push_back(record);
+      write(record, "B");
+    } else if (record.event == TraceEvent::PROPAGATION_END) {
+      if (!open.empty()) {
+        open.pop_back();
+        write(record, "E");
+      }
+    } else {
+      write(record, "i");
+    }
+  }
+  // Close the batches still open at the last record
+  while (!open.empty()) {
+    TraceRecord end = open.back();
+    end.event = TraceEvent::PROPAGATION_END;
+    end.nanoseconds = kept.back().nanoseconds;
+    end.a = 0;
+    write(end, "E");
+    open.pop_back();
+  }
+  out << "\n]}\n";
+}
+
+void SolverTrace::writeBinary(std::ostream &out) const
+{
+  out.write(kTraceMagic.data(), kTraceMagic.size());
+  WriteLittleEndian<std::uint32_t>(out, kTraceVersion);
+  const std::vector<TraceRecord> kept = records();
+  WriteLittleEndian<std::uint64_t>(out, kept.size());
+  WriteLittleEndian<std::uint64_t>(out, dropped());
+  for (const TraceRecord &record : kept) {
+    WriteLittleEndian<std::uint64_t>(out, record.nanoseconds);
+    WriteLittleEndian<std::uint32_t>(out, record.a);
+    WriteLittleEndian<std::uint32_t>(out, record.b);
+    WriteLittleEndian<std::uint16_t>(out, record.depth);
+    WriteLittleEndian<std::uint8_t>(out, static_cast<std::uint8_t>(record.event));
+    WriteLittleEndian<std::uint8_t>(out, record.flags);
+  }
+}
+
+std::vector<TraceRecord> ReadBinaryTrace(std::istream &in)
+{
+  std::array<char, 4> magic{};
+  if (!in.read(magic.data(), magic.size()) || magic != kTraceMagic || ReadField<std::uint32_t>(in) != kTraceVersion) {
+    throw std::runtime_error("Not a binary trace of this version");
+  }
+  const auto count = ReadField<std::uint64_t>(in);
+  ReadField<std::uint64_t>(in);
+  std::vector<TraceRecord> records;
+  for (std::uint64_t i = 0; i < count; ++i) {
+    TraceRecord record{};
+    record.nanoseconds = ReadField<std::uint64_t>(in);
+    record.a = ReadField<std::uint32_t>(in);
+    record.b = ReadField<std::uint32_t>(in);
+    record.depth = ReadField<std::uint16_t>(in);
+    const auto event = ReadField<std::uint8_t>(in);
+    if (event > static_cast<std::uint8_t>(TraceEvent::WITNESS)) {
+      throw std::runtime_error("Unknown event in binary trace");
+    }
+    record.event = static_cast<TraceEvent>(event);
+    record.flags = ReadField<std::uint8_t>(in);
+    records.push_back(record);
+  }
+  return records;
+}
+
+}// namespace usp
@@ -0,0 +1,102 @@
+#ifndef SOLVER_TRACE_H
+#define SOLVER_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/* Solver tracing hooks. The solvers call USP_TRACE at each step of the
+ * search, which records into the SolverTrace of their limits, if any.
+ * Unless built with USP_ENABLE_TRACE (the ENABLE_SOLVER_TRACE option)
+ * the hooks compile to nothing.
+ */
+#if defined(USP_ENABLE_TRACE)
+#define USP_TRACE(budget, ...) (budget).trace(__VA_ARGS__)
+#else
+#define USP_TRACE(budget, ...) static_cast<void>(0)
+#endif
+
+namespace usp {
+
+enum class TraceEvent : std::uint8_t {
+  // Branch on a value: a is the row or variable, b the column or literal
+  DECISION,
+  // A batch of propagation following a decision. At the end a is the number
+  // of literals it assigned, in the CNF solver which keeps a trail
+  PROPAGATION_BEGIN,
+  PROPAGATION_END,
+  CONFLICT,
+  // A learned clause of a literals
+  LEARN,
+  // Search returning from depth to level a, b levels lower
+  BACKTRACK,
+  WITNESS
+};
+
+/* A traced event, 24 bytes. flags is 1 for events on rho and 0 for sigma
+ */
+struct TraceRecord
+{
+  std::uint64_t nanoseconds;
+  std::uint32_t a;
+  std::uint32_t b;
+  std::uint16_t depth;
+  TraceEvent event;
+  std::uint8_t flags;
+};
+
+/* Ring buffer of the most recent trace records. All memory is allocated
+ * up front and recording never allocates; once full, the oldest records
+ * are overwritten. Timestamps are nanoseconds since construction.
+ * A trace belongs to one solve at a time.
+ */
+class SolverTrace
+{
+public:
+  // Keep the last capacity records, rounded up to a power of two
+  explicit SolverTrace(std::size_t capacity = 1 << 20);
+
+  void record(TraceEvent event, std::uint32_t depth, std::uint32_t a = 0, std::uint32_t b = 0, std::uint8_t flags = 0)
+  {
+    TraceRecord &entry = m_records[m_recorded & m_mask];
+    entry.nanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+    entry.a = a;
+    entry.b = b;
+    entry.depth = static_cast<std::uint16_t>(depth);
+    entry.event = event;
+    entry.flags = flags;
+    ++m_recorded;
+  }
+
+  // Return the records kept, oldest first
+  std::vector<TraceRecord> records() const;
+  // Number of records overwritten before they were read
+  std::uint64_t dropped() const;
+  void clear();
+
+  /* Write the records as Chrome trace event JSON, which Perfetto and chrome://tracing load.
+   * Propagation ends whose begin was overwritten are left out, and propagation still
+   * open at the last record is closed there.
+   */
+  void writeChromeJson(std::ostream &out) const;
+  /* Write the records in the compact binary form: magic "USPT", uint32 version,
+   * uint64 count, uint64 dropped, then the fields of each record little endian
+   */
+  void writeBinary(std::ostream &out) const;
+
+private:
+  std::vector<TraceRecord> m_records;
+  std::uint64_t m_mask;
+  std::uint64_t m_recorded{ 0 };
+  std::chrono::steady_clock::time_point m_start;
+};
+
+// Read the records of a binary trace. Throws 'std::runtime_error' if in is not one
+std::vector<TraceRecord> ReadBinaryTrace(std::istream &in);
+
+}// namespace usp
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef STRONG_SEARCH_H
+#define STRONG_SEARCH_H
+
+#include "usp.h"
+#include "uspgenerator.h"
+#include "cnfsolver.h"
+#include "localsearchsolver.h"
+#include "solverlimits.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+namespace usp {
+
+struct StrongSearchOptions
+{
+  // Threads evaluating candidate rows, 0 for every core
+  unsigned int threads{ 0 };
+  // Candidate rows each thread generates for each extension
+  unsigned int candidates{ 64 };
+  // Try the candidates with the most query bits first, instead of in random order
+  bool greedy{ true };
+  // Budget of the local search which rejects weak candidates before the SAT proof
+  LocalSearchOptions localSearch{ 20000, std::chrono::milliseconds(20), 0.1, 8, 0 };
+  // Limits of the SAT proof of each candidate. A candidate that exceeds them is rejected
+  SolverLimits proofLimits{};
+  // Extensions without a strong candidate before the last row is removed again
+  unsigned int patience{ 4 };
+  std::uint64_t seed{ 0 };
+};
+
+/* Counters of a strong USP search
+ */
+struct StrongSearchStats
+{
+  unsigned long long candidates{ 0 };
+  unsigned long long rejectedByLocalSearch{ 0 };
+  unsigned long long rejectedBySolver{ 0 };
+  unsigned long long unknown{ 0 };
+  unsigned long long accepted{ 0 };
+  unsigned long long backtracks{ 0 };
+};
+
+/* Builds strong USPs of width k a row at a time.
+ * For each extension every thread generates its own pool of candidate rows,
+ * from its own generator, ordered greedily by the number of query bits they add.
+ * A candidate is first rejected as weak by a short local search, and
+ * only survivors get a complete proof from the incremental CNF solver.
+ * Every thread keeps its own IncrementalUspSolver in step with the current
+ * puzzle, so proofs reuse what was learned for earlier rows. The first
+ * candidate proven strong is appended, and every session learns that the
+ * grown puzzle is strong. After patience extensions fail in a row the last
+ * row is removed again, so the search can leave dead ends.
+ */
+class StrongUspSearch
+{
+public:
+  StrongUspSearch(unsigned int k, const StrongSearchOptions &options, std::vector<std::vector<int>> rows = {}) : m_k(k), m_options(options), m_rows(std::move(rows)), m_best(m_rows)
+  {
+    unsigned int threads = m_options.threads != 0 ? m_options.threads : std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned int t = 0; t < threads; ++t) {
+      m_sessions.push_back(std::make_unique<IncrementalUspSolver>(puzzle()));
+      m_generators.emplace_back(options.seed, t);
+    }
+  }
+
+  // Try to extend the puzzle by a row. Returns true if a strong row was appended
+  bool step(const std::atomic<bool> *cancel = nullptr)
+  {
+    std::atomic<bool> found{ false };
+    // Session holding the winning candidate appended, if any
+    std::size_t winner = m_sessions.size();
+    std::vector<int> winningRow;
+    std::mutex mutex;
+
+    const unsigned long long tried = m_stats.candidates;
+    auto work = [&](std::size_t t) {
+      IncrementalUspSolver &session = *m_sessions[t];
+      const std::vector<std::vector<int>> candidates = generateCandidates(m_generators[t]);
+      LocalSearchOptions localSearch = m_options.localSearch;
+      SolverLimits limits = m_options.proofLimits;
+      // The proofs of other candidates are moot once one is found strong
+      limits.cancel = &found;
+      for (std::size_t index = 0; index < candidates.size() && !found; ++index) {
+        if (cancel != nullptr && *cancel) {
+          break;
+        }
+        session.appendRow(candidates[index]);
+        localSearch.seed = m_options.localSearch.seed + tried + t * candidates.size() + index;
+        LocalSearch search(session.puzzle(), localSearch);
+        if (search.run()) {
+          session.popRow();
+          std::lock_guard<std::mutex> lock(mutex);
+          ++m_stats.candidates;
+          ++m_stats.rejectedByLocalSearch;
+          continue;
+        }
+
+        SolverResult result = session.solve(limits);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (result.status == SolverStatus::STRONG && !found) {
+          found = true;
+          winner = t;
+          winningRow = candidates[index];
+          ++m_stats.candidates;
+          continue;
+        }
+        // Proofs cancelled by another strong candidate are not counted
+        if (result.status == SolverStatus::WEAK) {
+          ++m_stats.candidates;
+          ++m_stats.rejectedBySolver;
+        } else if (!found) {
+          ++m_stats.candidates;
+          ++m_stats.unknown;
+        }
+        session.popRow();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 1; t < m_sessions.size(); ++t) {
+      threads.emplace_back(work, t);
+    }
+    work(0);
+    for (std::thread &thread : threads) {
+      thread.join();
+    }
+
+    if (!found) {
+      if (++m_failures >= m_options.patience && !m_rows.empty()) {
+        m_rows.pop_back();
+        for (auto &session : m_sessions) {
+          session->popRow();
+        }
+        ++m_stats.backtracks;
+        m_failures = 0;
+      }
+      return false;
+    }
+
+    m_rows.push_back(winningRow);
+    for (std::size_t t = 0; t < m_sessions.size(); ++t) {
+      if (t != winner) {
+        m_sessions[t]->appendRow(winningRow);
+        m_sessions[t]->markStrong();
+      }
+    }
+    ++m_stats.accepted;
+    m_failures = 0;
+    if (m_rows.size() > m_best.size()) {
+      m_best = m_rows;
+    }
+    return true;
+  }
+
+  // Current strong puzzle
+  Usp puzzle() const
+  {
+    return RowsToUsp(m_rows, m_k);
+  }
+
+  // Rows of the current and of the largest strong puzzle found so far
+  const std::vector<std::vector<int>> &rows() const
+  {
+    return m_rows;
+  }
+
+  const std::vector<std::vector<int>> &best() const
+  {
+    return m_best;
+  }
+
+  const StrongSearchStats &stats() const
+  {
+    return m_stats;
+  }
+
+  // Build a (rows.size(), k) Usp from its rows
+  static Usp RowsToUsp(const std::vector<std::vector<int>> &rows, unsigned int k)
+  {
+    std::vector<int> data;
+    data.reserve(rows.size() * k);
+    for (const auto &row : rows) {
+      data.insert(data.end(), row.begin(), row.end());
+    }
+    return Usp(std::move(data), static_cast<unsigned int>(rows.size()), k);
+  }
+
+private:
+  // Called by each thread with its own generator, so only reads the shared state
+  std::vector<std::vector<int>> generateCandidates(UspGenerator &generator) const
+  {
+    std::vector<std::vector<int>> candidates;
+    candidates.reserve(m_options.candidates);
+    for (unsigned int i = 0; i < m_options.candidates; ++i) {
+      candidates.push_back(generator.generateRandomRow(m_k));
+    }
+    if (!m_options.greedy) {
+      return candidates;
+    }
+
+    // Score each candidate by the number of query bits it adds, which forbid pairs of values in a witness
+    Usp scratch = puzzle();
+    const unsigned int n = scratch.rows();
+    std::vector<std::pair<std::size_t, std::size_t>> scores;
+    for (std::size_t i = 0; i < candidates.size(); ++i) {
+      scratch.appendRow(candidates[i]);
+      std::size_t score = 0;
+      for (unsigned int a = 0; a <= n; ++a) {
+        for (unsigned int b = 0; b <= n; ++b) {
+          const std::uint64_t *slab = scratch.slab(a, b);
+          if (a == n || b == n) {
+            for (unsigned int word = 0; word < scratch.slabWords(); ++word) {
+              for (std::uint64_t bits = slab[word]; bits != 0; bits &= bits - 1) {
+                ++score;
+              }
+            }
+          } else {
+            score += (slab[n / 64] >> (n % 64)) & 1;
+          }
+        }
+      }
+      scratch.popRow();
+      scores.emplace_back(score, i);
+    }
+    std::stable_sort(scores.begin(), scores.end(), [](const auto &lhs, const auto &rhs) { return lhs.first > rhs.first; });
+
+    std::vector<std::vector<int>> ordered;
+    ordered.reserve(candidates.size());
+    for (const auto &score : scores) {
+      ordered.push_back(std::move(candidates[score.second]));
+    }
+    return ordered;
+  }
+
+  unsigned int m_k;
+  StrongSearchOptions m_options;
+  std::vector<std::vector<int>> m_rows;
+  std::vector<std::vector<int>> m_best;
+  std::vector<std::unique_ptr<IncrementalUspSolver>> m_sessions;
+  // Candidate generator of each session
+  std::vector<UspGenerator> m_generators;
+  unsigned int m_failures{ 0 };
+  StrongSearchStats m_stats;
+};
+
+/* Write rows of width k to path, as a line "k n" followed by a line of digits per row.
+ * The file is written under a temporary name and renamed, so an interrupted
+ * write leaves the previous checkpoint intact.
+ */
+void SaveCheckpoint(const std::string &path, unsigned int k, const std::vector<std::vector<int>> &rows)
+{
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary);
+    file << k << " " << rows.size() << "\n";
+    for (const auto &row : rows) {
+      for (int element : row) {
+        file << element;
+      }
+      file << "\n";
+    }
+    if (!file) {
+      throw std::runtime_error("Failed to write checkpoint " + temporary);
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    throw std::runtime_error("Failed to replace checkpoint " + path);
+  }
+}
+
+/* Read the rows of a checkpoint of width k written by SaveCheckpoint.
+ * Returns no rows if there is no checkpoint at path, and
+ * throws 'std::runtime_error' if it is malformed or of another width.
+ */
+std::vector<std::vector<int>> LoadCheckpoint(const std::string &path, unsigned int k)
+{
+  std::ifstream file(path);
+  if (!file) {
+    return {};
+  }
+  unsigned int width = 0;
+  std::size_t count = 0;
+  if (!(file >> width >> count) || width != k) {
+    throw std::runtime_error("Checkpoint " + path + " is not of width " + std::to_string(k));
+  }
+  std::vector<std::vector<int>> rows;
+  std::string line;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (!(file >> line) || line.size() != k || line.find_first_not_of("123") != std::string::npos) {
+      throw std::runtime_error("Malformed row in checkpoint " + path);
+    }
+    std::vector<int> row;
+    for (char element : line) {
+      row.push_back(element - '0');
+    }
+    rows.push_back(std::move(row));
+  }
+  return rows;
+}
+
+}// namespace usp
+
+#endif
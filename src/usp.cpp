@@ -1,23 +1,153 @@
 #include "usp.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <stdexcept>
+#include <tuple>
 
 #include <spdlog/spdlog.h>
 
 namespace usp {
 
-Usp::Usp(std::vector<int> data, unsigned int n, unsigned int k) : m_data(n, k, std::move(data)), m_rows(n), m_cols(k)
+PackedCellsView::PackedCellsView(const std::uint8_t *cells, unsigned int n, unsigned int k) : m_cells(cells), m_rows(n), m_cols(k)
+{}
+
+int PackedCellsView::element(unsigned int row, unsigned int col) const
+{
+  std::size_t index = static_cast<std::size_t>(row) * m_cols + col;
+  return (m_cells[index / 4] >> (2 * (index % 4))) & 3;
+}
+
+const std::uint8_t *PackedCellsView::data() const
+{
+  return m_cells;
+}
+
+std::size_t PackedCellsView::bytes() const
+{
+  return PackedBytes(m_rows, m_cols);
+}
+
+unsigned int PackedCellsView::rows() const
+{
+  return m_rows;
+}
+
+unsigned int PackedCellsView::cols() const
+{
+  return m_cols;
+}
+
+std::size_t PackedCellsView::PackedBytes(unsigned int n, unsigned int k)
+{
+  return (static_cast<std::size_t>(n) * k + 3) / 4;
+}
+
+Usp::Usp(std::vector<int> data, unsigned int n, unsigned int k, std::size_t cachedSlabs) : m_cells(PackedCellsView::PackedBytes(n, k), 0), m_rows(n), m_cols(k), m_slabWords((n + 63) / 64)
+{
+  if (data.size() != static_cast<std::size_t>(n) * k || cachedSlabs >= SlabCache::kNoSlot) {
+    throw std::invalid_argument("Usp::Usp");
+  }
+  m_cache.capacity = cachedSlabs;
+  for (unsigned int i = 0; i < n; ++i) {
+    for (unsigned int j = 0; j < k; ++j) {
+      setElement(i, j, data[i * k + j]);
+    }
+  }
+  computeFunction();
+}
+
+Usp::Usp(const PackedCellsView &view, std::size_t cachedSlabs) : m_cells(view.data(), view.data() + view.bytes()), m_rows(view.rows()), m_cols(view.cols()), m_slabWords((view.rows() + 63) / 64)
+{
+  if (cachedSlabs >= SlabCache::kNoSlot) {
+    throw std::invalid_argument("Usp::Usp");
+  }
+  m_cache.capacity = cachedSlabs;
+  for (unsigned int i = 0; i < m_rows; ++i) {
+    for (unsigned int j = 0; j < m_cols; ++j) {
+      if (view.element(i, j) == 0) {
+        throw std::invalid_argument("Usp element must be 1, 2 or 3");
+      }
+    }
+  }
+  computeFunction();
+}
+
+Usp::Usp(const std::int8_t *cells, unsigned int n, unsigned int k, std::size_t cachedSlabs)
 {
-  m_func.reserve(n * n * n);
+  if (cachedSlabs >= SlabCache::kNoSlot) {
+    throw std::invalid_argument("Usp::Usp");
+  }
+  m_cache.capacity = cachedSlabs;
+  assign(cells, n, k);
+}
+
+void Usp::assign(const int *cells, unsigned int n, unsigned int k)
+{
+  assignCells(cells, n, k);
+}
+
+void Usp::assign(const std::int8_t *cells, unsigned int n, unsigned int k)
+{
+  assignCells(cells, n, k);
+}
+
+template<typename Cell>
+void Usp::assignCells(const Cell *cells, unsigned int n, unsigned int k)
+{
+  const std::size_t count = static_cast<std::size_t>(n) * k;
+  if (std::any_of(cells, cells + count, [](Cell value) { return value < 1 || value > 3; })) {
+    throw std::invalid_argument("Usp element must be 1, 2 or 3");
+  }
+  m_rows = n;
+  m_cols = k;
+  m_slabWords = (n + 63) / 64;
+  m_cells.assign(PackedCellsView::PackedBytes(n, k), 0);
+  for (std::size_t index = 0; index < count; ++index) {
+    m_cells[index / 4] = static_cast<std::uint8_t>(m_cells[index / 4] | (static_cast<unsigned int>(cells[index]) << (2 * (index % 4))));
+  }
+  computeFunction();
+}
+
+void Usp::reserve(unsigned int n, unsigned int k)
+{
+  const std::size_t slabWords = (n + 63) / 64;
+  m_cells.reserve(PackedCellsView::PackedBytes(n, k));
+  if (lazy()) {
+    m_cache.slotOf.reserve(static_cast<std::size_t>(n) * n);
+    m_cache.words.reserve(std::min(m_cache.capacity, static_cast<std::size_t>(n) * n) * slabWords);
+  } else {
+    m_func.reserve(static_cast<std::size_t>(n) * n * slabWords);
+  }
+  m_threes.reserve(k * slabWords);
+}
+
+void Usp::setElement(unsigned int row, unsigned int col, int value)
+{
+  if (value < 1 || value > 3) {
+    throw std::invalid_argument("Usp element must be 1, 2 or 3");
+  }
+  std::size_t index = static_cast<std::size_t>(row) * m_cols + col;
+  auto shift = static_cast<unsigned int>(2 * (index % 4));
+  m_cells[index / 4] = static_cast<std::uint8_t>((m_cells[index / 4] & ~(3U << shift)) | (static_cast<unsigned int>(value) << shift));
+}
+
+void Usp::computeFunction()
+{
+  const unsigned int n = m_rows;
+  const unsigned int k = m_cols;
+  if (!lazy()) {
+    m_func.assign(static_cast<std::size_t>(n) * n * m_slabWords, 0);
+  }
 
   auto dataString = [this, n, k]() -> std::string {
     std::stringstream ss;
     ss << "Data: \n";
     for (unsigned int i = 0; i < n; ++i) {
       for (unsigned int j = 0; j < k; ++j) {
-        ss << m_data(i, j) << " ";
+        ss << element(i, j) << " ";
       }
       ss << "\n";
     }
@@ -25,28 +155,259 @@ Usp::Usp(std::vector<int> data, unsigned int n, unsigned int k) : m_data(n, k, s
   };
 
 
-  spdlog::debug(dataString());
-  spdlog::debug("Computing Function:");
+  // Only format the cells when they are logged
+  if (spdlog::default_logger_raw()->should_log(spdlog::level::debug)) {
+    spdlog::debug(dataString());
+    spdlog::debug("Computing Function:");
+  }
+
+  // Rows c with a 3 in each element, so a slab is built a word at a time
+  m_threes.assign(static_cast<std::size_t>(k) * m_slabWords, 0);
+  for (unsigned int c = 0; c < n; ++c) {
+    for (unsigned int col = 0; col < k; ++col) {
+      if (element(c, col) == 3) {
+        m_threes[col * m_slabWords + c / 64] |= std::uint64_t{ 1 } << (c % 64);
+      }
+    }
+  }
+  if (lazy()) {
+    resetCache();
+    return;
+  }
+
+  for (unsigned int a = 0; a < n; ++a) {
+    for (unsigned int b = 0; b < n; ++b) {
+      computeSlab(a, b);
+    }
+  }
+}
+
+void Usp::computeSlab(unsigned int a, unsigned int b)
+{
+  computeSlab(a, b, &m_func[(static_cast<std::size_t>(a) * m_rows + b) * m_slabWords]);
+}
+
+void Usp::computeSlab(unsigned int a, unsigned int b, std::uint64_t *slab) const
+{
+  // (a, b, c) is set if some column has exactly two of a = 1, b = 2, c = 3.
+  // Given a and b, that is c != 3 when both hold and c = 3 when one holds.
+  std::fill(slab, slab + m_slabWords, 0);
+  for (unsigned int col = 0; col < m_cols; ++col) {
+    int matches = (element(a, col) == 1) + (element(b, col) == 2);
+    const std::uint64_t *three = &m_threes[col * m_slabWords];
+    for (unsigned int word = 0; word < m_slabWords; ++word) {
+      slab[word] |= (matches == 2) ? ~three[word] : (matches == 1) ? three[word] : 0;
+    }
+  }
+  // Clear bits past the last row
+  if (m_rows % 64 != 0) {
+    slab[m_slabWords - 1] &= (std::uint64_t{ 1 } << (m_rows % 64)) - 1;
+  }
+}
+
+void Usp::resetCache()
+{
+  const std::size_t slabs = static_cast<std::size_t>(m_rows) * m_rows;
+  // Slots are added as slabs are computed, so an unbounded cache only takes the memory of the slabs used
+  m_cache.words.clear();
+  m_cache.words.reserve(std::min(m_cache.capacity, slabs) * m_slabWords);
+  m_cache.slotOf.assign(slabs, SlabCache::kNoSlot);
+  m_cache.scratch.resize(m_slabWords);
+  m_cache.owner.clear();
+  m_cache.referenced.clear();
+  m_cache.hand = 0;
+}
+
+const std::uint64_t *Usp::cachedSlab(unsigned int a, unsigned int b) const
+{
+  const std::size_t index = static_cast<std::size_t>(a) * m_rows + b;
+  std::uint32_t slot = m_cache.slotOf[index];
+  if (slot == SlabCache::kNoSlot) {
+    if (m_cache.owner.size() < std::min(m_cache.capacity, static_cast<std::size_t>(m_rows) * m_rows)) {
+      slot = static_cast<std::uint32_t>(m_cache.owner.size());
+      m_cache.words.resize(m_cache.words.size() + m_slabWords);
+      m_cache.owner.push_back(index);
+      m_cache.referenced.push_back(0);
+    } else {
+      /* Advance the clock hand by one slot. A slot accessed since the hand last
+       * passed it gets a second chance and the slab is computed into the scratch
+       * slab without being cached, so a scan over more slabs than the cache holds
+       * keeps hitting the slabs already cached rather than evicting each of them
+       * just before it is needed again.
+       */
+      const std::size_t victim = m_cache.hand;
+      m_cache.hand = (m_cache.hand + 1) % m_cache.owner.size();
+      if (m_cache.referenced[victim] != 0) {
+        m_cache.referenced[victim] = 0;
+        computeSlab(a, b, m_cache.scratch.data());
+        ++m_cache.computed;
+        return m_cache.scratch.data();
+      }
+      slot = static_cast<std::uint32_t>(victim);
+      m_cache.slotOf[m_cache.owner[slot]] = SlabCache::kNoSlot;
+      m_cache.owner[slot] = index;
+    }
+    m_cache.slotOf[index] = slot;
+    computeSlab(a, b, &m_cache.words[static_cast<std::size_t>(slot) * m_slabWords]);
+    ++m_cache.computed;
+  }
+  m_cache.referenced[slot] = 1;
+  return &m_cache.words[static_cast<std::size_t>(slot) * m_slabWords];
+}
+
+void Usp::appendRow(const std::vector<int> &row)
+{
+  if (row.size() != m_cols || std::any_of(row.begin(), row.end(), [](int value) { return value < 1 || value > 3; })) {
+    throw std::invalid_argument("Usp::appendRow");
+  }
+  const unsigned int n = m_rows;
+  const unsigned int slabWords = m_slabWords;
+  m_cells.resize(PackedCellsView::PackedBytes(n + 1, m_cols), 0);
+  for (unsigned int col = 0; col < m_cols; ++col) {
+    setElement(n, col, row[col]);
+  }
+  m_rows = n + 1;
+  m_slabWords = (m_rows + 63) / 64;
+
+  // Move the threes and every old slab to the new layout. Bits of old rows are unchanged.
+  std::vector<std::uint64_t> threes(static_cast<std::size_t>(m_cols) * m_slabWords, 0);
+  for (unsigned int col = 0; col < m_cols; ++col) {
+    std::copy_n(&m_threes[col * slabWords], slabWords, &threes[col * m_slabWords]);
+    if (row[col] == 3) {
+      threes[col * m_slabWords + n / 64] |= std::uint64_t{ 1 } << (n % 64);
+    }
+  }
+  m_threes = std::move(threes);
+  if (lazy()) {
+    resetCache();
+    return;
+  }
 
-  // Compute function
+  std::vector<std::uint64_t> func(static_cast<std::size_t>(m_rows) * m_rows * m_slabWords, 0);
   for (unsigned int a = 0; a < n; ++a) {
     for (unsigned int b = 0; b < n; ++b) {
-      for (unsigned int c = 0; c < n; ++c) {
-        m_func.push_back(false);
-        for (unsigned int element = 0; element < k; ++element) {
-          if ((m_data(a, element) == 1) + (m_data(b, element) == 2) + (m_data(c, element) == 3) == 2) {
-            m_func.back() = true;
-          }
+      std::uint64_t *slab = &func[(static_cast<std::size_t>(a) * m_rows + b) * m_slabWords];
+      std::copy_n(&m_func[(static_cast<std::size_t>(a) * n + b) * slabWords], slabWords, slab);
+      // Only the bit of the new row c = n is left to compute
+      for (unsigned int col = 0; col < m_cols; ++col) {
+        int matches = (element(a, col) == 1) + (element(b, col) == 2) + (row[col] == 3);
+        if (matches == 2) {
+          slab[n / 64] |= std::uint64_t{ 1 } << (n % 64);
+          break;
         }
-        spdlog::debug("({},{},{}): {}", a, b, c, m_func.back());
       }
     }
   }
+  m_func = std::move(func);
+
+  // Slabs with the new row as a or b are computed in full
+  for (unsigned int other = 0; other < m_rows; ++other) {
+    computeSlab(n, other);
+    if (other != n) {
+      computeSlab(other, n);
+    }
+  }
+}
+
+void Usp::popRow()
+{
+  if (m_rows == 0) {
+    throw std::out_of_range("Usp::popRow");
+  }
+  const unsigned int n = m_rows - 1;
+  const unsigned int slabWords = m_slabWords;
+  m_cells.resize(PackedCellsView::PackedBytes(n, m_cols));
+  if ((static_cast<std::size_t>(n) * m_cols) % 4 != 0) {
+    m_cells.back() &= static_cast<std::uint8_t>((1U << (2 * ((static_cast<std::size_t>(n) * m_cols) % 4))) - 1);
+  }
+  m_rows = n;
+  m_slabWords = (n + 63) / 64;
+
+  std::vector<std::uint64_t> threes(static_cast<std::size_t>(m_cols) * m_slabWords, 0);
+  for (unsigned int col = 0; col < m_cols; ++col) {
+    std::copy_n(&m_threes[col * slabWords], m_slabWords, &threes[col * m_slabWords]);
+  }
+  m_threes = std::move(threes);
+
+  // Clear the bits of the removed row, unless it was the only row of the last word
+  const std::uint64_t mask = (std::uint64_t{ 1 } << (n % 64)) - 1;
+  if (n % 64 != 0) {
+    for (unsigned int col = 0; col < m_cols; ++col) {
+      m_threes[col * m_slabWords + n / 64] &= mask;
+    }
+  }
+  if (lazy()) {
+    resetCache();
+    return;
+  }
+
+  std::vector<std::uint64_t> func(static_cast<std::size_t>(n) * n * m_slabWords, 0);
+  for (unsigned int a = 0; a < n; ++a) {
+    for (unsigned int b = 0; b < n; ++b) {
+      std::copy_n(&m_func[(static_cast<std::size_t>(a) * (n + 1) + b) * slabWords], m_slabWords, &func[(static_cast<std::size_t>(a) * n + b) * m_slabWords]);
+    }
+  }
+  m_func = std::move(func);
+  if (n % 64 != 0) {
+    for (std::size_t slab = 0; slab < static_cast<std::size_t>(n) * n; ++slab) {
+      m_func[slab * m_slabWords + n / 64] &= mask;
+    }
+  }
 }
 
 bool Usp::query(unsigned int a, unsigned int b, unsigned int c) const
 {
-  return m_func.at((a * m_rows * m_rows) + (b * m_rows) + c);
+  if (c >= m_rows) {
+    throw std::out_of_range("Usp::query");
+  }
+  if (lazy()) {
+    if (a >= m_rows || b >= m_rows) {
+      throw std::out_of_range("Usp::query");
+    }
+    return (cachedSlab(a, b)[c / 64] >> (c % 64)) & 1;
+  }
+  return (m_func.at((static_cast<std::size_t>(a) * m_rows + b) * m_slabWords + c / 64) >> (c % 64)) & 1;
+}
+
+const std::uint64_t *Usp::slab(unsigned int a, unsigned int b) const
+{
+  if (lazy()) {
+    return cachedSlab(a, b);
+  }
+  return &m_func[(static_cast<std::size_t>(a) * m_rows + b) * m_slabWords];
+}
+
+unsigned int Usp::slabWords() const
+{
+  return m_slabWords;
+}
+
+const std::uint64_t *Usp::tensor() const
+{
+  if (lazy()) {
+    throw std::logic_error("Usp::tensor");
+  }
+  return m_func.data();
+}
+
+bool Usp::lazy() const
+{
+  return m_cache.capacity != 0;
+}
+
+std::size_t Usp::slabsComputed() const
+{
+  return m_cache.computed;
+}
+
+int Usp::element(unsigned int row, unsigned int col) const
+{
+  return cells().element(row, col);
+}
+
+PackedCellsView Usp::cells() const
+{
+  return PackedCellsView(m_cells.data(), m_rows, m_cols);
 }
 
 unsigned int Usp::rows() const
@@ -104,7 +465,14 @@ SatClause::State SatClause::evaluate(const std::unique_ptr<Permutation> &rho, co
   }
   // Unit clause
   else if (assignmentCounter == m_variables.size() - 1) {
-    (lastUnassigned.m_rho) ? rho->assign(lastUnassigned.m_position.first, lastUnassigned.m_position.second, false, depth) : sigma->assign(lastUnassigned.m_position.first, lastUnassigned.m_position.second, false, depth);
+    // The remaining variables are the antecedents of the propagated assignment
+    std::vector<SatVariable> antecedents;
+    for (auto &variable : m_variables) {
+      if (!(variable == lastUnassigned)) {
+        antecedents.push_back(variable);
+      }
+    }
+    (lastUnassigned.m_rho) ? rho->assign(lastUnassigned.m_position.first, lastUnassigned.m_position.second, false, depth, antecedents) : sigma->assign(lastUnassigned.m_position.first, lastUnassigned.m_position.second, false, depth, antecedents);
 
     // Set to satisfied, but return unit to tell algorithm to loop propagation again.
     m_state = State::SATISFIED;
@@ -122,7 +490,7 @@ bool operator==(const SatVariable &lhs, const SatVariable &rhs)
 
 bool operator<(const SatVariable &lhs, const SatVariable &rhs)
 {
-  return lhs.m_position < rhs.m_position;
+  return std::tie(lhs.m_rho, lhs.m_position, lhs.m_positive) < std::tie(rhs.m_rho, rhs.m_position, rhs.m_positive);
 }
 
 bool operator==(const SatClause &lhs, const SatClause &rhs)
@@ -222,6 +590,16 @@ std::optional<unsigned int> Permutation::assignment(unsigned int row) const
   return std::nullopt;
 }
 
+std::vector<unsigned int> Permutation::assignments() const
+{
+  std::vector<unsigned int> columns;
+  columns.reserve(m_size);
+  for (unsigned int i = 0; i < m_size; ++i) {
+    columns.push_back(assignment(i).value());
+  }
+  return columns;
+}
+
 std::vector<unsigned int> Permutation::possibleAssignments(unsigned int row) const
 {
   std::vector<unsigned int> assignments;
@@ -233,7 +611,18 @@ std::vector<unsigned int> Permutation::possibleAssignments(unsigned int row) con
   return assignments;
 }
 
-std::vector<SatVariable> Permutation::contradictionAntecedents(int decision_level) const
+unsigned int Permutation::candidateCount(unsigned int row) const
+{
+  unsigned int count = 0;
+  for (unsigned int i = 0; i < m_size; ++i) {
+    if (!m_data(row, i).m_assigned) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+std::vector<SatVariable> Permutation::contradictionAntecedents() const
 {
   std::vector<SatVariable> antecedents;
   for (unsigned int i = 0; i < m_size; ++i) {
@@ -246,13 +635,11 @@ std::vector<SatVariable> Permutation::contradictionAntecedents(int decision_leve
       }
     }
     if (!flag) {
-      // Contradictary row, add all antecedents at decision_level
+      // Contradictary row, add the antecedents of every node. Nodes removed at
+      // earlier decision levels are part of the conflict as well.
       for (unsigned int j = 0; j < m_size; ++j) {
-        const Node &node = m_data(i, j);
-        if (node.m_decision_level == decision_level) {
-          std::vector<SatVariable> tempAntecedents = this->antecedents({ i, j });
-          antecedents.insert(std::end(antecedents), std::begin(tempAntecedents), std::end(tempAntecedents));
-        }
+        const std::vector<SatVariable> &nodeAntecedents = m_data(i, j).m_antecedents;
+        antecedents.insert(std::end(antecedents), std::begin(nodeAntecedents), std::end(nodeAntecedents));
       }
     }
   }
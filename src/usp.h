@@ -1,6 +1,8 @@
 #ifndef USP_H
 #define USP_H
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <set>
@@ -128,10 +130,14 @@ public:
   std::optional<unsigned int> nextAssignment() const;
   // Return which column is assigned by row
   std::optional<unsigned int> assignment(unsigned int row) const;
-  // Return all antecedents of every contradictary row at decision_level
-  std::vector<SatVariable> contradictionAntecedents(int decision_level) const;
+  // Return the column assigned by every row. Throws 'std::bad_optional_access' if a row is unassigned
+  std::vector<unsigned int> assignments() const;
+  // Return all antecedents of every contradictary row
+  std::vector<SatVariable> contradictionAntecedents() const;
   // Return all possible assignments by row
   std::vector<unsigned int> possibleAssignments(unsigned int row) const;
+  // Return the number of unassigned nodes in row
+  unsigned int candidateCount(unsigned int row) const;
   // Assign element (y, x) to value
   void assign(unsigned int y, unsigned int x, bool value, int decision_level = -1, std::vector<SatVariable> antecedents = {});
   // Assigns element (y, x) to true. Performs simple unit propagation
@@ -152,24 +158,142 @@ private:
   unsigned int m_size{ 0 };
 };
 
+/* Non-owning view of the cells of a (n, k) puzzle packed two bits per cell.
+ * Cell (i, j) is stored at bits 2 * (i * k + j) of the byte array, lowest bits first,
+ * which is the layout of Usp and of puzzles in a corpus file.
+ */
+class PackedCellsView
+{
+public:
+  PackedCellsView(const std::uint8_t *cells, unsigned int n, unsigned int k);
+
+  // Return the element (1, 2 or 3) of row in column col
+  int element(unsigned int row, unsigned int col) const;
+  // Return the packed cells, bytes() bytes long
+  const std::uint8_t *data() const;
+  std::size_t bytes() const;
+
+  unsigned int rows() const;
+  unsigned int cols() const;
+
+  // Number of bytes of n * k packed cells
+  static std::size_t PackedBytes(unsigned int n, unsigned int k);
+
+private:
+  const std::uint8_t *m_cells;
+  unsigned int m_rows;
+  unsigned int m_cols;
+};
+
 /* Usp of size (n, k)
+ * The query function is stored as a bit-packed tensor: for every pair
+ * (a, b) a slab of slabWords() 64-bit words holds query(a, b, c) at bit c.
  */
 class Usp
 {
 public:
-  Usp(std::vector<int> data, unsigned int n, unsigned int k);
+  // cachedSlabs of a lazy puzzle that keeps every slab it computes
+  static constexpr std::size_t kCacheEverySlab = 0xfffffffe;
+
+  /* Throws 'std::invalid_argument' if an element is not 1, 2 or 3.
+   * A cachedSlabs above 0 makes the puzzle lazy: rather than computing the
+   * whole query tensor up front, each slab is computed on first access and
+   * kept in a cache of cachedSlabs slabs, evicting in clock order once full.
+   * kCacheEverySlab never evicts, so memory only grows with the slabs used
+   * and a solver that rescans most slabs runs about as fast as on the eager
+   * tensor; a smaller cache trades recomputing slabs for memory.
+   * A lazy puzzle has no tensor(), a slab() pointer of it is only valid until
+   * the next query() or slab() call, and it must not be shared between threads:
+   * the multithreaded solvers throw 'std::invalid_argument' for one.
+   */
+  Usp(std::vector<int> data, unsigned int n, unsigned int k, std::size_t cachedSlabs = 0);
+  /* Copy the packed cells of view into a puzzle that owns them, and build the tensor unless
+   * cachedSlabs makes it lazy. Only reading the view is zero copy: the puzzle is not.
+   * Throws 'std::invalid_argument' if a cell is 0
+   */
+  explicit Usp(const PackedCellsView &view, std::size_t cachedSlabs = 0);
+  /* Pack the n * k cells straight from a byte buffer, such as a NumPy int8 array,
+   * with no intermediate vector. The puzzle owns its packed cells and does not
+   * refer to cells afterwards. Throws 'std::invalid_argument' if an element is not 1, 2 or 3
+   */
+  Usp(const std::int8_t *cells, unsigned int n, unsigned int k, std::size_t cachedSlabs = 0);
+
+  // Add a row of k elements to the puzzle, computing only the query bits that involve it
+  void appendRow(const std::vector<int> &row);
+  // Remove the last row of the puzzle
+  void popRow();
+  /* Replace the puzzle with the n * k cells, reusing the storage of this one.
+   * Throws 'std::invalid_argument' if an element is not 1, 2 or 3, leaving the puzzle unchanged
+   */
+  void assign(const int *cells, unsigned int n, unsigned int k);
+  void assign(const std::int8_t *cells, unsigned int n, unsigned int k);
+  // Reserve storage for puzzles of up to n rows and k columns, so assigning them does not allocate
+  void reserve(unsigned int n, unsigned int k);
 
   // Query a triple of rows to determine if they satisfy the USP condition
   bool query(unsigned int a, unsigned int b, unsigned int c) const;
+  // Return the slab of query(a, b, c) over all c
+  const std::uint64_t *slab(unsigned int a, unsigned int b) const;
+  // Return the number of words in each slab
+  unsigned int slabWords() const;
+  // Return the whole packed tensor, slab (a, b) begins at word (a * n + b) * slabWords(). Throws 'std::logic_error' if lazy
+  const std::uint64_t *tensor() const;
+  // True if slabs are computed on first access
+  bool lazy() const;
+  // Number of slabs a lazy puzzle has computed, counting those computed again after eviction
+  std::size_t slabsComputed() const;
+  // Return the element (1, 2 or 3) of row in column col
+  int element(unsigned int row, unsigned int col) const;
+  // Return a view of the packed cells
+  PackedCellsView cells() const;
 
   unsigned int rows() const;
   unsigned int cols() const;
 
 private:
-  Matrix<int> m_data;
-  std::vector<bool> m_func;
+  // Pack and validate the cells of assign()
+  template<typename Cell>
+  void assignCells(const Cell *cells, unsigned int n, unsigned int k);
+  // Compute the query tensor from the cells
+  void computeFunction();
+  // Compute slab (a, b) from m_threes into m_func
+  void computeSlab(unsigned int a, unsigned int b);
+  // Compute slab (a, b) from m_threes into slab
+  void computeSlab(unsigned int a, unsigned int b, std::uint64_t *slab) const;
+  // Empty the slab cache of a lazy puzzle, sizing it for the current rows
+  void resetCache();
+  // Return slab (a, b) of a lazy puzzle, computing it if it is not cached
+  const std::uint64_t *cachedSlab(unsigned int a, unsigned int b) const;
+  void setElement(unsigned int row, unsigned int col, int value);
+
+  // Two bits per cell, laid out as in PackedCellsView
+  std::vector<std::uint8_t> m_cells;
+  std::vector<std::uint64_t> m_func;
+  // Rows with a 3 in each element, slabWords() words per element
+  std::vector<std::uint64_t> m_threes;
   unsigned int m_rows{ 0 };
   unsigned int m_cols{ 0 };
+  unsigned int m_slabWords{ 0 };
+
+  // Slabs of a lazy puzzle, which are not part of its value
+  struct SlabCache
+  {
+    // Slot of each slab, or kNoSlot if it is not cached
+    static constexpr std::uint32_t kNoSlot = 0xffffffff;
+
+    std::size_t capacity{ 0 };
+    // slabWords() words per slot
+    std::vector<std::uint64_t> words;
+    std::vector<std::uint32_t> slotOf;
+    // Slab held by each slot in use, and whether it was accessed since the clock hand passed it
+    std::vector<std::size_t> owner;
+    std::vector<std::uint8_t> referenced;
+    // Slab computed without being cached
+    std::vector<std::uint64_t> scratch;
+    std::size_t hand{ 0 };
+    std::size_t computed{ 0 };
+  };
+  mutable SlabCache m_cache;
 };
 
 
@@ -0,0 +1,160 @@
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+#include <docopt/docopt.h>
+
+#include "usp.h"
+#include "uspgenerator.h"
+#include "solverregistry.h"
+#include "perfcounters.h"
+#include "allocationcounter.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static constexpr auto USAGE =
+  R"(Usage:
+  uspbench <k>... [--max-n=<n>] [--trials=<count>] [--solver=<name>] [--timeout=<ms>] [--seed=<s>] [--probe-rows=<count>] [--session]
+  uspbench (-h | --help)
+
+Benchmarks a solver on random (n, k) puzzles for n from 1 to the given
+maximum and each width k, like runsolver, but measuring every solve with
+hardware performance counters and counting its heap allocations.
+Outputs the mean of each counter per solve into "counters.csv" in the
+same directory. Counters the system does not provide, for instance when
+perf_event_paranoid forbids them, are left empty.
+
+Options:
+  -h --help           Show this screen.
+  --max-n=<n>         Largest number of rows [default: 20].
+  --trials=<count>    Random puzzles solved for each (n, k) [default: 100].
+  --solver=<name>     Solver to measure, dpll, cdcl, cnf or matching [default: cdcl].
+  --timeout=<ms>      Wall time limit of each solve in milliseconds, 0 for none [default: 10000].
+  --seed=<s>          Seed of the random puzzles [default: 0].
+  --probe-rows=<count> Rows probed by the dpll and cdcl lookahead at each node, 0 for none [default: 8].
+  --session           Solve every puzzle on one matching solver session, refilling one puzzle in place.
+)";
+
+int main(int argc, const char **argv)
+{
+  std::map<std::string, docopt::value> args = docopt::docopt(USAGE,
+    { std::next(argv), std::next(argv, argc) },
+    true,// show help if requested
+    "USP");// version string
+
+  spdlog::set_level(spdlog::level::info);
+
+  const std::string solverName = args["--solver"].asString();
+  usp::SolveFunction solve = nullptr;
+  try {
+    solve = usp::SolverByName(solverName);
+  } catch (const std::invalid_argument &error) {
+    spdlog::error("{}", error.what());
+    return 1;
+  }
+  const auto maxN = static_cast<unsigned int>(args["--max-n"].asLong());
+  const auto trials = static_cast<unsigned int>(args["--trials"].asLong());
+  usp::SolverLimits limits;
+  limits.wallTime = std::chrono::milliseconds(args["--timeout"].asLong());
+  limits.lookahead.rows = static_cast<unsigned int>(args["--probe-rows"].asLong());
+
+  usp::PerfCounters counters;
+  for (std::size_t c = 0; c < usp::kPerfCounters; ++c) {
+    const auto counter = static_cast<usp::PerfCounter>(c);
+    if (!counters.available(counter)) {
+      spdlog::warn("{} counter unavailable, it is left empty", usp::PerfCounters::Name(counter));
+    }
+  }
+
+  std::ofstream csvFile("counters.csv");
+  csvFile << "Depth,Width,Mean(ms),Timeouts";
+  for (std::size_t c = 0; c < usp::kPerfCounters; ++c) {
+    csvFile << "," << usp::PerfCounters::Name(static_cast<usp::PerfCounter>(c));
+  }
+  csvFile << ",IPC,Allocations,AllocatedBytes\n";
+
+  std::optional<usp::SolverSession> session;
+  usp::Usp sessionPuzzle({}, 0, 0);
+  usp::UspGenerator generator(static_cast<std::uint64_t>(args["--seed"].asLong()));
+  if (args["--session"].asBool()) {
+    if (solverName != "matching") {
+      spdlog::error("A solver session runs the matching solver, use --solver=matching");
+      return 1;
+    }
+    session.emplace(maxN, limits);
+    unsigned int maxK = 0;
+    for (const std::string &width : args["<k>"].asStringList()) {
+      maxK = std::max(maxK, static_cast<unsigned int>(std::stoul(width)));
+    }
+    sessionPuzzle.reserve(maxN, maxK);
+    generator.reserve(maxN, maxK);
+  }
+
+  for (unsigned int n = 1; n <= maxN; ++n) {
+    for (const std::string &width : args["<k>"].asStringList()) {
+      const auto k = static_cast<unsigned int>(std::stoul(width));
+      double seconds = 0;
+      unsigned int timeouts = 0;
+      std::array<double, usp::kPerfCounters> totals{};
+      std::array<bool, usp::kPerfCounters> measured{};
+      unsigned long long allocations = 0;
+      unsigned long long allocatedBytes = 0;
+
+      for (unsigned int trial = 0; trial < trials; ++trial) {
+        // Generated outside the measured interval, but its allocations are counted with a session
+        const unsigned long long allocationsBefore = usp::AllocationCount();
+        const unsigned long long bytesBefore = usp::AllocatedBytes();
+        std::optional<usp::Usp> fresh;
+        if (session.has_value()) {
+          generator.generateRandomPuzzle(sessionPuzzle, n, k);
+        } else {
+          fresh.emplace(generator.generateRandomPuzzle(n, k));
+        }
+        const usp::Usp &puzzle = fresh.has_value() ? *fresh : sessionPuzzle;
+        const unsigned long long freshAllocations = session.has_value() ? 0 : usp::AllocationCount() - allocationsBefore;
+        const unsigned long long freshBytes = session.has_value() ? 0 : usp::AllocatedBytes() - bytesBefore;
+
+        auto startTime = std::chrono::steady_clock::now();
+        counters.start();
+        const usp::SolverStatus status = session.has_value() ? session->solve(puzzle) : solve(puzzle, limits).status;
+        const usp::PerfSample sample = counters.stop();
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+        allocations += usp::AllocationCount() - allocationsBefore - freshAllocations;
+        allocatedBytes += usp::AllocatedBytes() - bytesBefore - freshBytes;
+        seconds += duration.count();
+        timeouts += status == usp::SolverStatus::UNKNOWN;
+        for (std::size_t c = 0; c < usp::kPerfCounters; ++c) {
+          if (sample.values[c].has_value()) {
+            totals[c] += static_cast<double>(*sample.values[c]);
+            measured[c] = true;
+          }
+        }
+      }
+
+      const double solves = trials;
+      csvFile << n << "," << k << "," << seconds * 1000 / solves << "," << timeouts;
+      for (std::size_t c = 0; c < usp::kPerfCounters; ++c) {
+        csvFile << ",";
+        if (measured[c]) {
+          csvFile << totals[c] / solves;
+        }
+      }
+      const auto cycles = static_cast<std::size_t>(usp::PerfCounter::CYCLES);
+      const auto instructions = static_cast<std::size_t>(usp::PerfCounter::INSTRUCTIONS);
+      csvFile << ",";
+      if (measured[cycles] && measured[instructions] && totals[cycles] > 0) {
+        csvFile << totals[instructions] / totals[cycles];
+      }
+      csvFile << "," << static_cast<double>(allocations) / solves << "," << static_cast<double>(allocatedBytes) / solves << std::endl;
+    }
+  }
+  csvFile.close();
+}
@@ -0,0 +1,91 @@
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+#include <docopt/docopt.h>
+
+#include "drat.h"
+#include "dimacs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+static constexpr auto USAGE =
+  R"(Usage:
+  uspcheck <cnf> <proof> [--core=<file>]
+  uspcheck (-h | --help)
+
+Checks a binary DRAT proof that the DIMACS CNF formula is unsatisfiable,
+such as a strong puzzle written by "runsolver export" and its proof from
+"runsolver prove". The proof is checked backwards from its conflict, so
+only the lemmas the refutation depends on are checked. Exits with 0 if
+the proof is verified and 1 otherwise.
+
+Options:
+  -h --help           Show this screen.
+  --core=<file>       Write the clauses of the formula the refutation uses as a DIMACS formula.
+)";
+
+int main(int argc, const char **argv)
+{
+  std::map<std::string, docopt::value> args = docopt::docopt(USAGE,
+    { std::next(argv), std::next(argv, argc) },
+    true,// show help if requested
+    "USP");// version string
+
+  spdlog::set_level(spdlog::level::info);
+
+  usp::DratChecker checker;
+  auto startTime = std::chrono::steady_clock::now();
+  std::ifstream cnfFile(args["<cnf>"].asString());
+  std::ifstream proofFile(args["<proof>"].asString(), std::ios::binary);
+  if (!cnfFile || !proofFile) {
+    spdlog::error("Failed to open the formula or the proof");
+    return 1;
+  }
+  try {
+    usp::LoadDimacs(cnfFile, checker);
+    checker.readProof(proofFile);
+  } catch (const std::runtime_error &error) {
+    spdlog::error("{}", error.what());
+    return 1;
+  }
+  std::chrono::duration<double> readTime = std::chrono::steady_clock::now() - startTime;
+
+  startTime = std::chrono::steady_clock::now();
+  const usp::DratResult result = checker.check();
+  std::chrono::duration<double> checkTime = std::chrono::steady_clock::now() - startTime;
+  spdlog::info("Read in {:.3f}ms, checked in {:.3f}ms", readTime.count() * 1000, checkTime.count() * 1000);
+  if (!result.verified) {
+    if (!result.conflict) {
+      spdlog::error("Proof does not derive a conflict");
+    } else {
+      spdlog::error("Lemma at proof step {} is not a RUP consequence", result.failedStep);
+    }
+    return 1;
+  }
+  spdlog::info("Verified: {} of {} lemmas checked, {} core clauses, {} deletions ignored", result.checkedLemmas, result.lemmas, result.coreClauses, result.ignoredDeletions);
+
+  if (args["--core"]) {
+    const auto core = checker.core();
+    std::ofstream coreFile(args["--core"].asString());
+    int variables = 0;
+    for (const auto &clause : core) {
+      for (int literal : clause) {
+        variables = std::max(variables, std::abs(literal));
+      }
+    }
+    coreFile << "p cnf " << variables << " " << core.size() << "\n";
+    for (const auto &clause : core) {
+      for (int literal : clause) {
+        coreFile << literal << " ";
+      }
+      coreFile << "0\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,310 @@
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+#include <docopt/docopt.h>
+
+#include "usp.h"
+#include "uspgenerator.h"
+#include "corpus.h"
+#include "corpusbaseline.h"
+#include "solverregistry.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static constexpr auto USAGE =
+  R"(Usage:
+  uspcorpus build <corpus> <k>... [--min-n=<n>] [--max-n=<n>] [--samples=<count>] [--keep=<count>] [--band=<p>] [--solver=<name>] [--timeout=<ms>] [--seed=<s>] [--slack=<ms>] [--repeats=<count>]
+  uspcorpus replay <corpus> [--tolerance=<percent>] [--slack=<ms>] [--repeats=<count>] [--timeout=<ms>] [--update]
+  uspcorpus (-h | --help)
+
+Builds and replays a regression corpus of hard puzzles.
+
+The build command solves random (n, k) puzzles for every n from the minimum
+to the maximum and each width k, estimating the probability that a puzzle
+is weak. The curve is written to "<corpus>.phase.csv" with a 90% Wilson
+interval. For each k, the hardest puzzles of the sizes whose weak fraction
+lies within the band, around the threshold between weak and strong, are
+kept, or those of the size closest to one half if none does. Puzzles are
+ranked by conflicts, then decisions, which unlike a single timing do not
+pick up warm-up noise. Each kept puzzle is then timed as the fastest of the
+repeats, and dropped if that is within the slack, as replay could hardly
+flag it. The rest are written to the corpus file with their times, verdicts
+and counters as baselines in "<corpus>.baseline.csv". Puzzles that time out
+are not kept.
+
+The replay command solves every puzzle of the corpus again with the solver
+of its baselines, taking the fastest of the repeats, and flags puzzles
+that are slower than their baseline beyond the tolerance, or whose verdict
+changed. Exits with 1 if any puzzle is flagged. With --update the new
+times are written as the baselines instead, unless a verdict changed.
+
+Options:
+  -h --help             Show this screen.
+  --min-n=<n>           Smallest number of rows [default: 4].
+  --max-n=<n>           Largest number of rows [default: 20].
+  --samples=<count>     Random puzzles solved for each (n, k) [default: 100].
+  --keep=<count>        Puzzles kept for each width [default: 10].
+  --band=<p>            Sizes whose weak fraction is within p of one half are near the threshold [default: 0.15].
+  --solver=<name>       Solver to measure, dpll, cdcl, cnf or matching [default: cdcl].
+  --timeout=<ms>        Wall time limit of each solve in milliseconds, 0 for none [default: 60000].
+  --seed=<s>            Seed of the random puzzles [default: 0].
+  --tolerance=<percent> Slowdown over the baseline that is flagged [default: 25].
+  --slack=<ms>          Slowdowns of at most this many milliseconds are never flagged, and build
+                        drops puzzles no slower than this [default: 1].
+  --repeats=<count>     Solves of each kept or replayed puzzle, the fastest being its time [default: 3].
+  --update              Write the replayed times as the new baselines.
+)";
+
+namespace {
+
+using usp::SolveFunction;
+
+// Solve puzzle, filling the time and counters of its baseline
+usp::InstanceBaseline Measure(SolveFunction solve, const usp::Usp &puzzle, const usp::SolverLimits &limits)
+{
+  auto startTime = std::chrono::steady_clock::now();
+  const usp::SolverResult result = solve(puzzle, limits);
+  std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - startTime;
+  return { puzzle.rows(), puzzle.cols(), result.status, duration.count(), result.stats.decisions, result.stats.conflicts };
+}
+
+// Measure puzzle repeats times, keeping the fastest solve
+usp::InstanceBaseline MeasureFastest(SolveFunction solve, const usp::Usp &puzzle, const usp::SolverLimits &limits, long repeats)
+{
+  usp::InstanceBaseline fastest = Measure(solve, puzzle, limits);
+  for (long repeat = 1; repeat < repeats; ++repeat) {
+    const usp::InstanceBaseline measured = Measure(solve, puzzle, limits);
+    if (measured.milliseconds < fastest.milliseconds) {
+      fastest = measured;
+    }
+  }
+  return fastest;
+}
+
+// Bounds of the 90% Wilson score interval of a fraction of count trials
+std::pair<double, double> WilsonInterval(double fraction, double count)
+{
+  constexpr double z = 1.645;
+  if (count == 0) {
+    return { 0, 1 };
+  }
+  const double denominator = 1 + z * z / count;
+  const double centre = (fraction + z * z / (2 * count)) / denominator;
+  const double spread = z * std::sqrt(fraction * (1 - fraction) / count + z * z / (4 * count * count)) / denominator;
+  return { std::max(0.0, centre - spread), std::min(1.0, centre + spread) };
+}
+
+int Build(std::map<std::string, docopt::value> &args, SolveFunction solve, const usp::SolverLimits &limits)
+{
+  const std::string path = args["<corpus>"].asString();
+  const auto minN = static_cast<unsigned int>(args["--min-n"].asLong());
+  const auto maxN = static_cast<unsigned int>(args["--max-n"].asLong());
+  const auto samples = static_cast<unsigned int>(args["--samples"].asLong());
+  const auto keep = static_cast<std::size_t>(args["--keep"].asLong());
+  const double band = std::stod(args["--band"].asString());
+  const double slack = std::stod(args["--slack"].asString());
+  const auto repeats = std::max(1L, args["--repeats"].asLong());
+
+  std::ofstream phaseFile(path + ".phase.csv");
+  phaseFile << "Depth,Width,Weak,Strong,Unknown,WeakFraction,Low,High,Mean(ms),Max(ms)\n";
+
+  usp::UspGenerator generator(static_cast<std::uint64_t>(args["--seed"].asLong()));
+  usp::CorpusBaselines baselines{ args["--solver"].asString(), {} };
+  usp::CorpusWriter writer(path);
+  for (const std::string &width : args["<k>"].asStringList()) {
+    const auto k = static_cast<unsigned int>(std::stoul(width));
+    usp::HardestPuzzles nearThreshold(keep);
+    // Hardest puzzles of the size closest to one half so far, kept in case no size is within the band
+    std::optional<usp::HardestPuzzles> closest;
+    double closestDistance = 1;
+    unsigned long long timeouts = 0;
+
+    for (unsigned int n = minN; n <= maxN; ++n) {
+      usp::HardestPuzzles hardest(keep);
+      std::array<unsigned int, 3> verdicts{};
+      double milliseconds = 0;
+      double maxMilliseconds = 0;
+      for (unsigned int sample = 0; sample < samples; ++sample) {
+        const usp::Usp puzzle = generator.generateRandomPuzzle(n, k);
+        const usp::InstanceBaseline baseline = Measure(solve, puzzle, limits);
+        ++verdicts[static_cast<std::size_t>(baseline.status)];
+        milliseconds += baseline.milliseconds;
+        maxMilliseconds = std::max(maxMilliseconds, baseline.milliseconds);
+        if (baseline.status != usp::SolverStatus::UNKNOWN) {
+          hardest.offer(puzzle, baseline);
+        }
+      }
+      timeouts += verdicts[static_cast<std::size_t>(usp::SolverStatus::UNKNOWN)];
+
+      const unsigned int weak = verdicts[static_cast<std::size_t>(usp::SolverStatus::WEAK)];
+      const unsigned int decided = weak + verdicts[static_cast<std::size_t>(usp::SolverStatus::STRONG)];
+      const double fraction = decided == 0 ? 0 : static_cast<double>(weak) / decided;
+      const auto interval = WilsonInterval(fraction, decided);
+      phaseFile << n << "," << k << "," << weak << "," << decided - weak << "," << verdicts[static_cast<std::size_t>(usp::SolverStatus::UNKNOWN)] << ","
+                << fraction << "," << interval.first << "," << interval.second << ","
+                << (samples == 0 ? 0 : milliseconds / samples) << "," << maxMilliseconds << std::endl;
+      spdlog::info("({}, {}) weak fraction {:.2f}, mean {:.3f}ms, max {:.3f}ms", n, k, fraction, samples == 0 ? 0 : milliseconds / samples, maxMilliseconds);
+
+      const double distance = std::abs(fraction - 0.5);
+      if (decided != 0 && distance <= band) {
+        for (auto &[puzzle, baseline] : hardest.take()) {
+          nearThreshold.offer(puzzle, baseline);
+        }
+      } else if (decided != 0 && distance < closestDistance) {
+        closestDistance = distance;
+        closest = std::move(hardest);
+      }
+    }
+
+    if (timeouts != 0) {
+      spdlog::warn("{} puzzles of width {} timed out and are not kept", timeouts, k);
+    }
+    usp::HardestPuzzles &kept = nearThreshold.size() != 0 || !closest.has_value() ? nearThreshold : *closest;
+    if (&kept != &nearThreshold) {
+      spdlog::warn("No size of width {} is within the band, keeping the size with a weak fraction closest to one half", k);
+    }
+    std::size_t written = 0;
+    for (const auto &[puzzle, sample] : kept.take()) {
+      // The time of the scan is a single, possibly cold, sample
+      const usp::InstanceBaseline baseline = MeasureFastest(solve, puzzle, limits, repeats);
+      if (baseline.status == usp::SolverStatus::UNKNOWN || baseline.milliseconds <= slack) {
+        continue;
+      }
+      writer.add(puzzle);
+      baselines.instances.push_back(baseline);
+      ++written;
+    }
+    if (written == 0) {
+      spdlog::warn("Dropped width {}, as none of its kept puzzles takes more than {}ms", k, slack);
+    }
+  }
+  writer.finish();
+
+  std::ofstream baselineFile(path + ".baseline.csv");
+  usp::WriteBaselines(baselineFile, baselines);
+  spdlog::info("Kept {} puzzles in {}", baselines.instances.size(), path);
+  return 0;
+}
+
+int Replay(std::map<std::string, docopt::value> &args, const usp::SolverLimits &limits)
+{
+  const std::string path = args["<corpus>"].asString();
+  const double tolerance = std::stod(args["--tolerance"].asString()) / 100;
+  const double slack = std::stod(args["--slack"].asString());
+  const auto repeats = std::max(1L, args["--repeats"].asLong());
+
+  usp::CorpusReader reader(path);
+  std::ifstream baselineFile(path + ".baseline.csv");
+  if (!baselineFile) {
+    spdlog::error("Failed to open the baselines {}.baseline.csv", path);
+    return 1;
+  }
+  usp::CorpusBaselines baselines = usp::ReadBaselines(baselineFile);
+  baselineFile.close();
+  if (baselines.instances.size() != reader.size()) {
+    spdlog::error("{} baselines for {} puzzles", baselines.instances.size(), reader.size());
+    return 1;
+  }
+  SolveFunction solve = nullptr;
+  try {
+    solve = usp::SolverByName(baselines.solver);
+  } catch (const std::invalid_argument &error) {
+    spdlog::error("{} of the baselines", error.what());
+    return 1;
+  }
+
+  usp::CorpusBaselines replayed{ baselines.solver, {} };
+  unsigned long long slower = 0;
+  unsigned long long changed = 0;
+  double baselineTotal = 0;
+  double replayTotal = 0;
+  double logRatios = 0;
+  for (std::size_t i = 0; i < reader.size(); ++i) {
+    const usp::Usp puzzle = reader.puzzle(i);
+    const usp::InstanceBaseline &baseline = baselines.instances[i];
+    if (puzzle.rows() != baseline.rows || puzzle.cols() != baseline.cols) {
+      spdlog::error("Puzzle {} is ({}, {}) but its baseline is ({}, {})", i, puzzle.rows(), puzzle.cols(), baseline.rows, baseline.cols);
+      return 1;
+    }
+
+    const usp::InstanceBaseline fastest = MeasureFastest(solve, puzzle, limits, repeats);
+    replayed.instances.push_back(fastest);
+    baselineTotal += baseline.milliseconds;
+    replayTotal += fastest.milliseconds;
+    // Guard against a zero time of the fastest puzzles
+    logRatios += std::log((fastest.milliseconds + 1e-3) / (baseline.milliseconds + 1e-3));
+
+    switch (usp::CompareToBaseline(baseline, fastest.status, fastest.milliseconds, tolerance, slack)) {
+    case usp::ReplayOutcome::VERDICT_CHANGED:
+      ++changed;
+      spdlog::error("Puzzle {} ({}, {}) changed verdict", i, puzzle.rows(), puzzle.cols());
+      break;
+    case usp::ReplayOutcome::SLOWER:
+      ++slower;
+      spdlog::warn("Puzzle {} ({}, {}) took {:.3f}ms, {:.2f}x its baseline of {:.3f}ms", i, puzzle.rows(), puzzle.cols(), fastest.milliseconds, fastest.milliseconds / baseline.milliseconds, baseline.milliseconds);
+      break;
+    case usp::ReplayOutcome::UNCHANGED:
+      spdlog::debug("Puzzle {} took {:.3f}ms against {:.3f}ms", i, fastest.milliseconds, baseline.milliseconds);
+      break;
+    }
+  }
+
+  const double geometricMean = reader.size() == 0 ? 1 : std::exp(logRatios / static_cast<double>(reader.size()));
+  spdlog::info("Replayed {} puzzles in {:.3f}ms against {:.3f}ms, geometric mean ratio {:.3f}, {} slower, {} changed verdict",
+    reader.size(), replayTotal, baselineTotal, geometricMean, slower, changed);
+
+  if (args["--update"].asBool()) {
+    if (changed != 0) {
+      spdlog::error("Not updating the baselines, as verdicts changed");
+      return 1;
+    }
+    std::ofstream updated(path + ".baseline.csv");
+    usp::WriteBaselines(updated, replayed);
+    spdlog::info("Updated the baselines of {}", path);
+    return 0;
+  }
+  return slower + changed == 0 ? 0 : 1;
+}
+
+}// namespace
+
+int main(int argc, const char **argv)
+{
+  std::map<std::string, docopt::value> args = docopt::docopt(USAGE,
+    { std::next(argv), std::next(argv, argc) },
+    true,// show help if requested
+    "USP");// version string
+
+  spdlog::set_level(spdlog::level::info);
+
+  usp::SolverLimits limits;
+  limits.wallTime = std::chrono::milliseconds(args["--timeout"].asLong());
+
+  // Corpus and baseline files that are missing, truncated or of another version throw
+  try {
+    if (args["build"].asBool()) {
+      SolveFunction solve = nullptr;
+      try {
+        solve = usp::SolverByName(args["--solver"].asString());
+      } catch (const std::invalid_argument &error) {
+        spdlog::error("{}", error.what());
+        return 1;
+      }
+      return Build(args, solve, limits);
+    }
+    return Replay(args, limits);
+  } catch (const std::runtime_error &error) {
+    spdlog::error("{}", error.what());
+    return 1;
+  }
+}
@@ -1,21 +1,225 @@
 #include "uspgenerator.h"
 
+#include <algorithm>
 #include <chrono>
+#include <numeric>
+#include <stdexcept>
 
 namespace usp {
 
-UspGenerator::UspGenerator()
+namespace {
+
+  std::uint64_t SplitMix64(std::uint64_t &state)
+  {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+
+}// namespace
+
+Xoshiro256::Xoshiro256(std::uint64_t seed, std::uint64_t stream)
+{
+  for (std::uint64_t &word : m_state) {
+    word = SplitMix64(seed);
+  }
+  for (std::uint64_t s = 0; s < stream; ++s) {
+    jump();
+  }
+}
+
+void Xoshiro256::jump()
+{
+  static constexpr std::array<std::uint64_t, 4> kJump{ 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+  std::array<std::uint64_t, 4> state{};
+  for (std::uint64_t word : kJump) {
+    for (int bit = 0; bit < 64; ++bit) {
+      if ((word >> bit) & 1) {
+        for (std::size_t i = 0; i < state.size(); ++i) {
+          state[i] ^= m_state[i];
+        }
+      }
+      (*this)();
+    }
+  }
+  m_state = state;
+}
+
+UspGenerator::UspGenerator() : UspGenerator(static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()))
+{}
+
+UspGenerator::UspGenerator(std::uint64_t seed, std::uint64_t stream) : m_seed(seed), m_stream(stream), m_random(seed, stream)
+{}
+
+std::uint64_t UspGenerator::seed() const
 {
-  m_generator.seed(static_cast<std::mt19937::result_type>(std::chrono::steady_clock::now().time_since_epoch().count()));
+  return m_seed;
+}
+
+std::uint64_t UspGenerator::stream() const
+{
+  return m_stream;
+}
+
+void UspGenerator::setSymbolWeights(const std::array<double, 3> &weights)
+{
+  const double total = weights[0] + weights[1] + weights[2];
+  if (std::any_of(weights.begin(), weights.end(), [](double weight) { return weight < 0; }) || total <= 0) {
+    throw std::invalid_argument("UspGenerator::setSymbolWeights");
+  }
+  m_uniform = weights[0] == weights[1] && weights[1] == weights[2];
+  m_thresholds[0] = static_cast<std::uint32_t>(weights[0] / total * 65536);
+  m_thresholds[1] = static_cast<std::uint32_t>((weights[0] + weights[1]) / total * 65536);
+}
+
+void UspGenerator::fill(int *cells, std::size_t count)
+{
+  std::size_t i = 0;
+  if (m_uniform) {
+    while (i < count) {
+      std::uint64_t bits = m_random();
+      for (int byte = 0; byte < 8 && i < count; ++byte, bits >>= 8) {
+        // A byte below 243 = 3^5 is five uniform base 3 digits
+        auto value = static_cast<unsigned int>(bits & 0xff);
+        if (value >= 243) {
+          continue;
+        }
+        for (int digit = 0; digit < 5 && i < count; ++digit, value /= 3) {
+          cells[i++] = static_cast<int>(value % 3) + 1;
+        }
+      }
+    }
+    return;
+  }
+  while (i < count) {
+    std::uint64_t bits = m_random();
+    for (int lane = 0; lane < 4 && i < count; ++lane, bits >>= 16) {
+      const auto value = static_cast<std::uint32_t>(bits & 0xffff);
+      cells[i++] = value < m_thresholds[0] ? 1 : value < m_thresholds[1] ? 2 : 3;
+    }
+  }
 }
 
 Usp UspGenerator::generateRandomPuzzle(unsigned int n, unsigned int k)
 {
   std::vector<int> data(n * k);
-  for (unsigned int i = 0; i < n * k; ++i) {
-    data[i] = m_distribution(m_generator);
+  fill(data.data(), data.size());
+  return Usp(std::move(data), n, k);
+}
+
+void UspGenerator::generateRandomPuzzle(Usp &puzzle, unsigned int n, unsigned int k)
+{
+  m_cells.resize(static_cast<std::size_t>(n) * k);
+  fill(m_cells.data(), m_cells.size());
+  puzzle.assign(m_cells.data(), n, k);
+}
+
+void UspGenerator::reserve(unsigned int n, unsigned int k)
+{
+  m_cells.reserve(static_cast<std::size_t>(n) * k);
+}
+
+std::vector<int> UspGenerator::generateRandomRow(unsigned int k)
+{
+  std::vector<int> row(k);
+  fill(row.data(), row.size());
+  return row;
+}
+
+unsigned int UspGenerator::below(unsigned int bound)
+{
+  // Lemire's multiply and shift, rejecting the biased low products
+  std::uint64_t product = (m_random() >> 32) * bound;
+  if (static_cast<std::uint32_t>(product) < bound) {
+    const unsigned int threshold = (0U - bound) % bound;
+    while (static_cast<std::uint32_t>(product) < threshold) {
+      product = (m_random() >> 32) * bound;
+    }
+  }
+  return static_cast<unsigned int>(product >> 32);
+}
+
+std::vector<unsigned int> UspGenerator::randomPermutation(unsigned int n)
+{
+  std::vector<unsigned int> permutation(n);
+  std::iota(permutation.begin(), permutation.end(), 0U);
+  for (unsigned int i = n; i > 1; --i) {
+    std::swap(permutation[i - 1], permutation[below(i)]);
+  }
+  return permutation;
+}
+
+PlantedPuzzle UspGenerator::generatePlantedWeakPuzzle(unsigned int n, unsigned int k)
+{
+  if (n < 2) {
+    throw std::invalid_argument("UspGenerator::generatePlantedWeakPuzzle");
+  }
+  std::vector<unsigned int> rho;
+  std::vector<unsigned int> sigma;
+  do {
+    rho = randomPermutation(n);
+    sigma = randomPermutation(n);
+  } while (std::is_sorted(rho.begin(), rho.end()) && std::is_sorted(sigma.begin(), sigma.end()));
+
+  std::vector<int> data(n * k);
+  fill(data.data(), data.size());
+  std::vector<int> column(n);
+  // Row i queries true in a column iff exactly two of (i = 1, rho(i) = 2, sigma(i) = 3) hold there
+  auto violated = [&column, &rho, &sigma](unsigned int i) {
+    return (column[i] == 1) + (column[rho[i]] == 2) + (column[sigma[i]] == 3) == 2;
+  };
+  for (unsigned int col = 0; col < k; ++col) {
+    for (unsigned int row = 0; row < n; ++row) {
+      column[row] = data[row * k + col];
+    }
+    // WalkSAT style repair: move a cell of a random violated row to another symbol
+    for (unsigned int step = 0;; ++step) {
+      const unsigned int start = below(n);
+      unsigned int offset = 0;
+      while (offset < n && !violated((start + offset) % n)) {
+        ++offset;
+      }
+      if (offset == n) {
+        break;
+      }
+      if (step == 10 * n) {
+        // A constant column makes exactly one of the three hold in every row
+        std::fill(column.begin(), column.end(), static_cast<int>(below(3)) + 1);
+        break;
+      }
+      const unsigned int i = (start + offset) % n;
+      const std::array<unsigned int, 3> cells{ i, rho[i], sigma[i] };
+      int &cell = column[cells[below(3)]];
+      cell = (cell + static_cast<int>(below(2))) % 3 + 1;
+    }
+    for (unsigned int row = 0; row < n; ++row) {
+      data[row * k + col] = column[row];
+    }
+  }
+  return { Usp(std::move(data), n, k), std::move(rho), std::move(sigma) };
+}
+
+Usp UspGenerator::generatePerturbedPuzzle(const Usp &base, unsigned int changes)
+{
+  const unsigned int n = base.rows();
+  const unsigned int k = base.cols();
+  std::vector<int> data(n * k);
+  for (unsigned int row = 0; row < n; ++row) {
+    for (unsigned int col = 0; col < k; ++col) {
+      data[row * k + col] = base.element(row, col);
+    }
+  }
+  std::vector<bool> changed(data.size(), false);
+  for (std::size_t change = 0; change < std::min<std::size_t>(changes, data.size()); ++change) {
+    unsigned int index = below(n * k);
+    while (changed[index]) {
+      index = below(n * k);
+    }
+    changed[index] = true;
+    data[index] = (data[index] + static_cast<int>(below(2))) % 3 + 1;
   }
   return Usp(std::move(data), n, k);
 }
 
-}//namespace usp
\ No newline at end of file
+}//namespace usp
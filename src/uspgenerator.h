@@ -3,24 +3,126 @@
 
 #include "usp.h"
 
-#include <random>
+#include <array>
+#include <cstdint>
+#include <vector>
 
 namespace usp {
 
+/* xoshiro256** pseudo random generator, a UniformRandomBitGenerator.
+ * The state is expanded from the seed by splitmix64, and stream s
+ * starts s jumps of 2^128 draws further, so streams never overlap.
+ */
+class Xoshiro256
+{
+public:
+  using result_type = std::uint64_t;
+
+  explicit Xoshiro256(std::uint64_t seed = 0, std::uint64_t stream = 0);
+
+  result_type operator()()
+  {
+    const std::uint64_t result = rotate(m_state[1] * 5, 7) * 9;
+    const std::uint64_t t = m_state[1] << 17;
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+    m_state[2] ^= t;
+    m_state[3] = rotate(m_state[3], 45);
+    return result;
+  }
+
+  // Advance by 2^128 draws
+  void jump();
+
+  static constexpr result_type min()
+  {
+    return 0;
+  }
+
+  static constexpr result_type max()
+  {
+    return ~result_type{ 0 };
+  }
+
+private:
+  static std::uint64_t rotate(std::uint64_t x, int bits)
+  {
+    return (x << bits) | (x >> (64 - bits));
+  }
+
+  std::array<std::uint64_t, 4> m_state{};
+};
+
+/* A weak puzzle together with the witness planted in it
+ */
+struct PlantedPuzzle
+{
+  Usp puzzle;
+  std::vector<unsigned int> rho;
+  std::vector<unsigned int> sigma;
+};
+
 /* Utility class to generate random USPs.
+ * Cells are filled in bulk, several per 64-bit draw: uniform symbols take
+ * five cells from every byte below 3^5, weighted symbols take a 16-bit
+ * lane per cell. A generator with the same seed and stream always
+ * generates the same puzzles.
  */
 class UspGenerator
 {
 public:
+  // Seeded from the clock, see seed()
   UspGenerator();
+  explicit UspGenerator(std::uint64_t seed, std::uint64_t stream = 0);
+
+  // Seed and stream the generator started from
+  std::uint64_t seed() const;
+  std::uint64_t stream() const;
+
+  /* Draw the symbols 1, 2 and 3 with the given relative weights, uniform by default.
+   * Throws 'std::invalid_argument' if a weight is negative or all are zero
+   */
+  void setSymbolWeights(const std::array<double, 3> &weights);
+
   // Randomly generate a (n, k) USP
   Usp generateRandomPuzzle(unsigned int n, unsigned int k);
+  // Randomly generate a (n, k) USP into puzzle, reusing its storage
+  void generateRandomPuzzle(Usp &puzzle, unsigned int n, unsigned int k);
+  // Size the cells drawn for puzzles of up to (n, k), so generating into a reserved puzzle never allocates
+  void reserve(unsigned int n, unsigned int k);
+  // Randomly generate a row of k elements
+  std::vector<int> generateRandomRow(unsigned int k);
+  // Fill count cells with random symbols
+  void fill(int *cells, std::size_t count);
+
+  /* Generate a weak (n, k) USP around a random witness. Every column is drawn
+   * at random and then repaired until no row queries true under the witness,
+   * falling back to a constant column when repair stalls.
+   * Throws 'std::invalid_argument' if n < 2, which has no witness
+   */
+  PlantedPuzzle generatePlantedWeakPuzzle(unsigned int n, unsigned int k);
+  /* Copy base with changes distinct random cells set to another symbol. Perturbing a
+   * strong USP gives near-strong puzzles, which are the hardest to decide
+   */
+  Usp generatePerturbedPuzzle(const Usp &base, unsigned int changes);
 
 private:
-  std::mt19937 m_generator;
-  std::uniform_int_distribution<int> m_distribution{ 1, 3 };
+  // Return a random value below bound
+  unsigned int below(unsigned int bound);
+  std::vector<unsigned int> randomPermutation(unsigned int n);
+
+  std::uint64_t m_seed;
+  std::uint64_t m_stream;
+  Xoshiro256 m_random;
+  // Cumulative weights of symbols 1 and 2 out of 2^16, while not uniform
+  bool m_uniform{ true };
+  std::array<std::uint32_t, 2> m_thresholds{};
+  // Cells of the puzzles generated in place
+  std::vector<int> m_cells;
 };
 
 }// namespace usp
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,101 @@
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+#include <docopt/docopt.h>
+
+#include "usp.h"
+#include "strongsearch.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+static constexpr auto USAGE =
+  R"(Usage:
+  uspsearch <k>... [--minutes=<m>] [--threads=<count>] [--candidates=<count>] [--random] [--proof-timeout=<ms>] [--checkpoint=<dir>] [--seed=<s>]
+  uspsearch (-h | --help)
+
+Searches for strong USPs of each width k, extending them a row at a time.
+Each width runs for the given number of minutes. The largest strong USP
+found is checkpointed to "<dir>/strong_<k>.txt" whenever it grows, and a
+later run resumes from it. Outputs the largest puzzle and the rows found
+per hour of each width into "search.csv" in the same directory.
+
+Options:
+  -h --help              Show this screen.
+  --minutes=<m>          Minutes to search each width [default: 10].
+  --threads=<count>      Threads evaluating candidate rows, 0 for every core [default: 0].
+  --candidates=<count>   Candidate rows each thread generates per extension [default: 64].
+  --random               Try candidates in random order instead of greedily.
+  --proof-timeout=<ms>   Wall time limit of each strong proof in milliseconds, 0 for none [default: 10000].
+  --checkpoint=<dir>     Directory of the checkpoints [default: .].
+  --seed=<s>             Seed of the candidate rows [default: 0].
+)";
+
+// Set on SIGINT, ending the search after the current extension
+static std::atomic<bool> interrupted{ false };
+
+extern "C" void onInterrupt(int /*signal*/)
+{
+  interrupted = true;
+}
+
+int main(int argc, const char **argv)
+{
+  std::map<std::string, docopt::value> args = docopt::docopt(USAGE,
+    { std::next(argv), std::next(argv, argc) },
+    true,// show help if requested
+    "USP");// version string
+
+  spdlog::set_level(spdlog::level::info);
+  std::signal(SIGINT, onInterrupt);
+
+  usp::StrongSearchOptions options;
+  options.threads = static_cast<unsigned int>(args["--threads"].asLong());
+  options.candidates = static_cast<unsigned int>(args["--candidates"].asLong());
+  options.greedy = !args["--random"].asBool();
+  options.proofLimits.wallTime = std::chrono::milliseconds(args["--proof-timeout"].asLong());
+  options.seed = static_cast<std::uint64_t>(args["--seed"].asLong());
+  const std::chrono::minutes duration(args["--minutes"].asLong());
+
+  std::ofstream csvFile;
+  csvFile.open("search.csv");
+  csvFile << "Width,Rows,Accepted,Backtracks,Hours,RowsPerHour\n";
+
+  for (const std::string &width : args["<k>"].asStringList()) {
+    if (interrupted) {
+      break;
+    }
+    const auto k = static_cast<unsigned int>(std::stoul(width));
+    const std::string checkpoint = args["--checkpoint"].asString() + "/strong_" + width + ".txt";
+    usp::StrongUspSearch search(k, options, usp::LoadCheckpoint(checkpoint, k));
+    spdlog::info("Searching width {} from {} rows", k, search.rows().size());
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::size_t best = search.best().size();
+    while (!interrupted && std::chrono::steady_clock::now() - startTime < duration) {
+      search.step(&interrupted);
+      if (search.best().size() > best) {
+        best = search.best().size();
+        usp::SaveCheckpoint(checkpoint, k, search.best());
+        spdlog::info("Width {}: strong USP with {} rows", k, best);
+      }
+    }
+
+    std::chrono::duration<double, std::ratio<3600>> hours = std::chrono::steady_clock::now() - startTime;
+    const usp::StrongSearchStats &stats = search.stats();
+    spdlog::info("Width {}: {} candidates, {} rejected by local search, {} by the solver, {} unknown",
+      k,
+      stats.candidates,
+      stats.rejectedByLocalSearch,
+      stats.rejectedBySolver,
+      stats.unknown);
+    csvFile << k << "," << best << "," << stats.accepted << "," << stats.backtracks << "," << hours.count() << "," << static_cast<double>(stats.accepted) / hours.count() << std::endl;
+  }
+
+  csvFile.close();
+}
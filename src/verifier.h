@@ -3,26 +3,116 @@
 
 #include "usp.h"
 
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace usp {
 
-/* Verifier using witnesses rho and sigma. 
- * Checks the condition holds for each element in the USP.
- * Returns true iff the permutations prove the usp is weak. 
- * Throws 'std::bad_optional_access' if rho or sigma don't contain 
- * a valid assignment.
+// First failing row reported for a witness that passes every row
+static constexpr int kNoFailingRow = -1;
+
+/* Verifier using witnesses rho and sigma as index arrays,
+ * rho[i] and sigma[i] being the columns assigned to row i.
+ * Returns the first row i with query(i, rho(i), sigma(i)),
+ * or kNoFailingRow if the permutations prove the usp is weak.
  */
-bool VerifyUspWeakness(const usp::Usp &usp, const Permutation &rho, const Permutation &sigma)
+inline int FirstFailingRow(const usp::Usp &usp, const std::vector<unsigned int> &rho, const std::vector<unsigned int> &sigma)
 {
   for (unsigned int i = 0; i < usp.rows(); ++i) {
-    spdlog::debug("Query: ({},{},{}): {}", i, rho.assignment(i).value(), sigma.assignment(i).value(), usp.query(i, rho.assignment(i).value(), sigma.assignment(i).value()));
-    if (usp.query(i, rho.assignment(i).value(), sigma.assignment(i).value())) {
+    if ((usp.slab(i, rho[i])[sigma[i] / 64] >> (sigma[i] % 64)) & 1) {
+      return static_cast<int>(i);
+    }
+  }
+  return kNoFailingRow;
+}
+
+/* Whether rho and sigma, as index arrays, are both the identity.
+ * The index array verifiers accept that pair, which proves nothing.
+ */
+inline bool IsIdentityWitness(const std::vector<unsigned int> &rho, const std::vector<unsigned int> &sigma)
+{
+  for (std::size_t i = 0; i < rho.size(); ++i) {
+    if (rho[i] != i || sigma[i] != i) {
       return false;
     }
   }
   return true;
 }
 
+/* Verifier using witnesses rho and sigma.
+ * Checks the condition holds for each element in the USP.
+ * Returns true iff the permutations prove the usp is weak.
+ * Throws 'std::bad_optional_access' if rho or sigma don't contain
+ * a valid assignment.
+ */
+inline bool VerifyUspWeakness(const usp::Usp &usp, const Permutation &rho, const Permutation &sigma)
+{
+  int row = FirstFailingRow(usp, rho.assignments(), sigma.assignments());
+  spdlog::debug("Verifier first failing row: {}", row);
+  return row == kNoFailingRow;
+}
+
+/* Batched verifier for count witnesses over plain index arrays.
+ * Witnesses are stored row-major so that a row of every witness is
+ * contiguous: rho[i * count + w] is rho(i) of witness w.
+ * Writes the first failing row of each witness to firstFailingRow[w],
+ * or kNoFailingRow if the witness proves the usp is weak.
+ * Lanes of eight witnesses are checked with vector gathers from the
+ * packed query tensor when built with AVX2, and stop once every lane has failed.
+ * Lazy puzzles have no tensor to gather from and are checked a slab at a time.
+ */
+inline void VerifyUspWeaknessBatch(const usp::Usp &usp, const unsigned int *rho, const unsigned int *sigma, std::size_t count, int *firstFailingRow)
+{
+  const unsigned int n = usp.rows();
+  const std::uint64_t *tensor = usp.lazy() ? nullptr : usp.tensor();
+  const std::size_t slabWords = usp.slabWords();
+
+  std::size_t w = 0;
+#if defined(__AVX2__)
+  // Address the tensor as 32-bit words, bit c of slab (a, b) is bit c % 32 of word (a * n + b) * 2 * slabWords + c / 32
+  const auto *tensor32 = reinterpret_cast<const int *>(tensor);
+  const __m256i slabWords32 = _mm256_set1_epi32(static_cast<int>(2 * slabWords));
+  const __m256i low5 = _mm256_set1_epi32(31);
+  const __m256i one = _mm256_set1_epi32(1);
+  for (; tensor != nullptr && w + 8 <= count; w += 8) {
+    __m256i failing = _mm256_set1_epi32(kNoFailingRow);
+    __m256i alive = _mm256_set1_epi32(-1);
+    for (unsigned int i = 0; i < n && !_mm256_testz_si256(alive, alive); ++i) {
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&rho[i * count + w]));
+      __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&sigma[i * count + w]));
+      __m256i slab = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i * n)), b);
+      __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(slab, slabWords32), _mm256_srli_epi32(c, 5));
+      __m256i words = _mm256_i32gather_epi32(tensor32, index, 4);
+      __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(c, low5)), one);
+      __m256i failed = _mm256_and_si256(_mm256_cmpeq_epi32(bits, one), alive);
+      failing = _mm256_blendv_epi8(failing, _mm256_set1_epi32(static_cast<int>(i)), failed);
+      alive = _mm256_andnot_si256(failed, alive);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(&firstFailingRow[w]), failing);
+  }
+#endif
+
+  // Remaining witnesses, or all of them without AVX2
+  for (; w < count; ++w) {
+    firstFailingRow[w] = kNoFailingRow;
+    for (unsigned int i = 0; i < n; ++i) {
+      unsigned int b = rho[i * count + w];
+      unsigned int c = sigma[i * count + w];
+      const std::uint64_t word = tensor != nullptr ? tensor[(i * n + b) * slabWords + c / 64] : usp.slab(i, b)[c / 64];
+      if ((word >> (c % 64)) & 1) {
+        firstFailingRow[w] = static_cast<int>(i);
+        break;
+      }
+    }
+  }
+}
+
 }// namespace usp
 
 
-#endif
\ No newline at end of file
+#endif
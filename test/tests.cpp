@@ -2,11 +2,32 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+
 #include "usp.h"
+#include "uspgenerator.h"
 #include "verifier.h"
 #include "basicsolver.h"
 #include "cdclsolver.h"
+#include "cnfsolver.h"
+#include "dimacs.h"
+#include "corpus.h"
+#include "corpusbaseline.h"
+#include "batchserver.h"
+#include "perfcounters.h"
 #include "dpllsolver.h"
+#include "localsearchsolver.h"
+#include "strongsearch.h"
+#include "matchingsolver.h"
+#include "lockstepsolver.h"
+#include "allocationcounter.h"
 
 namespace data {
 const usp::Usp weakPuzzle({ 2, 2, 2, 3 }, 2, 2);
@@ -16,6 +37,20 @@ const usp::Usp medWeakPuzzle({ 3, 2, 3, 1, 2, 1, 1, 2, 1, 2, 1, 1, 2, 3, 1, 2, 3
 const usp::Usp medStrongPuzzle({ 1, 2, 2, 2, 2, 3, 3, 3, 2, 2, 3, 2, 2, 1, 1, 3, 2, 2, 3, 2, 3, 1, 2, 3, 3, 1, 2, 1, 1, 3, 1, 3, 2, 3, 3, 1, 3, 3, 3, 3, 2, 3, 3, 3, 2, 3, 1, 2, 1, 1, 3, 3, 1, 2, 1, 3, 1, 3, 2, 1, 2, 3, 2, 2 }, 8, 8);
 }// namespace data
 
+// Scratch file in the temporary directory, removed when it goes out of scope
+struct TemporaryFile
+{
+  explicit TemporaryFile(const std::string &name) : path((std::filesystem::temp_directory_path() / name).string()) {}
+  TemporaryFile(const TemporaryFile &) = delete;
+  TemporaryFile &operator=(const TemporaryFile &) = delete;
+  ~TemporaryFile()
+  {
+    std::remove(path.c_str());
+  }
+
+  const std::string path;
+};
+
 TEST_CASE("USP and Permutation construction", "[usp]")
 {
   usp::Usp puzzle({ 2, 2, 2, 3 }, 2, 2);
@@ -72,6 +107,50 @@ TEST_CASE("USP Verifier failure on small strong puzzles", "[usp]")
   REQUIRE(!usp::VerifyUspWeakness(data::strongPuzzle, rho, sigma));
 }
 
+TEST_CASE("Batched verifier agrees with the single witness verifier", "[usp]")
+{
+  usp::UspGenerator generator(7);
+  std::mt19937 random(7);
+  for (unsigned int n : { 2U, 9U, 70U }) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(n, n / 2 + 1);
+    const std::size_t count = 21;
+    std::vector<unsigned int> rho(n * count);
+    std::vector<unsigned int> sigma(n * count);
+    std::vector<std::vector<unsigned int>> rhos;
+    std::vector<std::vector<unsigned int>> sigmas;
+    for (std::size_t w = 0; w < count; ++w) {
+      std::vector<unsigned int> witnessRho(n);
+      std::vector<unsigned int> witnessSigma(n);
+      std::iota(witnessRho.begin(), witnessRho.end(), 0);
+      std::iota(witnessSigma.begin(), witnessSigma.end(), 0);
+      // Keep a few identity rows so some witnesses pass
+      if (w % 3 != 0) {
+        std::shuffle(witnessRho.begin(), witnessRho.end(), random);
+        std::shuffle(witnessSigma.begin(), witnessSigma.end(), random);
+      }
+      for (unsigned int i = 0; i < n; ++i) {
+        rho[i * count + w] = witnessRho[i];
+        sigma[i * count + w] = witnessSigma[i];
+      }
+      rhos.push_back(witnessRho);
+      sigmas.push_back(witnessSigma);
+    }
+
+    std::vector<int> failing(count);
+    usp::VerifyUspWeaknessBatch(puzzle, rho.data(), sigma.data(), count, failing.data());
+    for (std::size_t w = 0; w < count; ++w) {
+      int expected = usp::kNoFailingRow;
+      for (unsigned int i = 0; i < n && expected == usp::kNoFailingRow; ++i) {
+        if (puzzle.query(i, rhos[w][i], sigmas[w][i])) {
+          expected = static_cast<int>(i);
+        }
+      }
+      REQUIRE(failing[w] == expected);
+      REQUIRE(usp::FirstFailingRow(puzzle, rhos[w], sigmas[w]) == expected);
+    }
+  }
+}
+
 TEST_CASE("Basic Solver works on small puzzles", "[solver]")
 {
   auto solver = usp::BasicSolver(data::weakPuzzle);
@@ -82,6 +161,38 @@ TEST_CASE("Basic Solver works on small puzzles", "[solver]")
   REQUIRE(usp::VerifyUspWeakness(data::weakPuzzle, rho, sigma));
 }
 
+TEST_CASE("Basic Solver works on medium sized puzzles", "[solver]")
+{
+  auto solver = usp::BasicSolver(data::medWeakPuzzle);
+  auto strongSolver = usp::BasicSolver(data::medStrongPuzzle);
+  REQUIRE(solver.has_value());
+  REQUIRE(!strongSolver.has_value());
+  auto [rho, sigma] = solver.value();
+  REQUIRE(usp::VerifyUspWeakness(data::medWeakPuzzle, rho, sigma));
+}
+
+TEST_CASE("Permutation prefixes are unranked lexicographically", "[solver]")
+{
+  REQUIRE(usp::PermutationPrefixCount(5, 2) == 20);
+  REQUIRE(usp::UnrankPermutationPrefix(0, 4, 4) == std::vector<unsigned int>{ 0, 1, 2, 3 });
+  REQUIRE(usp::UnrankPermutationPrefix(23, 4, 4) == std::vector<unsigned int>{ 3, 2, 1, 0 });
+  REQUIRE(usp::UnrankPermutationPrefix(5, 4, 2) == std::vector<unsigned int>{ 1, 3 });
+}
+
+TEST_CASE("Basic Solver agrees with CDCL Solver on random puzzles", "[solver]")
+{
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 50; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(5, 4);
+    auto basic = usp::BasicSolver(puzzle, 4);
+    auto cdcl = usp::CdclSolver(puzzle);
+    REQUIRE(basic.has_value() == cdcl.has_value());
+    if (basic.has_value()) {
+      REQUIRE(usp::VerifyUspWeakness(puzzle, basic->first, basic->second));
+    }
+  }
+}
+
 TEST_CASE("DPLL Solver works on small puzzles", "[solver]")
 {
   auto solver = usp::DpllSolver(data::weakPuzzle);
@@ -121,3 +232,894 @@ TEST_CASE("CDCL Solver works on medium sized puzzles", "[solver]")
   auto [rho, sigma] = solver.value();
   REQUIRE(usp::VerifyUspWeakness(data::medWeakPuzzle, rho, sigma));
 }
+
+TEST_CASE("Local search finds witnesses on weak puzzles", "[solver]")
+{
+  auto solver = usp::LocalSearchSolver(data::medWeakPuzzle);
+  auto strongSolver = usp::LocalSearchSolver(data::medStrongPuzzle, { 10000, std::chrono::milliseconds(1000), 0.1, 8, 0 });
+  REQUIRE(solver.has_value());
+  REQUIRE(!strongSolver.has_value());
+  auto [rho, sigma] = solver.value();
+  REQUIRE(usp::VerifyUspWeakness(data::medWeakPuzzle, rho, sigma));
+  REQUIRE(!usp::LocalSearchSolver(data::strongPuzzle).has_value());
+}
+
+TEST_CASE("Local search first stage agrees with CDCL Solver", "[solver]")
+{
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 50; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(7, 6);
+    auto hybrid = usp::LocalSearchCdclSolver(puzzle, { 2000, std::chrono::milliseconds(100), 0.1, 8, trial });
+    auto cdcl = usp::CdclSolver(puzzle);
+    REQUIRE(hybrid.has_value() == cdcl.has_value());
+    if (hybrid.has_value()) {
+      REQUIRE(usp::VerifyUspWeakness(puzzle, hybrid->first, hybrid->second));
+    }
+  }
+}
+
+TEST_CASE("DPLL and CDCL enumeration count every witness", "[solver]")
+{
+  // Count witnesses by trying every pair of permutations
+  auto bruteForceCount = [](const usp::Usp &puzzle) {
+    unsigned long long count = 0;
+    std::vector<unsigned int> rho(puzzle.rows());
+    std::iota(rho.begin(), rho.end(), 0);
+    do {
+      std::vector<unsigned int> sigma(puzzle.rows());
+      std::iota(sigma.begin(), sigma.end(), 0);
+      do {
+        bool identity = std::is_sorted(rho.begin(), rho.end()) && std::is_sorted(sigma.begin(), sigma.end());
+        if (!identity && usp::FirstFailingRow(puzzle, rho, sigma) == usp::kNoFailingRow) {
+          ++count;
+        }
+      } while (std::next_permutation(sigma.begin(), sigma.end()));
+    } while (std::next_permutation(rho.begin(), rho.end()));
+    return count;
+  };
+
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 20; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(5, 3);
+    unsigned long long expected = bruteForceCount(puzzle);
+
+    std::set<std::pair<std::vector<unsigned int>, std::vector<unsigned int>>> witnesses;
+    usp::CdclEnumerate(puzzle, [&](const usp::Permutation &rho, const usp::Permutation &sigma) {
+      REQUIRE(usp::VerifyUspWeakness(puzzle, rho, sigma));
+      witnesses.emplace(rho.assignments(), sigma.assignments());
+      return true;
+    });
+    unsigned long long streamed = 0;
+    usp::DpllEnumerate(puzzle, [&streamed](const usp::Permutation &, const usp::Permutation &) {
+      ++streamed;
+      return true;
+    });
+
+    REQUIRE(witnesses.size() == expected);
+    REQUIRE(streamed == expected);
+    REQUIRE(usp::DpllCountWitnesses(puzzle, 2) == expected);
+    REQUIRE(usp::CdclCountWitnesses(puzzle, 2) == expected);
+  }
+
+  unsigned long long first = 0;
+  REQUIRE(usp::CdclEnumerate(data::medWeakPuzzle, [&first](const usp::Permutation &, const usp::Permutation &) {
+    ++first;
+    return false;
+  }));
+  REQUIRE(first == 1);
+  REQUIRE(usp::CdclCountWitnesses(data::medStrongPuzzle) == 0);
+}
+
+TEST_CASE("Bounded solves report unknown when a limit is reached", "[solver]")
+{
+  usp::SolverLimits limits;
+  limits.maxDecisions = 3;
+  usp::SolverResult bounded = usp::CdclSolve(data::medStrongPuzzle, limits);
+  REQUIRE(bounded.status == usp::SolverStatus::UNKNOWN);
+  REQUIRE(!bounded.witness.has_value());
+  REQUIRE(usp::DpllSolve(data::medStrongPuzzle, limits).status == usp::SolverStatus::UNKNOWN);
+
+  std::atomic<bool> cancel{ true };
+  usp::SolverLimits cancelled;
+  cancelled.cancel = &cancel;
+  REQUIRE(usp::CdclSolve(data::medWeakPuzzle, cancelled).status == usp::SolverStatus::UNKNOWN);
+
+  usp::SolverResult strong = usp::CdclSolve(data::medStrongPuzzle, {});
+  REQUIRE(strong.status == usp::SolverStatus::STRONG);
+  REQUIRE(strong.stats.decisions > 0);
+  usp::SolverResult weak = usp::CdclSolve(data::medWeakPuzzle, {});
+  REQUIRE(weak.status == usp::SolverStatus::WEAK);
+  REQUIRE(usp::VerifyUspWeakness(data::medWeakPuzzle, weak.witness->first, weak.witness->second));
+}
+
+TEST_CASE("Lookahead probing keeps the verdict of the search", "[solver]")
+{
+  usp::SolverLimits plain;
+  plain.lookahead.rows = 0;
+  usp::SolverLimits probing;
+  probing.lookahead.minConflicts = 0;
+
+  usp::SolverResult strong = usp::DpllSolve(data::medStrongPuzzle, probing);
+  REQUIRE(strong.status == usp::SolverStatus::STRONG);
+  REQUIRE(strong.stats.probes > 0);
+  REQUIRE(strong.stats.decisions < usp::DpllSolve(data::medStrongPuzzle, plain).stats.decisions);
+  REQUIRE(usp::DpllSolve(data::medStrongPuzzle, plain).stats.probes == 0);
+
+  usp::UspGenerator generator(42);
+  for (unsigned int trial = 0; trial < 100; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(2 + trial % 7, 2 + trial % 9);
+    const bool weak = usp::DpllSolve(puzzle, plain).status == usp::SolverStatus::WEAK;
+    for (auto solve : { &usp::DpllSolve, &usp::CdclSolve }) {
+      usp::SolverResult result = solve(puzzle, probing);
+      REQUIRE((result.status == usp::SolverStatus::WEAK) == weak);
+      if (result.witness.has_value()) {
+        REQUIRE(usp::VerifyUspWeakness(puzzle, result.witness->first, result.witness->second));
+      }
+    }
+  }
+}
+
+TEST_CASE("CNF Solver works on small and medium sized puzzles", "[solver]")
+{
+  REQUIRE(usp::CnfSolver(data::weakPuzzle).has_value());
+  REQUIRE(!usp::CnfSolver(data::strongPuzzle).has_value());
+  auto solver = usp::CnfSolver(data::medWeakPuzzle);
+  auto strongSolver = usp::CnfSolver(data::medStrongPuzzle);
+  REQUIRE(solver.has_value());
+  REQUIRE(!strongSolver.has_value());
+  auto [rho, sigma] = solver.value();
+  REQUIRE(usp::VerifyUspWeakness(data::medWeakPuzzle, rho, sigma));
+}
+
+TEST_CASE("CNF Solver agrees with CDCL Solver on random puzzles", "[solver]")
+{
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 100; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(2 + trial % 7, 2 + trial % 5);
+    auto cnf = usp::CnfSolver(puzzle);
+    REQUIRE(cnf.has_value() == usp::CdclSolver(puzzle).has_value());
+    if (cnf.has_value()) {
+      REQUIRE(usp::VerifyUspWeakness(puzzle, cnf->first, cnf->second));
+    }
+  }
+}
+
+TEST_CASE("Matching Solver agrees with CDCL Solver on random puzzles", "[solver]")
+{
+  REQUIRE(usp::MatchingSolver(data::weakPuzzle).has_value());
+  REQUIRE(!usp::MatchingSolver(data::strongPuzzle).has_value());
+  REQUIRE(usp::MatchingSolver(data::medWeakPuzzle).has_value());
+  REQUIRE(!usp::MatchingSolver(data::medStrongPuzzle).has_value());
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 200; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(1 + trial % 9, 1 + trial % 6);
+    auto matching = usp::MatchingSolver(puzzle);
+    REQUIRE(matching.has_value() == usp::CdclSolver(puzzle).has_value());
+    if (matching.has_value()) {
+      REQUIRE(usp::VerifyUspWeakness(puzzle, matching->first, matching->second));
+    }
+  }
+}
+
+TEST_CASE("Solver session reuses its buffers across puzzles", "[solver]")
+{
+  usp::UspGenerator generator(7);
+  usp::UspGenerator replay(7);
+  usp::SolverSession session(9);
+  usp::Usp puzzle({}, 0, 0);
+  puzzle.reserve(9, 6);
+  for (unsigned int trial = 0; trial < 200; ++trial) {
+    const unsigned int n = 1 + (trial * 7) % 9;
+    const unsigned int k = 1 + trial % 6;
+    generator.generateRandomPuzzle(puzzle, n, k);
+    usp::Usp expected = replay.generateRandomPuzzle(n, k);
+    REQUIRE(puzzle.rows() == n);
+    REQUIRE(std::equal(puzzle.tensor(), puzzle.tensor() + n * n * puzzle.slabWords(), expected.tensor()));
+
+    usp::SolverStatus status = session.solve(puzzle);
+    REQUIRE(status == usp::MatchingSolve(expected).status);
+    REQUIRE(session.rho().size() == (status == usp::SolverStatus::WEAK ? n : 0));
+    if (status == usp::SolverStatus::WEAK) {
+      REQUIRE(!usp::IsIdentityWitness(session.rho(), session.sigma()));
+      REQUIRE(usp::FirstFailingRow(puzzle, session.rho(), session.sigma()) == usp::kNoFailingRow);
+    }
+  }
+
+  const std::vector<int> invalid{ 1, 2, 0, 3 };
+  REQUIRE_THROWS_AS(puzzle.assign(invalid.data(), 2, 2), std::invalid_argument);
+  REQUIRE(puzzle.rows() == 1 + (199 * 7) % 9);
+}
+
+TEST_CASE("Solver session trials do not allocate once reserved", "[solver]")
+{
+  usp::UspGenerator generator(7);
+  usp::SolverSession session(12);
+  usp::Usp puzzle({}, 0, 0);
+  puzzle.reserve(12, 15);
+  generator.reserve(12, 15);
+  unsigned long long allocations = 0;
+  unsigned int weak = 0;
+  for (unsigned int trial = 0; trial < 300; ++trial) {
+    const unsigned int n = 1 + trial % 12;
+    const unsigned int k = trial % 2 == 0 ? 10 : 15;
+    const unsigned long long before = usp::AllocationCount();
+    generator.generateRandomPuzzle(puzzle, n, k);
+    if (session.solve(puzzle) == usp::SolverStatus::WEAK) {
+      ++weak;
+    }
+    allocations += usp::AllocationCount() - before;
+  }
+  REQUIRE(weak > 0);
+  REQUIRE(allocations == 0);
+}
+
+TEST_CASE("Lockstep batches agree with CDCL Solver on tiny puzzles", "[solver]")
+{
+  usp::UspGenerator generator(11);
+  for (unsigned int n = 1; n <= usp::kLockstepMaxRows; ++n) {
+    for (unsigned int k : { 1U, 2U, 3U, 5U, 8U }) {
+      usp::LockstepBatch batch(n);
+      std::vector<usp::Usp> puzzles;
+      // A partial batch as well as a full one
+      for (std::size_t count : { std::size_t{ 37 }, usp::kLockstepLanes }) {
+        batch.clear();
+        puzzles.clear();
+        for (std::size_t lane = 0; lane < count; ++lane) {
+          puzzles.push_back(generator.generateRandomPuzzle(n, k));
+          REQUIRE(batch.add(puzzles.back()) == lane);
+        }
+        batch.solve();
+        for (std::size_t lane = 0; lane < count; ++lane) {
+          REQUIRE(batch.weak(lane) == usp::CdclSolver(puzzles[lane]).has_value());
+          if (batch.weak(lane)) {
+            REQUIRE(usp::FirstFailingRow(puzzles[lane], batch.rho(lane), batch.sigma(lane)) == usp::kNoFailingRow);
+          }
+        }
+      }
+      REQUIRE_THROWS_AS(batch.add(generator.generateRandomPuzzle(n, k)), std::length_error);
+      REQUIRE_THROWS_AS(batch.add(generator.generateRandomPuzzle(n + 1, k)), std::invalid_argument);
+    }
+  }
+  REQUIRE_THROWS_AS(usp::LockstepBatch(usp::kLockstepMaxRows + 1), std::invalid_argument);
+}
+
+TEST_CASE("Incremental SAT solver keeps clauses between solves", "[solver]")
+{
+  usp::IncrementalSatSolver solver;
+  int a = solver.newVariable();
+  int b = solver.newVariable();
+  REQUIRE(solver.addClause({ a, b }));
+  REQUIRE(solver.solve({ -a }) == usp::IncrementalSatSolver::Result::SATISFIABLE);
+  REQUIRE(solver.modelValue(b));
+  REQUIRE(solver.addClause({ -b }));
+  REQUIRE(solver.solve({ -a }) == usp::IncrementalSatSolver::Result::UNSATISFIABLE);
+  REQUIRE(solver.solve() == usp::IncrementalSatSolver::Result::SATISFIABLE);
+  REQUIRE(solver.modelValue(a));
+}
+
+TEST_CASE("DIMACS export round trips through the SAT solver", "[dimacs]")
+{
+  usp::UspGenerator generator(7);
+  for (unsigned int trial = 0; trial < 50; ++trial) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(2 + trial % 7, 2 + trial % 5);
+    std::stringstream cnf;
+    usp::WriteDimacs(puzzle, cnf);
+
+    std::string text = cnf.str();
+    auto clauses = static_cast<std::size_t>(std::count(text.begin(), text.end(), '\n')) - puzzle.rows() - 2;
+    REQUIRE(clauses == usp::DimacsClauseCount(puzzle));
+
+    usp::Usp stored = usp::ReadDimacsPuzzle(cnf);
+    REQUIRE(std::equal(stored.tensor(), stored.tensor() + puzzle.rows() * puzzle.rows() * puzzle.slabWords(), puzzle.tensor()));
+
+    cnf.seekg(0);
+    usp::IncrementalSatSolver solver;
+    usp::LoadDimacs(cnf, solver);
+    std::stringstream model;
+    if (solver.solve() == usp::IncrementalSatSolver::Result::SATISFIABLE) {
+      model << "s SATISFIABLE\nv";
+      for (int variable = 1; variable <= solver.variables(); ++variable) {
+        model << " " << (solver.modelValue(variable) ? variable : -variable);
+      }
+      model << " 0\n";
+    } else {
+      model << "s UNSATISFIABLE\n";
+    }
+    auto witness = usp::ReadDimacsWitness(puzzle, model);
+    REQUIRE(witness.has_value() == usp::CdclSolver(puzzle).has_value());
+  }
+}
+
+TEST_CASE("DRAT proofs of strong puzzles pass the backward checker", "[dimacs]")
+{
+  std::vector<usp::Usp> puzzles{ data::medStrongPuzzle };
+  usp::UspGenerator generator(7);
+  while (puzzles.size() < 6) {
+    usp::Usp puzzle = generator.generateRandomPuzzle(7, 6);
+    if (usp::CnfSolve(puzzle).status == usp::SolverStatus::STRONG) {
+      puzzles.push_back(puzzle);
+    }
+  }
+  for (const usp::Usp &puzzle : puzzles) {
+    std::stringstream cnf;
+    usp::WriteDimacs(puzzle, cnf);
+    std::stringstream proof;
+    {
+      usp::IncrementalSatSolver solver;
+      usp::DratWriter writer(proof);
+      solver.setProof(&writer);
+      usp::LoadDimacs(cnf, solver);
+      REQUIRE(solver.solve() == usp::IncrementalSatSolver::Result::UNSATISFIABLE);
+    }
+
+    cnf.clear();
+    cnf.seekg(0);
+    usp::DratChecker checker;
+    usp::LoadDimacs(cnf, checker);
+    checker.readProof(proof);
+    usp::DratResult result = checker.check();
+    REQUIRE(result.verified);
+    REQUIRE(result.checkedLemmas <= result.lemmas);
+    REQUIRE(result.coreClauses <= usp::DimacsClauseCount(puzzle));
+
+    // The trimmed core is unsatisfiable on its own
+    usp::IncrementalSatSolver coreSolver;
+    for (const auto &clause : checker.core()) {
+      coreSolver.addClause(clause);
+    }
+    REQUIRE(coreSolver.solve() == usp::IncrementalSatSolver::Result::UNSATISFIABLE);
+  }
+
+  // The empty clause alone is no proof that the puzzle is strong
+  std::stringstream cnf;
+  usp::WriteDimacs(data::medStrongPuzzle, cnf);
+  usp::DratChecker checker;
+  usp::LoadDimacs(cnf, checker);
+  std::stringstream empty(std::string("a\0", 2));
+  checker.readProof(empty);
+  usp::DratResult result = checker.check();
+  REQUIRE(result.conflict);
+  REQUIRE(!result.verified);
+  std::stringstream malformed("x");
+  REQUIRE_THROWS_AS(checker.readProof(malformed), std::runtime_error);
+  // A literal cut off after its continuation byte, which uspcheck reports with exit code 1
+  std::stringstream truncated(std::string("a\x80", 2));
+  REQUIRE_THROWS_AS(checker.readProof(truncated), std::runtime_error);
+}
+
+TEST_CASE("DIMACS models that are not witnesses are rejected", "[dimacs]")
+{
+  std::stringstream transposition("SAT\n-1 2 3 -4 5 -6 -7 8 0\n");
+  REQUIRE_THROWS_AS(usp::ReadDimacsWitness(data::strongPuzzle, transposition), std::runtime_error);
+  // The identity pair passes the row check of every puzzle, but is no witness
+  std::stringstream identity("SAT\n1 -2 -3 4 5 -6 -7 8 0\n");
+  REQUIRE_THROWS_AS(usp::ReadDimacsWitness(data::strongPuzzle, identity), std::runtime_error);
+  std::stringstream incomplete("SAT\n1 -2 -3 -4 5 -6 -7 8 0\n");
+  REQUIRE_THROWS_AS(usp::ReadDimacsModel(incomplete, 2), std::runtime_error);
+  std::stringstream undecided("s UNKNOWN\n");
+  REQUIRE_THROWS_AS(usp::ReadDimacsModel(undecided, 2), std::runtime_error);
+}
+
+TEST_CASE("Appending rows matches building the puzzle at once", "[usp]")
+{
+  std::mt19937 generator(3);
+  std::uniform_int_distribution<int> element(1, 3);
+  for (unsigned int k : { 1U, 5U, 12U }) {
+    std::vector<int> data;
+    usp::Usp grown({}, 0, k);
+    for (unsigned int n = 1; n <= 70; ++n) {
+      std::vector<int> row(k);
+      std::generate(row.begin(), row.end(), [&]() { return element(generator); });
+      data.insert(data.end(), row.begin(), row.end());
+      grown.appendRow(row);
+    }
+    usp::Usp built(data, 70, k);
+    REQUIRE(grown.slabWords() == built.slabWords());
+    REQUIRE(std::equal(built.tensor(), built.tensor() + 70 * 70 * built.slabWords(), grown.tensor()));
+
+    for (unsigned int n = 70; n > 60; --n) {
+      grown.popRow();
+    }
+    data.resize(60 * k);
+    usp::Usp shrunk(data, 60, k);
+    REQUIRE(grown.slabWords() == shrunk.slabWords());
+    REQUIRE(std::equal(shrunk.tensor(), shrunk.tensor() + 60 * 60 * shrunk.slabWords(), grown.tensor()));
+  }
+}
+
+TEST_CASE("Lazy tensor matches the eager tensor under eviction", "[usp]")
+{
+  std::mt19937 generator(11);
+  std::uniform_int_distribution<int> element(1, 3);
+  for (unsigned int n : { 5U, 70U }) {
+    std::vector<int> data(n * 6);
+    std::generate(data.begin(), data.end(), [&]() { return element(generator); });
+    usp::Usp eager(data, n, 6);
+    usp::Usp lazy(data, n, 6, 7);
+    REQUIRE(lazy.lazy());
+    REQUIRE_THROWS_AS(lazy.tensor(), std::logic_error);
+
+    // Random slabs far outnumber the cache, so most are evicted and computed again
+    std::uniform_int_distribution<unsigned int> row(0, n - 1);
+    for (unsigned int access = 0; access < 2000; ++access) {
+      const unsigned int a = row(generator);
+      const unsigned int b = row(generator);
+      REQUIRE(std::equal(eager.slab(a, b), eager.slab(a, b) + eager.slabWords(), lazy.slab(a, b)));
+      const unsigned int c = row(generator);
+      REQUIRE(lazy.query(a, b, c) == eager.query(a, b, c));
+    }
+    REQUIRE(lazy.slabsComputed() > 7);
+    REQUIRE(usp::MatchingSolve(lazy).status == usp::MatchingSolve(eager).status);
+
+    std::vector<int> extra(6);
+    std::generate(extra.begin(), extra.end(), [&]() { return element(generator); });
+    eager.appendRow(extra);
+    lazy.appendRow(extra);
+    for (unsigned int a = 0; a <= n; ++a) {
+      for (unsigned int b = 0; b <= n; ++b) {
+        REQUIRE(std::equal(eager.slab(a, b), eager.slab(a, b) + eager.slabWords(), lazy.slab(a, b)));
+      }
+    }
+    eager.popRow();
+    lazy.popRow();
+    for (unsigned int a = 0; a < n; ++a) {
+      for (unsigned int b = 0; b < n; ++b) {
+        REQUIRE(std::equal(eager.slab(a, b), eager.slab(a, b) + eager.slabWords(), lazy.slab(a, b)));
+      }
+    }
+  }
+}
+
+TEST_CASE("Lazy puzzles are kept off shared threads and cache every slab by default", "[usp]")
+{
+  usp::UspGenerator generator(13);
+  const usp::Usp eager = generator.generateRandomPuzzle(6, 3);
+  std::vector<int> cells;
+  for (unsigned int i = 0; i < eager.rows(); ++i) {
+    for (unsigned int j = 0; j < eager.cols(); ++j) {
+      cells.push_back(eager.element(i, j));
+    }
+  }
+  const usp::Usp lazy(cells, eager.rows(), eager.cols(), usp::Usp::kCacheEverySlab);
+  REQUIRE(lazy.lazy());
+
+  REQUIRE_THROWS_AS(usp::BasicSolver(lazy), std::invalid_argument);
+  REQUIRE_THROWS_AS(usp::BasicSolver(lazy, 2), std::invalid_argument);
+  REQUIRE_THROWS_AS(usp::DpllCountWitnesses(lazy), std::invalid_argument);
+  REQUIRE_THROWS_AS(usp::CdclCountWitnesses(lazy, 4), std::invalid_argument);
+  REQUIRE_THROWS_AS(usp::SolveBatch({ &lazy, &eager, &lazy }, &usp::CdclSolve, usp::SolverLimits{}, 2), std::invalid_argument);
+
+  // One thread per lazy puzzle is safe, and agrees with the eager puzzle
+  REQUIRE(usp::BasicSolver(lazy, 1).has_value() == usp::BasicSolver(eager, 1).has_value());
+  REQUIRE(usp::DpllCountWitnesses(lazy, 1) == usp::DpllCountWitnesses(eager));
+  REQUIRE(usp::CdclCountWitnesses(lazy, 1) == usp::CdclCountWitnesses(eager));
+  const auto batch = usp::SolveBatch({ &lazy, &eager, &lazy }, &usp::CdclSolve, usp::SolverLimits{}, 1);
+  REQUIRE(batch[0].status == batch[1].status);
+  REQUIRE(batch[2].status == batch[1].status);
+
+  // With every slab cached, a matching solve computes no slab twice
+  const usp::Usp fresh(cells, eager.rows(), eager.cols(), usp::Usp::kCacheEverySlab);
+  REQUIRE(usp::MatchingSolve(fresh).status == usp::MatchingSolve(eager).status);
+  REQUIRE(fresh.slabsComputed() <= static_cast<std::size_t>(eager.rows()) * eager.rows());
+}
+
+TEST_CASE("Incremental USP solver agrees with solving each puzzle from scratch", "[solver]")
+{
+  std::mt19937 generator(5);
+  std::uniform_int_distribution<int> element(1, 3);
+  for (unsigned int trial = 0; trial < 10; ++trial) {
+    // Grow a strong puzzle, removing candidate rows that make it weak
+    const unsigned int k = 4 + trial % 3;
+    usp::IncrementalUspSolver solver(usp::Usp({}, 0, k));
+    for (unsigned int candidate = 0; candidate < 40; ++candidate) {
+      std::vector<int> row(k);
+      std::generate(row.begin(), row.end(), [&]() { return element(generator); });
+      solver.appendRow(row);
+      usp::SolverResult result = solver.solve();
+      REQUIRE(result.status == usp::CnfSolve(solver.puzzle()).status);
+      if (result.witness.has_value()) {
+        REQUIRE(usp::VerifyUspWeakness(solver.puzzle(), result.witness->first, result.witness->second));
+        solver.popRow();
+      }
+    }
+    REQUIRE(usp::CnfSolve(solver.puzzle()).status == usp::SolverStatus::STRONG);
+  }
+}
+
+TEST_CASE("Strong USP search only accepts strong rows", "[search]")
+{
+  usp::StrongSearchOptions options;
+  options.threads = 2;
+  options.candidates = 16;
+  options.seed = 7;
+  usp::StrongUspSearch search(4, options);
+  for (unsigned int step = 0; step < 20; ++step) {
+    search.step();
+    REQUIRE(usp::CnfSolve(search.puzzle()).status == usp::SolverStatus::STRONG);
+  }
+  REQUIRE(search.best().size() >= 4);
+  REQUIRE(search.stats().accepted > 0);
+
+  const TemporaryFile checkpoint("usp_strong_search_test.txt");
+  const std::string &path = checkpoint.path;
+  usp::SaveCheckpoint(path, 4, search.best());
+  REQUIRE(usp::LoadCheckpoint(path, 4) == search.best());
+  REQUIRE_THROWS_AS(usp::LoadCheckpoint(path, 5), std::runtime_error);
+}
+
+TEST_CASE("Packed cells and corpus files round trip puzzles", "[corpus]")
+{
+  usp::UspGenerator generator(7);
+  std::vector<usp::Usp> puzzles;
+  for (unsigned int i = 0; i < 50; ++i) {
+    puzzles.push_back(generator.generateRandomPuzzle(1 + i % 13, 1 + i % 7));
+  }
+  REQUIRE_THROWS_AS(usp::Usp({ 1, 4 }, 1, 2), std::invalid_argument);
+
+  const TemporaryFile corpus("usp_corpus_test.bin");
+  const std::string &path = corpus.path;
+  {
+    usp::CorpusWriter writer(path);
+    for (const usp::Usp &puzzle : puzzles) {
+      writer.add(puzzle);
+    }
+    writer.finish();
+  }
+
+  usp::CorpusReader reader(path);
+  REQUIRE(reader.size() == puzzles.size());
+  for (std::size_t i = 0; i < puzzles.size(); ++i) {
+    usp::PackedCellsView view = reader.view(i);
+    REQUIRE(view.rows() == puzzles[i].rows());
+    REQUIRE(view.cols() == puzzles[i].cols());
+    for (unsigned int row = 0; row < view.rows(); ++row) {
+      for (unsigned int col = 0; col < view.cols(); ++col) {
+        REQUIRE(view.element(row, col) == puzzles[i].element(row, col));
+      }
+    }
+    usp::Usp loaded = reader.puzzle(i);
+    REQUIRE(std::equal(loaded.tensor(), loaded.tensor() + loaded.rows() * loaded.rows() * loaded.slabWords(), puzzles[i].tensor()));
+  }
+  REQUIRE_THROWS_AS(reader.view(puzzles.size()), std::out_of_range);
+
+  std::ofstream(path, std::ios::binary) << "not a corpus";
+  REQUIRE_THROWS_AS(usp::CorpusReader(path), std::runtime_error);
+}
+
+TEST_CASE("Corpus baselines round trip and flag regressions", "[corpus]")
+{
+  usp::UspGenerator generator(5);
+  usp::HardestPuzzles hardest(3);
+  for (unsigned int i = 0; i < 10; ++i) {
+    // Conflicts 0, 7, 4, 1, 8, 5, 2, 9, 6, 3 in that order, the times running the other way
+    const unsigned int conflicts = i * 7 % 10;
+    const usp::InstanceBaseline baseline{ 4, 5, usp::SolverStatus::STRONG, static_cast<double>(10 - conflicts), i, conflicts };
+    hardest.offer(generator.generateRandomPuzzle(4, 5), baseline);
+  }
+  // Equal conflicts rank by decisions
+  REQUIRE(hardest.offer(generator.generateRandomPuzzle(4, 5), { 4, 5, usp::SolverStatus::STRONG, 0.5, 100, 7 }));
+  REQUIRE(!hardest.offer(generator.generateRandomPuzzle(4, 5), { 4, 5, usp::SolverStatus::STRONG, 100, 0, 7 }));
+  REQUIRE(hardest.size() == 3);
+  usp::CorpusBaselines baselines{ "cdcl", {} };
+  for (const auto &[puzzle, baseline] : hardest.take()) {
+    REQUIRE(puzzle.rows() == 4);
+    baselines.instances.push_back(baseline);
+  }
+  REQUIRE(hardest.size() == 0);
+  REQUIRE(baselines.instances.size() == 3);
+  REQUIRE(baselines.instances[0].conflicts == 9);
+  REQUIRE(baselines.instances[1].conflicts == 8);
+  REQUIRE(baselines.instances[2].conflicts == 7);
+  REQUIRE(baselines.instances[2].decisions == 100);
+  REQUIRE(baselines.instances[0].milliseconds == 1);
+  baselines.instances[1].status = usp::SolverStatus::WEAK;
+  baselines.instances[2].milliseconds = 0.125;
+
+  std::stringstream file;
+  usp::WriteBaselines(file, baselines);
+  const usp::CorpusBaselines read = usp::ReadBaselines(file);
+  REQUIRE(read.solver == "cdcl");
+  REQUIRE(read.instances.size() == baselines.instances.size());
+  for (std::size_t i = 0; i < read.instances.size(); ++i) {
+    REQUIRE(read.instances[i].rows == baselines.instances[i].rows);
+    REQUIRE(read.instances[i].cols == baselines.instances[i].cols);
+    REQUIRE(read.instances[i].status == baselines.instances[i].status);
+    REQUIRE(read.instances[i].milliseconds == baselines.instances[i].milliseconds);
+    REQUIRE(read.instances[i].decisions == baselines.instances[i].decisions);
+    REQUIRE(read.instances[i].conflicts == baselines.instances[i].conflicts);
+  }
+
+  std::istringstream otherVersion("# uspcorpus baseline 0 solver=cdcl\n");
+  REQUIRE_THROWS_AS(usp::ReadBaselines(otherVersion), std::runtime_error);
+  std::istringstream malformed("# uspcorpus baseline 1 solver=cdcl\nindex,rows,cols,verdict,ms,decisions,conflicts\n0,4,5,unknown,1,1,1\n");
+  REQUIRE_THROWS_AS(usp::ReadBaselines(malformed), std::runtime_error);
+  baselines.instances[0].status = usp::SolverStatus::UNKNOWN;
+  REQUIRE_THROWS_AS(usp::WriteBaselines(file, baselines), std::invalid_argument);
+
+  const usp::InstanceBaseline baseline{ 4, 5, usp::SolverStatus::WEAK, 100, 0, 0 };
+  REQUIRE(usp::CompareToBaseline(baseline, usp::SolverStatus::WEAK, 120, 0.25, 1) == usp::ReplayOutcome::UNCHANGED);
+  REQUIRE(usp::CompareToBaseline(baseline, usp::SolverStatus::WEAK, 130, 0.25, 1) == usp::ReplayOutcome::SLOWER);
+  REQUIRE(usp::CompareToBaseline(baseline, usp::SolverStatus::WEAK, 130, 0.25, 50) == usp::ReplayOutcome::UNCHANGED);
+  REQUIRE(usp::CompareToBaseline(baseline, usp::SolverStatus::STRONG, 10, 0.25, 1) == usp::ReplayOutcome::VERDICT_CHANGED);
+  REQUIRE(usp::CompareToBaseline(baseline, usp::SolverStatus::UNKNOWN, 10, 0.25, 1) == usp::ReplayOutcome::VERDICT_CHANGED);
+}
+
+TEST_CASE("Batch server solves a stream of puzzles", "[batchserver]")
+{
+  usp::UspGenerator generator(7);
+  std::vector<usp::Usp> puzzles;
+  std::ostringstream text;
+  std::string binary;
+  for (unsigned int i = 0; i < 40; ++i) {
+    puzzles.push_back(generator.generateRandomPuzzle(1 + i % 6, 1 + i % 4));
+    const usp::Usp &puzzle = puzzles.back();
+    for (unsigned int row = 0; row < puzzle.rows(); ++row) {
+      text << (row == 0 ? "" : " ");
+      for (unsigned int col = 0; col < puzzle.cols(); ++col) {
+        text << puzzle.element(row, col);
+      }
+    }
+    text << "\n";
+    for (std::uint32_t field : { puzzle.rows(), puzzle.cols() }) {
+      for (unsigned int byte = 0; byte < 4; ++byte) {
+        binary.push_back(static_cast<char>((field >> (8 * byte)) & 0xff));
+      }
+    }
+    usp::PackedCellsView cells = puzzle.cells();
+    binary.append(reinterpret_cast<const char *>(cells.data()), cells.bytes());
+  }
+
+  for (bool binaryInput : { false, true }) {
+    for (bool ordered : { true, false }) {
+      usp::BatchServerOptions options;
+      options.threads = 4;
+      options.maxInFlight = 3;
+      options.ordered = ordered;
+      options.binary = binaryInput;
+      usp::BatchServer server(usp::CnfSolve, options);
+      std::istringstream in(binaryInput ? binary : text.str() + "# comment\n1234\n");
+      std::ostringstream out;
+      usp::BatchServerStats stats = server.run(in, out);
+      REQUIRE(stats.puzzles == puzzles.size() + (binaryInput ? 0 : 1));
+      REQUIRE(stats.errors == (binaryInput ? 0 : 1));
+      REQUIRE(stats.peakInFlight <= options.maxInFlight);
+
+      std::istringstream lines(out.str());
+      std::string line;
+      std::vector<bool> seen(stats.puzzles, false);
+      unsigned long long previous = 0;
+      while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        unsigned long long index = 0;
+        std::string verdict;
+        words >> index >> verdict;
+        REQUIRE(index < stats.puzzles);
+        REQUIRE(!seen[index]);
+        if (ordered) {
+          REQUIRE(index == previous);
+        }
+        previous = index + 1;
+        seen[index] = true;
+        if (index == puzzles.size()) {
+          REQUIRE(verdict == "error");
+          continue;
+        }
+        REQUIRE(verdict == (usp::BasicSolver(puzzles[index], 1).has_value() ? "weak" : "strong"));
+      }
+      REQUIRE(std::all_of(seen.begin(), seen.end(), [](bool value) { return value; }));
+    }
+  }
+
+  usp::BatchServer server(usp::CnfSolve, { 1, 4, true, true, {} });
+  std::istringstream truncated(binary.substr(0, 10));
+  std::ostringstream out;
+  REQUIRE_THROWS_AS(server.run(truncated, out), std::runtime_error);
+
+  // A huge header is an error, not an allocation, and a record too large to skip is truncated
+  const std::string huge(8, '\xff');
+  std::istringstream hugeThenEnd(huge);
+  REQUIRE_THROWS_AS(server.run(hugeThenEnd, out), std::runtime_error);
+  std::string oversized;
+  for (std::uint32_t field : { 300U, 1U }) {
+    for (unsigned int byte = 0; byte < 4; ++byte) {
+      oversized.push_back(static_cast<char>((field >> (8 * byte)) & 0xff));
+    }
+  }
+  oversized.append(usp::PackedCellsView::PackedBytes(300, 1), '\x55');
+  std::istringstream oversizedThenPuzzles(oversized + binary);
+  std::ostringstream oversizedOut;
+  usp::BatchServerStats stats = server.run(oversizedThenPuzzles, oversizedOut);
+  REQUIRE(stats.puzzles == puzzles.size() + 1);
+  REQUIRE(stats.errors == 1);
+  REQUIRE(oversizedOut.str().rfind("0 error puzzle of 300x1 is larger than 256x256\n", 0) == 0);
+
+  // A throwing solve is reported for its puzzle, and the others are still solved
+  usp::BatchServer throwing([](const usp::Usp &puzzle, const usp::SolverLimits &limits) {
+    if (puzzle.rows() == 3) {
+      throw std::runtime_error("solver failed");
+    }
+    return usp::CnfSolve(puzzle, limits);
+  },
+    { 2, 4, true, true, {} });
+  std::istringstream all(binary);
+  std::ostringstream throwingOut;
+  stats = throwing.run(all, throwingOut);
+  REQUIRE(stats.errors == static_cast<unsigned long long>(std::count_if(puzzles.begin(), puzzles.end(), [](const usp::Usp &puzzle) { return puzzle.rows() == 3; })));
+  REQUIRE(stats.weak + stats.strong + stats.errors == puzzles.size());
+
+  // So is a result whose line can not be formatted, here a witness without assignments
+  usp::BatchServer unformattable([](const usp::Usp &puzzle, const usp::SolverLimits &) {
+    usp::SolverResult result;
+    result.status = usp::SolverStatus::WEAK;
+    result.witness = std::make_pair(usp::Permutation(puzzle.rows()), usp::Permutation(puzzle.rows()));
+    return result;
+  },
+    { 2, 4, true, true, {} });
+  std::istringstream again(binary);
+  std::ostringstream unformattableOut;
+  stats = unformattable.run(again, unformattableOut);
+  REQUIRE(stats.errors == puzzles.size());
+  REQUIRE(stats.weak == 0);
+  REQUIRE(unformattableOut.str().rfind("0 error ", 0) == 0);
+}
+
+TEST_CASE("Batch solves match single solves of puzzles built from bytes", "[batchserver]")
+{
+  usp::UspGenerator generator(7);
+  std::vector<usp::Usp> puzzles;
+  for (unsigned int i = 0; i < 30; ++i) {
+    const usp::Usp puzzle = generator.generateRandomPuzzle(2 + i % 7, 2 + i % 5);
+    std::vector<std::int8_t> bytes;
+    for (unsigned int row = 0; row < puzzle.rows(); ++row) {
+      for (unsigned int col = 0; col < puzzle.cols(); ++col) {
+        bytes.push_back(static_cast<std::int8_t>(puzzle.element(row, col)));
+      }
+    }
+    puzzles.emplace_back(bytes.data(), puzzle.rows(), puzzle.cols());
+    REQUIRE(std::equal(puzzle.tensor(), puzzle.tensor() + puzzle.rows() * puzzle.rows() * puzzle.slabWords(), puzzles.back().tensor()));
+  }
+  const std::int8_t invalid[] = { 1, 2, 0, 3 };
+  REQUIRE_THROWS_AS(usp::Usp(invalid, 2, 2), std::invalid_argument);
+
+  std::vector<const usp::Usp *> pointers;
+  for (const usp::Usp &puzzle : puzzles) {
+    pointers.push_back(&puzzle);
+  }
+  for (unsigned int threads : { 1U, 4U }) {
+    const std::vector<usp::SolverResult> results = usp::SolveBatch(pointers, usp::CdclSolve, {}, threads);
+    REQUIRE(results.size() == puzzles.size());
+    for (std::size_t i = 0; i < puzzles.size(); ++i) {
+      REQUIRE(results[i].status == usp::CdclSolve(puzzles[i], {}).status);
+      if (results[i].witness.has_value()) {
+        REQUIRE(usp::VerifyUspWeakness(puzzles[i], results[i].witness->first, results[i].witness->second));
+      }
+    }
+  }
+
+  auto failing = [](const usp::Usp &puzzle, const usp::SolverLimits &limits) {
+    if (puzzle.rows() == 5) {
+      throw std::runtime_error("solve failed");
+    }
+    return usp::CdclSolve(puzzle, limits);
+  };
+  REQUIRE_THROWS_AS(usp::SolveBatch(pointers, failing, {}, 3), std::runtime_error);
+}
+
+TEST_CASE("Generator is reproducible and supports structured puzzles", "[generator]")
+{
+  usp::UspGenerator first(42, 1);
+  usp::UspGenerator second(42, 1);
+  usp::UspGenerator other(42, 2);
+  usp::Usp a = first.generateRandomPuzzle(20, 15);
+  usp::Usp b = second.generateRandomPuzzle(20, 15);
+  usp::Usp c = other.generateRandomPuzzle(20, 15);
+  REQUIRE(std::equal(a.cells().data(), a.cells().data() + a.cells().bytes(), b.cells().data()));
+  REQUIRE(!std::equal(a.cells().data(), a.cells().data() + a.cells().bytes(), c.cells().data()));
+
+  std::vector<int> cells(300000);
+  first.fill(cells.data(), cells.size());
+  for (int symbol = 1; symbol <= 3; ++symbol) {
+    const auto count = static_cast<double>(std::count(cells.begin(), cells.end(), symbol));
+    REQUIRE(std::abs(count / static_cast<double>(cells.size()) - 1.0 / 3) < 0.01);
+  }
+  first.setSymbolWeights({ 1, 0, 3 });
+  first.fill(cells.data(), cells.size());
+  REQUIRE(std::count(cells.begin(), cells.end(), 2) == 0);
+  REQUIRE(std::abs(static_cast<double>(std::count(cells.begin(), cells.end(), 1)) / static_cast<double>(cells.size()) - 0.25) < 0.01);
+  REQUIRE_THROWS_AS(first.setSymbolWeights({ 0, 0, 0 }), std::invalid_argument);
+
+  for (unsigned int n = 2; n < 40; ++n) {
+    usp::PlantedPuzzle planted = second.generatePlantedWeakPuzzle(n, 1 + n % 9);
+    REQUIRE(usp::FirstFailingRow(planted.puzzle, planted.rho, planted.sigma) == usp::kNoFailingRow);
+    REQUIRE(!(std::is_sorted(planted.rho.begin(), planted.rho.end()) && std::is_sorted(planted.sigma.begin(), planted.sigma.end())));
+  }
+  REQUIRE_THROWS_AS(second.generatePlantedWeakPuzzle(1, 3), std::invalid_argument);
+
+  usp::Usp perturbed = second.generatePerturbedPuzzle(data::strongPuzzle, 2);
+  unsigned int changed = 0;
+  for (unsigned int row = 0; row < perturbed.rows(); ++row) {
+    for (unsigned int col = 0; col < perturbed.cols(); ++col) {
+      changed += perturbed.element(row, col) != data::strongPuzzle.element(row, col);
+    }
+  }
+  REQUIRE(changed == 2);
+}
+
+TEST_CASE("Solver trace keeps the latest records and round trips", "[trace]")
+{
+  usp::SolverTrace trace(5);
+  for (std::uint32_t i = 0; i < 20; ++i) {
+    trace.record(usp::TraceEvent::DECISION, i, i, 2 * i, 1);
+  }
+  std::vector<usp::TraceRecord> records = trace.records();
+  REQUIRE(records.size() == 8);
+  REQUIRE(trace.dropped() == 12);
+  REQUIRE(records.front().a == 12);
+  REQUIRE(records.back().b == 38);
+
+  std::stringstream binary;
+  trace.writeBinary(binary);
+  std::vector<usp::TraceRecord> read = usp::ReadBinaryTrace(binary);
+  REQUIRE(read.size() == records.size());
+  for (std::size_t i = 0; i < read.size(); ++i) {
+    REQUIRE(read[i].nanoseconds == records[i].nanoseconds);
+    REQUIRE(read[i].a == records[i].a);
+    REQUIRE(read[i].depth == records[i].depth);
+    REQUIRE(read[i].event == records[i].event);
+  }
+  std::stringstream garbage("not a trace");
+  REQUIRE_THROWS_AS(usp::ReadBinaryTrace(garbage), std::runtime_error);
+
+  std::ostringstream json;
+  trace.writeChromeJson(json);
+  REQUIRE(json.str().find("\"traceEvents\"") != std::string::npos);
+  REQUIRE(json.str().find("\"name\":\"decision\"") != std::string::npos);
+
+  // After the ring wraps, an end without its begin is dropped and an open begin is closed
+  auto count = [](const std::string &text, const std::string &phase) {
+    std::size_t found = 0;
+    for (std::size_t at = text.find(phase); at != std::string::npos; at = text.find(phase, at + 1)) {
+      ++found;
+    }
+    return found;
+  };
+  usp::SolverTrace wrapped(4);
+  wrapped.record(usp::TraceEvent::PROPAGATION_BEGIN, 0);
+  wrapped.record(usp::TraceEvent::DECISION, 1);
+  wrapped.record(usp::TraceEvent::PROPAGATION_END, 1, 3);
+  wrapped.record(usp::TraceEvent::PROPAGATION_BEGIN, 1);
+  wrapped.record(usp::TraceEvent::PROPAGATION_END, 1, 2);
+  wrapped.record(usp::TraceEvent::PROPAGATION_BEGIN, 2);
+  REQUIRE(wrapped.dropped() == 2);
+  REQUIRE(wrapped.records().front().event == usp::TraceEvent::PROPAGATION_END);
+  json.str("");
+  wrapped.writeChromeJson(json);
+  REQUIRE(count(json.str(), "\"ph\":\"B\"") == 2);
+  REQUIRE(count(json.str(), "\"ph\":\"E\"") == 2);
+  REQUIRE(json.str().find("\"ph\":\"E\"") > json.str().find("\"ph\":\"B\""));
+  REQUIRE(json.str().rfind("\"ph\":\"E\"") > json.str().rfind("\"ph\":\"B\""));
+
+#if defined(USP_ENABLE_TRACE)
+  trace = usp::SolverTrace();
+  usp::SolverLimits limits;
+  limits.trace = &trace;
+  usp::SolverResult result = usp::CdclSolve(data::strongPuzzle, limits);
+  records = trace.records();
+  REQUIRE(static_cast<unsigned long long>(std::count_if(records.begin(), records.end(), [](const usp::TraceRecord &record) { return record.event == usp::TraceEvent::DECISION; })) == result.stats.decisions);
+#endif
+}
+
+TEST_CASE("Performance counters count or report themselves unavailable", "[perf]")
+{
+  usp::PerfCounters counters;
+  counters.start();
+  usp::CdclSolve(data::weakPuzzle, {});
+  usp::PerfSample sample = counters.stop();
+  for (std::size_t c = 0; c < usp::kPerfCounters; ++c) {
+    const auto counter = static_cast<usp::PerfCounter>(c);
+    REQUIRE(sample[counter].has_value() == counters.available(counter));
+  }
+  if (counters.available(usp::PerfCounter::INSTRUCTIONS)) {
+    REQUIRE(*sample[usp::PerfCounter::INSTRUCTIONS] > 0);
+  }
+}
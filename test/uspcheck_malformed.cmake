@@ -0,0 +1,12 @@
+# Runs uspcheck on a proof cut off inside its first step, which it must
+# reject with exit code 1 rather than abort. Run by ctest with
+# -DUSPCHECK=<path of uspcheck> -DWORK_DIR=<scratch directory>.
+file(WRITE ${WORK_DIR}/uspcheck_formula.cnf "p cnf 1 1\n1 0\n")
+file(WRITE ${WORK_DIR}/uspcheck_truncated.drat "a")
+execute_process(
+  COMMAND ${USPCHECK} ${WORK_DIR}/uspcheck_formula.cnf ${WORK_DIR}/uspcheck_truncated.drat
+  RESULT_VARIABLE result)
+file(REMOVE ${WORK_DIR}/uspcheck_formula.cnf ${WORK_DIR}/uspcheck_truncated.drat)
+if(NOT result EQUAL 1)
+  message(FATAL_ERROR "uspcheck exited with '${result}' on a truncated proof, expected 1")
+endif()